@@ -0,0 +1,238 @@
+//
+//  FileWatch.cpp
+//  MiniScript
+//
+
+#include "FileWatch.h"
+#include <string.h>
+
+#if defined(__linux__)
+	#include <unistd.h>
+	#include <poll.h>
+	#include <dirent.h>
+	#include <sys/stat.h>
+	#include <sys/inotify.h>
+	#define USE_INOTIFY 1
+#endif
+
+namespace MiniScript {
+
+#if USE_INOTIFY
+
+static const uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB
+	| IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+// How long to wait for more events after some arrive, before calling it a
+// batch (and at most how many times to keep waiting, if they keep coming).
+static const int kSettleMs = 5;
+static const int kMaxSettleRounds = 10;
+
+static String ChildPath(const String& dir, const char *name) {
+	if (dir.empty()) return String(name);
+	if (dir.data()[dir.LengthB() - 1] == '/') return dir + name;
+	return dir + "/" + name;
+}
+
+static bool IsDirectory(const String& path) {
+	struct stat stats;
+	return stat(path.c_str(), &stats) == 0 and S_ISDIR(stats.st_mode);
+}
+
+// Split a path into its directory and the name within it.
+static void SplitPath(const String& path, String *outDir, String *outName) {
+	long slash = path.LastIndexOfB("/");
+	if (slash < 0) {
+		*outDir = ".";
+		*outName = path;
+	} else {
+		*outDir = slash == 0 ? String("/") : path.SubstringB(0, slash);
+		*outName = path.SubstringB(slash + 1);
+	}
+}
+
+FileWatcher::FileWatcher() : fd(-1) {}
+
+bool FileWatcher::Add(const String& path, bool recursive) {
+	if (fd < 0) fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) return false;
+	int wd = inotify_add_watch(fd, path.c_str(), kWatchMask);
+	if (wd < 0) return false;
+	Watch& watch = watches[wd];		// (may already exist, e.g. as a directory awaiting a file)
+	watch.path = path;
+	watch.recursive = recursive;
+	watch.isFile = !IsDirectory(path);
+	watch.reported = true;
+	if (!recursive) return true;
+
+	// inotify watches only one directory at a time; so add each subdirectory too.
+	DIR *dir = opendir(path.c_str());
+	if (!dir) return true;
+	while (struct dirent *entry = readdir(dir)) {
+		if (strcmp(entry->d_name, ".") == 0 or strcmp(entry->d_name, "..") == 0) continue;
+		String child = ChildPath(path, entry->d_name);
+		if (entry->d_type == DT_DIR or (entry->d_type == DT_UNKNOWN and IsDirectory(child))) Add(child, true);
+	}
+	closedir(dir);
+	return true;
+}
+
+// Start watching a file again after the one we were watching was replaced or
+// deleted.  Return true if there's a file there now; if not, watch its
+// directory for one to appear.
+bool FileWatcher::Restore(const String& path) {
+	if (Add(path, false)) return true;
+	AwaitFile(path);
+	if (!Add(path, false)) return false;
+	// (it turned up while we were setting that up; so we needn't wait after all)
+	String dir, name;
+	SplitPath(path, &dir, &name);
+	for (std::map<int, Watch>::iterator w = watches.begin(); w != watches.end(); ++w) {
+		Value awaited;
+		if (!w->second.awaiting.Get(name, &awaited) or awaited.ToString() != path) continue;
+		w->second.awaiting.Remove(name);
+		if (!w->second.reported and w->second.awaiting.Count() == 0) inotify_rm_watch(fd, w->first);
+	}
+	return true;
+}
+
+// Watch the directory of the given (missing) file, so we can watch the file
+// again when it reappears.
+void FileWatcher::AwaitFile(const String& path) {
+	String dir, name;
+	SplitPath(path, &dir, &name);
+	int wd = inotify_add_watch(fd, dir.c_str(), kWatchMask);
+	if (wd < 0) return;
+	std::map<int, Watch>::iterator w = watches.find(wd);
+	if (w == watches.end()) {
+		Watch& watch = watches[wd];
+		watch.path = dir;
+		watch.recursive = false;
+		watch.isFile = false;
+		watch.reported = false;
+		w = watches.find(wd);
+	}
+	w->second.awaiting.SetValue(name, path);
+}
+
+// Note a change to the given path, merging it with any change already noted
+// for that path in this batch.
+static void AddChange(ValueList *events, ValueDict& byPath, const String& path, const String& change) {
+	static const Value eventKey("event");
+	static const Value pathKey("path");
+	Value existing;
+	if (byPath.Get(path, &existing)) {
+		ValueDict event = existing.GetDict();
+		String was = event.Lookup(eventKey, Value::null).ToString();
+		if (was == "created" and change == "modified") return;	// (still just "created")
+		if (was == "deleted" and change == "created") event.SetValue(eventKey, "modified");	// (replaced)
+		else event.SetValue(eventKey, change);
+		return;
+	}
+	ValueDict event;
+	event.SetValue(pathKey, path);
+	event.SetValue(eventKey, change);
+	events->Add(event);
+	byPath.SetValue(path, event);
+}
+
+// Read all the events queued up now, adding them to the current batch.
+void FileWatcher::ReadQueued(ValueList *outEvents, ValueDict& byPath) {
+	union {
+		char buf[16 * 1024];
+		struct inotify_event align;
+	} data;
+	while (true) {
+		ssize_t len = read(fd, data.buf, sizeof(data.buf));
+		if (len <= 0) break;
+		for (char *p = data.buf; p < data.buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len) {
+			struct inotify_event *ev = (struct inotify_event*)p;
+			if (ev->mask & IN_Q_OVERFLOW) {
+				AddChange(outEvents, byPath, "", "overflow");
+				continue;
+			}
+			std::map<int, Watch>::iterator w = watches.find(ev->wd);
+			if (w == watches.end()) continue;
+			if (ev->mask & IN_IGNORED) {
+				watches.erase(w);	// (watch removed, since what it watched is gone)
+				continue;
+			}
+			Watch& watch = w->second;
+			if (watch.isFile and (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF))) {
+				// The file we're watching was deleted, or renamed or replaced.
+				// Either way, carry on with whatever file is at its path now.
+				String path = watch.path;
+				inotify_rm_watch(fd, ev->wd);	// (if moved, the watch would follow it)
+				watches.erase(w);
+				AddChange(outEvents, byPath, path, Restore(path) ? "modified" : "deleted");
+				continue;
+			}
+			if (ev->len and watch.awaiting.Count() > 0 and (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+				String name(ev->name);
+				Value filePath;
+				if (watch.awaiting.Get(name, &filePath) and Add(filePath.ToString(), false)) {
+					watch.awaiting.Remove(name);
+					AddChange(outEvents, byPath, filePath.ToString(), "created");
+					if (!watch.reported and watch.awaiting.Count() == 0) inotify_rm_watch(fd, ev->wd);
+				}
+			}
+			if (!watch.reported) continue;
+			String path = ev->len ? ChildPath(watch.path, ev->name) : watch.path;
+			String change;
+			if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+				change = "created";
+				if ((ev->mask & IN_ISDIR) and watch.recursive) Add(path, true);
+			} else if (ev->mask & (IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF)) {
+				change = "deleted";
+			} else {
+				change = "modified";
+			}
+			AddChange(outEvents, byPath, path, change);
+		}
+	}
+}
+
+bool FileWatcher::Read(long waitMs, ValueList *outEvents) {
+	if (fd < 0 or watches.empty()) return false;
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, (int)waitMs) <= 0) return true;	// (nothing yet)
+
+	// Gather a batch: what's queued now, plus whatever follows close behind it
+	// (one change, like a `touch` or an editor's save, often makes several
+	// events in quick succession).
+	ValueDict byPath;
+	for (int i=0; i<kMaxSettleRounds; i++) {
+		ReadQueued(outEvents, byPath);
+		pfd.revents = 0;
+		if (poll(&pfd, 1, kSettleMs) <= 0) break;
+	}
+	return true;
+}
+
+void FileWatcher::Close() {
+	if (fd >= 0) close(fd);
+	fd = -1;
+	watches.clear();
+}
+
+#else
+
+FileWatcher::FileWatcher() : fd(-1) {}
+
+bool FileWatcher::Add(const String& path, bool recursive) {
+	return false;
+}
+
+bool FileWatcher::Read(long waitMs, ValueList *outEvents) {
+	return false;
+}
+
+void FileWatcher::Close() {
+	watches.clear();
+}
+
+#endif
+
+}
@@ -0,0 +1,66 @@
+//
+//  FileWatch.h
+//  MiniScript
+//
+//	Watches files and directories for changes, so that a script can wait for
+//	something to happen instead of polling file.info over and over.  Uses
+//	inotify on Linux; elsewhere, nothing can be watched (Add always fails).
+//
+
+#ifndef FILEWATCH_H
+#define FILEWATCH_H
+
+#include <map>
+#include "SimpleString.h"
+#include "MiniscriptTypes.h"
+
+namespace MiniScript {
+
+class FileWatcher {
+public:
+	FileWatcher();
+	~FileWatcher() { Close(); }
+
+	// Start watching the given file or directory (and if recursive, every
+	// directory under it, including ones created later).  A watched file is
+	// watched by path: if it's replaced (as editors do when they save, by
+	// renaming a new file over it) or deleted and created again, we carry on
+	// watching the new one.
+	// Return false if it can't be watched.
+	bool Add(const String& path, bool recursive);
+
+	// Wait up to the given number of milliseconds for changes, and add them to
+	// outEvents as maps with "path" and "event" ("created", "modified",
+	// "deleted", or "overflow" if the system dropped some).  Changes that
+	// arrive together are coalesced, so each path appears at most once.
+	// Return false if we're not watching anything (any more).
+	bool Read(long waitMs, ValueList *outEvents);
+
+	// Stop watching everything.
+	void Close();
+
+	bool IsOpen() const { return fd >= 0; }
+
+private:
+	FileWatcher(const FileWatcher& other);			// (not copyable)
+	FileWatcher& operator= (const FileWatcher& other);
+
+	struct Watch {
+		String path;
+		bool recursive;
+		bool isFile;		// a file (followed by path), rather than a directory
+		bool reported;		// false for a directory watched only to see awaited files return
+		ValueDict awaiting;	// name -> path of watched files in this directory that are gone
+	};
+
+	bool Restore(const String& path);
+	void AwaitFile(const String& path);
+	void ReadQueued(ValueList *outEvents, ValueDict& byPath);
+
+	int fd;							// inotify instance (or -1)
+	std::map<int, Watch> watches;	// what each watch descriptor is watching
+};
+
+}
+
+#endif /* FILEWATCH_H */
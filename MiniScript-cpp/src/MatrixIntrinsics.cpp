@@ -0,0 +1,556 @@
+//
+//  MatrixIntrinsics.cpp
+//  MiniScript
+//
+
+#include "MatrixIntrinsics.h"
+
+#include "MiniScript/MiniscriptInterpreter.h"
+#include "MiniScript/MiniscriptTypes.h"
+#include "MiniScript/MiniscriptIntrinsics.h"
+#include "MiniScript/UnitTest.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace MiniScript;
+
+// Matrices bigger than this (in elements) are refused, rather than risking
+// an allocation failure that takes down the whole process.
+static const long kMaxMatrixElements = 1L << 28;
+
+// Side length of the square tiles used by multiply and transpose, chosen
+// so that a tile of each operand fits comfortably in L1/L2 cache.
+static const long kBlockSize = 64;
+
+// Multiplies needing at least this many multiply-adds are split across threads.
+static const double kThreadedMultiplyWork = 2e6;
+
+static NativeClass& MatrixClass();
+
+// Native object holding the elements of a matrix, in row-major order.
+class MatrixStorage : public NativeObject {
+public:
+	// Make a new matrix of zeros (raising an error if the size is unreasonable).
+	static MatrixStorage *Create(long rows, long columns) {
+		if (rows < 0 or columns < 0) IndexException("matrix size must be >= 0").raise();
+		if (columns > 0 and rows > kMaxMatrixElements / columns) LimitExceededException("matrix too large").raise();
+		return new MatrixStorage(rows, columns);
+	}
+	virtual ~MatrixStorage() {
+		delete[] data;
+		MemoryAccount::Charge(-DataBytes());
+	}
+
+	long Count() const { return rows * columns; }
+	double *Row(long r) const { return data + r * columns; }
+
+	long rows;
+	long columns;
+	double *data;
+
+private:
+	MatrixStorage(long rows, long columns) : NativeObject(MatrixClass()), rows(rows), columns(columns) {
+		data = new double[rows * columns > 0 ? rows * columns : 1]();
+		MemoryAccount::Charge(DataBytes());
+	}
+
+	long DataBytes() const { return (Count() > 0 ? Count() : 1) * (long)sizeof(double); }
+};
+
+static Value NewMatrix(MatrixStorage *storage) {
+	return Value::NewHandle(storage);
+}
+
+// Get the storage behind a Matrix object, or nullptr if the value isn't one.
+static MatrixStorage *GetMatrix(Value v) {
+	return (MatrixStorage*)NativeObject::Get(v, MatrixClass());
+}
+
+static MatrixStorage *GetSelfMatrix(Context *context) {
+	MatrixStorage *m = GetMatrix(context->GetVar("self"));
+	if (!m) TypeException("Type Error: Matrix required").raise();
+	return m;
+}
+
+static void CheckSameSize(MatrixStorage *a, MatrixStorage *b) {
+	if (a->rows != b->rows or a->columns != b->columns) {
+		RuntimeException("matrix sizes must match (" + String::Format(a->rows) + "x" + String::Format(a->columns)
+			+ " vs. " + String::Format(b->rows) + "x" + String::Format(b->columns) + ")").raise();
+	}
+}
+
+static long CheckIndex(Value idxVal, long count) {
+	long idx = idxVal.IntValue();
+	if (idx < 0) idx += count;
+	if (idx < 0 or idx >= count) IndexException("Index Error (matrix index " + idxVal.ToString() + " out of range)").raise();
+	return idx;
+}
+
+static double ElementValue(Value v) {
+	if (v.type != ValueType::Number) TypeException("Type Error: matrix elements must be numbers").raise();
+	return v.data.number;
+}
+
+//--------------------------------------------------------------------------------
+// Kernels
+
+// c[rowStart..rowEnd) = a * b, where c is zeroed beforehand.  Works in tiles,
+// and within a tile runs the innermost loop along contiguous rows of b and c.
+static void MultiplyRows(const MatrixStorage *a, const MatrixStorage *b, MatrixStorage *c, long rowStart, long rowEnd) {
+	long inner = a->columns, cols = b->columns;
+	for (long i0 = rowStart; i0 < rowEnd; i0 += kBlockSize) {
+		long i1 = std::min(i0 + kBlockSize, rowEnd);
+		for (long k0 = 0; k0 < inner; k0 += kBlockSize) {
+			long k1 = std::min(k0 + kBlockSize, inner);
+			for (long j0 = 0; j0 < cols; j0 += kBlockSize) {
+				long j1 = std::min(j0 + kBlockSize, cols);
+				for (long i = i0; i < i1; i++) {
+					const double *aRow = a->Row(i);
+					double *cRow = c->Row(i);
+					for (long k = k0; k < k1; k++) {
+						double aik = aRow[k];
+						if (aik == 0) continue;
+						const double *bRow = b->Row(k);
+						for (long j = j0; j < j1; j++) cRow[j] += aik * bRow[j];
+					}
+				}
+			}
+		}
+	}
+}
+
+// Multiply a * b, splitting the rows of the result across threads when the
+// job is big enough to be worth it.  threads <= 0 means "decide for me."
+static MatrixStorage *Multiply(const MatrixStorage *a, const MatrixStorage *b, long threads) {
+	if (a->columns != b->rows) {
+		RuntimeException("matrix multiply: " + String::Format(a->rows) + "x" + String::Format(a->columns)
+			+ " by " + String::Format(b->rows) + "x" + String::Format(b->columns) + " is undefined").raise();
+	}
+	MatrixStorage *c = MatrixStorage::Create(a->rows, b->columns);
+	double work = (double)a->rows * a->columns * b->columns;
+	if (threads <= 0) {
+		threads = work < kThreadedMultiplyWork ? 1 : (long)std::thread::hardware_concurrency();
+		if (threads < 1) threads = 1;
+	}
+	threads = std::min(threads, (a->rows + kBlockSize - 1) / kBlockSize);
+	if (threads <= 1) {
+		MultiplyRows(a, b, c, 0, a->rows);
+		return c;
+	}
+	// Give each thread a whole number of row blocks.
+	long blocks = (a->rows + kBlockSize - 1) / kBlockSize;
+	std::vector<std::thread> workers;
+	long rowStart = 0;
+	for (long t = 0; t < threads; t++) {
+		long rowEnd = std::min(a->rows, ((t + 1) * blocks / threads) * kBlockSize);
+		if (t == threads - 1) rowEnd = a->rows;
+		workers.emplace_back(MultiplyRows, a, b, c, rowStart, rowEnd);
+		rowStart = rowEnd;
+	}
+	for (auto& w : workers) w.join();
+	return c;
+}
+
+static MatrixStorage *Transpose(const MatrixStorage *a) {
+	MatrixStorage *t = MatrixStorage::Create(a->columns, a->rows);
+	for (long i0 = 0; i0 < a->rows; i0 += kBlockSize) {
+		long i1 = std::min(i0 + kBlockSize, a->rows);
+		for (long j0 = 0; j0 < a->columns; j0 += kBlockSize) {
+			long j1 = std::min(j0 + kBlockSize, a->columns);
+			for (long i = i0; i < i1; i++) {
+				const double *aRow = a->Row(i);
+				for (long j = j0; j < j1; j++) t->data[j * a->rows + i] = aRow[j];
+			}
+		}
+	}
+	return t;
+}
+
+// Solve a * x = b for x, by LU decomposition with partial pivoting.
+// a must be square; b has one column per right-hand side.
+static MatrixStorage *Solve(const MatrixStorage *a, const MatrixStorage *b) {
+	long n = a->rows;
+	if (a->columns != n) RuntimeException("matrix solve: matrix must be square").raise();
+	if (b->rows != n) RuntimeException("matrix solve: right-hand side must have " + String::Format(n) + " rows").raise();
+	long k = b->columns;
+
+	// Work on copies: lu becomes the decomposition, x the solution.
+	std::vector<double> lu(a->data, a->data + a->Count());
+	MatrixStorage *x = MatrixStorage::Create(n, k);
+	memcpy(x->data, b->data, sizeof(double) * b->Count());
+
+	double scale = 0;
+	for (double v : lu) scale = std::max(scale, fabs(v));
+	double tiny = scale * n * 1e-15;
+
+	for (long col = 0; col < n; col++) {
+		long pivot = col;
+		for (long r = col + 1; r < n; r++) {
+			if (fabs(lu[r * n + col]) > fabs(lu[pivot * n + col])) pivot = r;
+		}
+		if (fabs(lu[pivot * n + col]) <= tiny) {
+			delete x;
+			RuntimeException("matrix solve: matrix is singular").raise();
+		}
+		if (pivot != col) {
+			std::swap_ranges(&lu[col * n], &lu[col * n] + n, &lu[pivot * n]);
+			std::swap_ranges(x->Row(col), x->Row(col) + k, x->Row(pivot));
+		}
+		double diag = lu[col * n + col];
+		for (long r = col + 1; r < n; r++) {
+			double f = lu[r * n + col] / diag;
+			if (f == 0) continue;
+			lu[r * n + col] = f;
+			for (long j = col + 1; j < n; j++) lu[r * n + j] -= f * lu[col * n + j];
+			for (long j = 0; j < k; j++) x->Row(r)[j] -= f * x->Row(col)[j];
+		}
+	}
+	// Back substitution.
+	for (long r = n - 1; r >= 0; r--) {
+		double *xRow = x->Row(r);
+		for (long c = r + 1; c < n; c++) {
+			double f = lu[r * n + c];
+			const double *xc = x->Row(c);
+			for (long j = 0; j < k; j++) xRow[j] -= f * xc[j];
+		}
+		double diag = lu[r * n + r];
+		for (long j = 0; j < k; j++) xRow[j] /= diag;
+	}
+	return x;
+}
+
+// Combine each element of a with the corresponding element of b (a matrix
+// of the same size) or with b itself (a number).
+template <typename OP>
+static Value ElementWise(Context *context, OP op) {
+	MatrixStorage *a = GetSelfMatrix(context);
+	Value other = context->GetVar("other");
+	MatrixStorage *b = nullptr;
+	if (other.type != ValueType::Number) {
+		// Validate before allocating, so a raise can't leak the result.
+		b = GetMatrix(other);
+		if (!b) TypeException("Type Error: Matrix or number required").raise();
+		CheckSameSize(a, b);
+	}
+	MatrixStorage *result = MatrixStorage::Create(a->rows, a->columns);
+	long count = a->Count();
+	if (!b) {
+		double num = other.data.number;
+		for (long i = 0; i < count; i++) result->data[i] = op(a->data[i], num);
+	} else {
+		for (long i = 0; i < count; i++) result->data[i] = op(a->data[i], b->data[i]);
+	}
+	return NewMatrix(result);
+}
+
+//--------------------------------------------------------------------------------
+// Intrinsics
+
+Intrinsic *i_matrixGet = nullptr;
+Intrinsic *i_matrixSet = nullptr;
+Intrinsic *i_matrixToList = nullptr;
+Intrinsic *i_matrixClone = nullptr;
+Intrinsic *i_matrixTranspose = nullptr;
+Intrinsic *i_matrixTimes = nullptr;
+Intrinsic *i_matrixPlus = nullptr;
+Intrinsic *i_matrixMinus = nullptr;
+Intrinsic *i_matrixElemTimes = nullptr;
+Intrinsic *i_matrixSolve = nullptr;
+Intrinsic *i_matrixOfSize = nullptr;
+Intrinsic *i_matrixIdentity = nullptr;
+Intrinsic *i_matrixFromList = nullptr;
+
+static Value matrixGetRows(NativeObject *obj) {
+	return Value(((MatrixStorage*)obj)->rows);
+}
+
+static Value matrixGetColumns(NativeObject *obj) {
+	return Value(((MatrixStorage*)obj)->columns);
+}
+
+static IntrinsicResult intrinsic_matrixGet(Context *context, IntrinsicResult partialResult) {
+	MatrixStorage *m = GetSelfMatrix(context);
+	long r = CheckIndex(context->GetVar("row"), m->rows);
+	long c = CheckIndex(context->GetVar("column"), m->columns);
+	return IntrinsicResult(m->Row(r)[c]);
+}
+
+static IntrinsicResult intrinsic_matrixSet(Context *context, IntrinsicResult partialResult) {
+	MatrixStorage *m = GetSelfMatrix(context);
+	long r = CheckIndex(context->GetVar("row"), m->rows);
+	long c = CheckIndex(context->GetVar("column"), m->columns);
+	m->Row(r)[c] = ElementValue(context->GetVar("value"));
+	return IntrinsicResult::Null;
+}
+
+static IntrinsicResult intrinsic_matrixToList(Context *context, IntrinsicResult partialResult) {
+	MatrixStorage *m = GetSelfMatrix(context);
+	ValueList result(m->rows);
+	for (long r = 0; r < m->rows; r++) {
+		ValueList row(m->columns);
+		const double *src = m->Row(r);
+		for (long c = 0; c < m->columns; c++) row.Add(src[c]);
+		result.Add(row);
+	}
+	return IntrinsicResult(result);
+}
+
+static IntrinsicResult intrinsic_matrixClone(Context *context, IntrinsicResult partialResult) {
+	MatrixStorage *m = GetSelfMatrix(context);
+	MatrixStorage *result = MatrixStorage::Create(m->rows, m->columns);
+	memcpy(result->data, m->data, sizeof(double) * m->Count());
+	return IntrinsicResult(NewMatrix(result));
+}
+
+static IntrinsicResult intrinsic_matrixTranspose(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(NewMatrix(Transpose(GetSelfMatrix(context))));
+}
+
+static IntrinsicResult intrinsic_matrixTimes(Context *context, IntrinsicResult partialResult) {
+	Value other = context->GetVar("other");
+	if (other.type == ValueType::Number) {
+		return IntrinsicResult(ElementWise(context, [](double a, double b) { return a * b; }));
+	}
+	MatrixStorage *b = GetMatrix(other);
+	if (!b) TypeException("Type Error: Matrix or number required").raise();
+	return IntrinsicResult(NewMatrix(Multiply(GetSelfMatrix(context), b, context->GetVar("threads").IntValue())));
+}
+
+static IntrinsicResult intrinsic_matrixPlus(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(ElementWise(context, [](double a, double b) { return a + b; }));
+}
+
+static IntrinsicResult intrinsic_matrixMinus(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(ElementWise(context, [](double a, double b) { return a - b; }));
+}
+
+static IntrinsicResult intrinsic_matrixElemTimes(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(ElementWise(context, [](double a, double b) { return a * b; }));
+}
+
+static IntrinsicResult intrinsic_matrixSolve(Context *context, IntrinsicResult partialResult) {
+	MatrixStorage *a = GetSelfMatrix(context);
+	Value bVal = context->GetVar("b");
+	if (bVal.type == ValueType::List) {
+		// A plain list is a single column; so is the result.
+		ValueList bList = bVal.GetList();
+		MatrixStorage *b = MatrixStorage::Create(bList.Count(), 1);
+		Value bHolder = NewMatrix(b);
+		for (long i = 0; i < bList.Count(); i++) b->data[i] = ElementValue(bList[i]);
+		MatrixStorage *x = Solve(a, b);
+		ValueList result(x->rows);
+		for (long i = 0; i < x->rows; i++) result.Add(x->data[i]);
+		delete x;
+		return IntrinsicResult(result);
+	}
+	MatrixStorage *b = GetMatrix(bVal);
+	if (!b) TypeException("Type Error: Matrix or list required").raise();
+	return IntrinsicResult(NewMatrix(Solve(a, b)));
+}
+
+static IntrinsicResult intrinsic_matrixOfSize(Context *context, IntrinsicResult partialResult) {
+	MatrixStorage *m = MatrixStorage::Create(context->GetVar("rows").IntValue(), context->GetVar("columns").IntValue());
+	Value result = NewMatrix(m);
+	double value = ElementValue(context->GetVar("value"));
+	if (value != 0) std::fill(m->data, m->data + m->Count(), value);
+	return IntrinsicResult(result);
+}
+
+static IntrinsicResult intrinsic_matrixIdentity(Context *context, IntrinsicResult partialResult) {
+	long n = context->GetVar("size").IntValue();
+	MatrixStorage *m = MatrixStorage::Create(n, n);
+	for (long i = 0; i < n; i++) m->Row(i)[i] = 1;
+	return IntrinsicResult(NewMatrix(m));
+}
+
+// Build a matrix from a list of lists (one per row), or from a flat list
+// (giving a single row).
+static Value MatrixFromList(ValueList list) {
+	long rows = list.Count();
+	if (rows == 0) return NewMatrix(MatrixStorage::Create(0, 0));
+	if (list[0].type != ValueType::List) {
+		MatrixStorage *m = MatrixStorage::Create(1, rows);
+		Value result = NewMatrix(m);
+		for (long c = 0; c < rows; c++) m->data[c] = ElementValue(list[c]);
+		return result;
+	}
+	long columns = list[0].GetList().Count();
+	MatrixStorage *m = MatrixStorage::Create(rows, columns);
+	Value result = NewMatrix(m);
+	for (long r = 0; r < rows; r++) {
+		if (list[r].type != ValueType::List or list[r].GetList().Count() != columns) {
+			RuntimeException("matrix.fromList: rows must be lists of equal length").raise();
+		}
+		ValueList row = list[r].GetList();
+		double *dest = m->Row(r);
+		for (long c = 0; c < columns; c++) dest[c] = ElementValue(row[c]);
+	}
+	return result;
+}
+
+static IntrinsicResult intrinsic_matrixFromList(Context *context, IntrinsicResult partialResult) {
+	Value list = context->GetVar("list");
+	if (list.type != ValueType::List) TypeException("Type Error: list required").raise();
+	return IntrinsicResult(MatrixFromList(list.GetList()));
+}
+
+static NativeClass& MatrixClass() {
+	static NativeClass cls("Matrix");
+	if (cls.classMap.Count() == 0 and i_matrixGet) {	// (unit tests may make matrices before the intrinsics exist)
+		cls.AddProperty("rows", &matrixGetRows);
+		cls.AddProperty("columns", &matrixGetColumns);
+		cls.AddMethod("get", i_matrixGet->GetFunc());
+		cls.AddMethod("set", i_matrixSet->GetFunc());
+		cls.AddMethod("toList", i_matrixToList->GetFunc());
+		cls.AddMethod("clone", i_matrixClone->GetFunc());
+		cls.AddMethod("transpose", i_matrixTranspose->GetFunc());
+		cls.AddMethod("times", i_matrixTimes->GetFunc());
+		cls.AddMethod("plus", i_matrixPlus->GetFunc());
+		cls.AddMethod("minus", i_matrixMinus->GetFunc());
+		cls.AddMethod("elemTimes", i_matrixElemTimes->GetFunc());
+		cls.AddMethod("solve", i_matrixSolve->GetFunc());
+	}
+	return cls;
+}
+
+static bool disallowAssignment(ValueDict& dict, Value key, Value value) {
+	return true;
+}
+
+static ValueDict& MatrixModule() {
+	static ValueDict matrixModule;
+
+	if (matrixModule.Count() == 0) {
+		matrixModule.SetValue("Matrix", MatrixClass().classMap);
+		matrixModule.SetValue("ofSize", i_matrixOfSize->GetFunc());
+		matrixModule.SetValue("identity", i_matrixIdentity->GetFunc());
+		matrixModule.SetValue("fromList", i_matrixFromList->GetFunc());
+		matrixModule.SetAssignOverride(disallowAssignment);
+	}
+
+	return matrixModule;
+}
+
+static IntrinsicResult intrinsic_Matrix(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(MatrixModule());
+}
+
+void AddMatrixIntrinsics() {
+	Intrinsic *f;
+
+	f = Intrinsic::Create("matrix");
+	f->code = &intrinsic_Matrix;
+
+	// matrix.* functions
+
+	i_matrixOfSize = Intrinsic::Create("");
+	i_matrixOfSize->AddParam("rows", 0);
+	i_matrixOfSize->AddParam("columns", 0);
+	i_matrixOfSize->AddParam("value", 0);
+	i_matrixOfSize->code = &intrinsic_matrixOfSize;
+
+	i_matrixIdentity = Intrinsic::Create("");
+	i_matrixIdentity->AddParam("size", 0);
+	i_matrixIdentity->code = &intrinsic_matrixIdentity;
+
+	i_matrixFromList = Intrinsic::Create("");
+	i_matrixFromList->AddParam("list");
+	i_matrixFromList->code = &intrinsic_matrixFromList;
+
+	// Matrix methods
+
+	i_matrixGet = Intrinsic::Create("");
+	i_matrixGet->AddParam("self");
+	i_matrixGet->AddParam("row", 0);
+	i_matrixGet->AddParam("column", 0);
+	i_matrixGet->code = &intrinsic_matrixGet;
+
+	i_matrixSet = Intrinsic::Create("");
+	i_matrixSet->AddParam("self");
+	i_matrixSet->AddParam("row", 0);
+	i_matrixSet->AddParam("column", 0);
+	i_matrixSet->AddParam("value", 0);
+	i_matrixSet->code = &intrinsic_matrixSet;
+
+	i_matrixToList = Intrinsic::Create("");
+	i_matrixToList->AddParam("self");
+	i_matrixToList->code = &intrinsic_matrixToList;
+
+	i_matrixClone = Intrinsic::Create("");
+	i_matrixClone->AddParam("self");
+	i_matrixClone->code = &intrinsic_matrixClone;
+
+	i_matrixTranspose = Intrinsic::Create("");
+	i_matrixTranspose->AddParam("self");
+	i_matrixTranspose->code = &intrinsic_matrixTranspose;
+
+	i_matrixTimes = Intrinsic::Create("");
+	i_matrixTimes->AddParam("self");
+	i_matrixTimes->AddParam("other");
+	i_matrixTimes->AddParam("threads", 0);
+	i_matrixTimes->code = &intrinsic_matrixTimes;
+
+	i_matrixPlus = Intrinsic::Create("");
+	i_matrixPlus->AddParam("self");
+	i_matrixPlus->AddParam("other");
+	i_matrixPlus->code = &intrinsic_matrixPlus;
+
+	i_matrixMinus = Intrinsic::Create("");
+	i_matrixMinus->AddParam("self");
+	i_matrixMinus->AddParam("other");
+	i_matrixMinus->code = &intrinsic_matrixMinus;
+
+	i_matrixElemTimes = Intrinsic::Create("");
+	i_matrixElemTimes->AddParam("self");
+	i_matrixElemTimes->AddParam("other");
+	i_matrixElemTimes->code = &intrinsic_matrixElemTimes;
+
+	i_matrixSolve = Intrinsic::Create("");
+	i_matrixSolve->AddParam("self");
+	i_matrixSolve->AddParam("b");
+	i_matrixSolve->code = &intrinsic_matrixSolve;
+}
+
+//--------------------------------------------------------------------------------
+// Unit Tests
+//--------------------------------------------------------------------------------
+
+class TestMatrixMemory : public UnitTest
+{
+public:
+	TestMatrixMemory() : UnitTest("MatrixMemory") {}
+	virtual void Run();
+private:
+	static String lastError;
+	static void CaptureError(String s, bool) { lastError = s; }
+	static IntrinsicResult MakeBigMatrix(Context*, IntrinsicResult) {
+		return IntrinsicResult(NewMatrix(MatrixStorage::Create(1000, 1000)));
+	}
+};
+
+String TestMatrixMemory::lastError;
+
+void TestMatrixMemory::Run()
+{
+	// A matrix's elements count against its interpreter's memory limit.
+	static Intrinsic *makeBig = nullptr;
+	if (!makeBig) {
+		makeBig = Intrinsic::Create("");
+		makeBig->code = &MakeBigMatrix;
+	}
+	lastError = "";
+	Interpreter interp("m = makeBig\ndone = 1");
+	interp.errorOutput = &CaptureError;
+	interp.SetMemoryLimit(1000000);
+	interp.Compile();
+	interp.SetGlobalValue("makeBig", makeBig->GetFunc());
+	interp.RunUntilDone(60, false);
+	Assert(lastError.Contains("Memory limit exceeded"));
+	Assert(interp.GetGlobalValue("done").IsNull());
+}
+
+RegisterUnitTest(TestMatrixMemory);
@@ -0,0 +1,16 @@
+//
+//  MatrixIntrinsics.h
+//  MiniScript
+//
+//	The "matrix" module: a native Matrix type holding a dense, row-major
+//	block of doubles, with blocked (and for large sizes, multithreaded)
+//	multiply, transpose, element-wise arithmetic, and linear solve.
+//
+
+#ifndef MATRIXINTRINSICS_H
+#define MATRIXINTRINSICS_H
+
+// Register the "matrix" intrinsic module to the global environment.
+void AddMatrixIntrinsics();
+
+#endif // MATRIXINTRINSICS_H
@@ -12,6 +12,8 @@
 
 namespace MiniScript {
 	
+	std::atomic<unsigned long> DictInternal::nextEpoch(0);
+	
 	class TestDictionary : public UnitTest
 	{
 	public:
@@ -45,12 +47,19 @@ namespace MiniScript {
 		Assert(d.Lookup("two", 0) == 2);
 		Assert(d.Lookup("nosuch", 0) == 0);
 
+		unsigned long epoch = d.Epoch();
+		d.SetValue("two", 22);
+		Assert(d.Epoch() == epoch);
+		Assert(*d.GetValuePtr("two") == 22);
+		Assert(d.GetValuePtr("nosuch") == nullptr);
+		
 		d.Remove("one");
+		Assert(d.Epoch() != epoch);
 		Assert(d.Count() == 1);
 		Assert(not d.ContainsKey("one"));
 		Assert(d.ContainsKey("two"));
 		Assert(d.Lookup("one", 0) == 0);
-		Assert(d.Lookup("two", 0) == 2);
+		Assert(d.Lookup("two", 0) == 22);
 
 		d.RemoveAll();
 		Assert(d.Count() == 0);
@@ -9,6 +9,8 @@
 #define HASHMAP_H
 
 #include "List.h"
+#include "RecyclingPool.h"
+#include <atomic>
 
 namespace MiniScript {
 
@@ -45,6 +47,12 @@ namespace MiniScript {
 			// If not found or at min, halve the size (fallback)
 			return currentSize > 2 ? currentSize / 2 : currentSize;
 		}
+		
+		// Source of DictionaryStorage epochs (see DictionaryStorage::epoch).
+		// Atomic, since dictionaries may be created or changed on any thread;
+		// epochs need only be unique, so relaxed ordering is enough.
+		extern std::atomic<unsigned long> nextEpoch;
+		inline unsigned long NewEpoch() { return nextEpoch.fetch_add(1, std::memory_order_relaxed) + 1; }
 	}
 	
 	// Default table size (backward compatibility)
@@ -59,6 +67,9 @@ namespace MiniScript {
 		HashMapEntry() : next(nullptr) {}
 		~HashMapEntry() { if (next) delete next; }
 		
+		static void *operator new(size_t size) { return RecyclingPool<sizeof(HashMapEntry)>::Allocate(size); }
+		static void operator delete(void *p, size_t size) { RecyclingPool<sizeof(HashMapEntry)>::Release(p, size); }
+		
 		HashMapEntry *Clone() {
 			HashMapEntry *result = new HashMapEntry();
 			result->key = key;
@@ -75,11 +86,16 @@ namespace MiniScript {
 	template <class K, class V>
 	class DictionaryStorage : public RefCountedStorage {
 	private:
-		DictionaryStorage() : RefCountedStorage(), mSize(0), mTableSize(TABLE_SIZE), assignOverride(nullptr), evalOverride(nullptr) { 
+		DictionaryStorage() : RefCountedStorage(), mSize(0), mTableSize(TABLE_SIZE), epoch(DictInternal::NewEpoch()), assignOverride(nullptr), evalOverride(nullptr), owner(nullptr) { 
 			mTable = new HashMapEntry<K, V>*[mTableSize];
+			MemoryAccount::Charge((long)(mTableSize * sizeof(mTable[0])));
 			for (size_t i=0; i<mTableSize; i++) mTable[i] = nullptr; 
 		}
-		~DictionaryStorage() { RemoveAll(); delete[] mTable; }
+		~DictionaryStorage() {
+			RemoveAll();
+			delete[] mTable;
+			MemoryAccount::Charge(-(long)(mTableSize * sizeof(mTable[0])));
+		}
 
 		void RemoveAll() {
 			for (size_t i = 0; i < mTableSize; i++) {
@@ -89,18 +105,21 @@ namespace MiniScript {
 				}
 			}
 			mSize = 0;
+			epoch = DictInternal::NewEpoch();
 		}
 		
-
-		
-
-		
 		long mSize;
 		size_t mTableSize;  // Dynamic table size
 		HashMapEntry<K, V> **mTable;  // Dynamic table
 
+		// Changes whenever a key is added or removed, to a number never used
+		// before by any storage.  So a pointer to a value in this storage,
+		// kept along with the epoch, is still good while the epoch matches.
+		unsigned long epoch;
+
 		void *assignOverride;
 		void *evalOverride;
+		void *owner;		// host object this map belongs to, if any (e.g. the NativeClass of a class map)
 		
 		template <class K2, class V2, unsigned int HASH(const K2&)> friend class Dictionary;
 		template <class K2, class V2> friend class DictIterator;
@@ -161,6 +180,10 @@ namespace MiniScript {
 		inline V Lookup(const K& key, const V& defaultValue) const;
 		inline const V operator[](const K& key) const;
 		inline bool Get(const K& key, V *outValue) const;
+		inline V *GetValuePtr(const K& key) const;		// (valid while Epoch() is unchanged)
+
+		/// EPOCH
+		unsigned long Epoch() const { return ds ? ds->epoch : 0; }
 
 		/// INQUIRY
 		long Count() const { return ds ? ds->mSize : 0; }
@@ -181,6 +204,9 @@ namespace MiniScript {
 			return cb(*this, key, value);
 		}
 		
+		/// Whether either override is set (so values can't be read or written directly)
+		bool HasOverrides() const { return ds and (ds->assignOverride or ds->evalOverride); }
+		
 		/// LOOKUP OVERRIDE
 		typedef bool (*EvalOverrideCallback)(Dictionary<K,V,HASH> &dict, K key, V& outValue);
 		void SetEvalOverride(EvalOverrideCallback callback) { ensureStorage(); ds->evalOverride = (void*)callback; }
@@ -190,6 +216,10 @@ namespace MiniScript {
 			return cb(*this, key, outValue);
 		}
 		
+		/// OWNER (an object the host associates with this map, found without any search)
+		void SetOwner(void *owner) { ensureStorage(); ds->owner = owner; }
+		void *Owner() const { return ds ? ds->owner : nullptr; }
+		
 		/// DEBUGGING
 		inline int BinEntries(int binNum) const;
 		
@@ -250,6 +280,7 @@ namespace MiniScript {
 		ds->mTable[hash] = entry;
 
 		ds->mSize++;
+		ds->epoch = DictInternal::NewEpoch();
 	}
 	
 	template <class K, class V, unsigned int HASH(const K&)>
@@ -266,6 +297,7 @@ namespace MiniScript {
 				entry->next = nullptr;
 				delete entry;
 				ds->mSize--;
+				ds->epoch = DictInternal::NewEpoch();
 				
 				// Phase 1 Enhancement: Check if table shrinking is needed
 				double currentLoadFactor = (double)ds->mSize / (double)ds->mTableSize;
@@ -320,6 +352,19 @@ namespace MiniScript {
 		return false;
 	}
 
+	template <class K, class V, unsigned int HASH(const K&)>
+	V *Dictionary<K, V, HASH>::GetValuePtr(const K& key) const {
+		if (!ds) return nullptr;
+		int hash = hashKey(key);
+		HashMapEntry<K, V> *entry = ds->mTable[hash];
+		while (entry) {
+			if (entry->key == key) return &entry->value;
+			entry = entry->next;
+		}
+		
+		return nullptr;
+	}
+
 	template <class K, class V, unsigned int HASH(const K&)>
 	const V Dictionary<K, V, HASH>::operator[](const K& key) const {
 		Assert(ds);
@@ -340,10 +385,10 @@ namespace MiniScript {
 
 	template <class K, class V, unsigned int HASH(const K&)>
 	List<K> Dictionary<K, V, HASH>::Keys() const {
-		List<K> keys;
+		List<K> keys(Count());
 		if (!ds) return keys;
 		
-		for (int i=0; i<TABLE_SIZE; i++) {
+		for (size_t i=0; i<ds->mTableSize; i++) {
 			HashMapEntry<K, V> *entry = ds->mTable[i];
 			while (entry) {
 				keys.Add(entry->key);
@@ -356,10 +401,10 @@ namespace MiniScript {
 
 	template <class K, class V, unsigned int HASH(const K&)>
 	List<V> Dictionary<K, V, HASH>::Values() const {
-		List<K> values;
+		List<V> values(Count());
 		if (!ds) return values;
 		
-		for (int i=0; i<TABLE_SIZE; i++) {
+		for (size_t i=0; i<ds->mTableSize; i++) {
 			HashMapEntry<K, V> *entry = ds->mTable[i];
 			while (entry) {
 				values.Add(entry->value);
@@ -417,6 +462,7 @@ namespace MiniScript {
 		// Create new table
 		ds->mTableSize = newSize;
 		ds->mTable = new HashMapEntry<K, V>*[ds->mTableSize];
+		MemoryAccount::Charge(((long)newSize - (long)oldSize) * (long)sizeof(oldTable[0]));
 		for (size_t i = 0; i < ds->mTableSize; i++) {
 			ds->mTable[i] = nullptr;
 		}
@@ -451,7 +497,7 @@ namespace MiniScript {
 	DictIterator<K, V>::DictIterator(DictionaryStorage<K, V> *storage) : storage(storage), binIndex(0) {
 		// Find and attach to the first bin with any data in it.
 		if (storage) {
-			for (int i=0; i<TABLE_SIZE; i++) {
+			for (size_t i=0; i<storage->mTableSize; i++) {
 				if (storage->mTable[i]) {
 					binIndex = i;
 					entry = storage->mTable[i];
@@ -467,7 +513,7 @@ namespace MiniScript {
 		entry = entry->next;
 		if (!entry) {
 			// Advance to the next bin with any data in it.
-			while (binIndex+1 < TABLE_SIZE) {
+			while (binIndex+1 < (int)storage->mTableSize) {
 				binIndex++;
 				entry = storage->mTable[binIndex];
 				if (entry) return;
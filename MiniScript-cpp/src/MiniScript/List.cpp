@@ -126,6 +126,14 @@ namespace MiniScript {
 		check(list3, 4, 0, 1, 2, 3);
 		list3.RemoveRange(1, 3);
 		check(list3, 4, 3);
+		list3.InsertRange(list2, 1);
+		check(list3, 4, 42, 1, 0, 3);
+		list3.RemoveRange(1, 3);
+		check(list3, 4, 3);
+		list3.AddRange(list3);
+		check(list3, 4, 3, 4, 3);
+		list3.RemoveRange(3, 100);
+		check(list3, 4, 3, 4);
 	}
 	
 	RegisterUnitTest(TestList);
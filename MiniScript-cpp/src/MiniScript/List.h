@@ -47,7 +47,9 @@ namespace MiniScript {
 		void Clear() { if (ls) ls->deleteAll(); }
 		void Insert(T item, long index) { ensureStorage(); ls->insert(item, index); }
 		void RemoveAt(long index) { if (ls) ls->deleteIdx(index); }
-		void RemoveRange(long startIndex, long count) { for (long i=0; i<count; i++) RemoveAt(startIndex); }	// OFI: do this without looping
+		void RemoveRange(long startIndex, long count) { if (ls) ls->deleteRange(startIndex, count); }
+		void InsertRange(const List& items, long index) { if (items.Count()) { ensureStorage(); ls->insertRange(&(*items.ls)[0], items.Count(), index); } }
+		void AddRange(const List& items) { InsertRange(items, Count()); }
 		void Reposition(long indexFrom, long indexTo) { if (ls) ls->reposition(indexFrom, indexTo); }
 		T Pop() { Assert(ls); return ls->pop_back(); }
 		void ResizeBuffer(long newBufSize) { if (newBufSize == 0) Clear(); else { ensureStorage(); ls->resizeBuffer(newBufSize); } }
@@ -0,0 +1,76 @@
+//
+//  MemoryAccount.h
+//  MiniScript
+//
+//	Keeps a running count of the bytes held by MiniScript data: every
+//	RefCountedStorage (strings, lists, maps, and so on), plus the buffers
+//	they own.  Allocations and frees are charged to whichever account is
+//	current on this thread; each Interpreter has its own, made current while
+//	it runs, and everything else goes to the thread's default tally.
+//
+//	Charging is a single add to a thread-local counter, so it's cheap enough
+//	to leave on all the time.  Checking the total against a limit is up to
+//	the caller (see Machine::memoryLimit), at a point where it is safe to
+//	raise an error.
+//
+//	Note that an object is credited back to whichever account is current when
+//	it is freed, which is not necessarily the one it was charged to (e.g. a
+//	value handed from one interpreter to another, or kept by the host after
+//	its interpreter is gone).  So the counts are close, but not exact.
+//
+
+#ifndef MEMORYACCOUNT_H
+#define MEMORYACCOUNT_H
+
+namespace MiniScript {
+
+	class MemoryAccount {
+	public:
+		MemoryAccount() : bytes(0), active(false) {}
+
+		// Bytes currently charged to this account.
+		long Bytes() const { return active ? Tally() : bytes; }
+
+		// Charge the given number of bytes (negative to credit) to the current account.
+		static void Charge(long n) { Tally() += n; }
+
+		// Bytes charged to the current account.
+		static long Current() { return Tally(); }
+
+		// Scope: makes the given account current, for the lifetime of this object.
+		class Scope {
+		public:
+			Scope(MemoryAccount& account) : account(account.active ? nullptr : &account), saved(0) {
+				if (!this->account) return;		// (already current; nothing to do)
+				saved = Tally();
+				Tally() = account.bytes;
+				account.active = true;
+			}
+			~Scope() {
+				if (!account) return;
+				account->bytes = Tally();
+				account->active = false;
+				Tally() = saved;
+			}
+		private:
+			Scope(const Scope& other);				// (not copyable)
+			Scope& operator= (const Scope& other);
+
+			MemoryAccount *account;
+			long saved;			// tally of the account that was current before us
+		};
+
+	private:
+		// The running count for whichever account is current on this thread.
+		static long& Tally() {
+			static thread_local long tally = 0;
+			return tally;
+		}
+
+		long bytes;		// our count, while we are not the current account
+		bool active;	// true while we are the current account (and our count is in Tally)
+	};
+
+}
+
+#endif /* MEMORYACCOUNT_H */
@@ -9,25 +9,27 @@
 #include "MiniscriptInterpreter.h"
 #include "MiniscriptParser.h"
 #include "SplitJoin.h"
+#include "UnitTest.h"
 
 namespace MiniScript {
 	
 	Interpreter::Interpreter() : standardOutput(nullptr), errorOutput(nullptr), implicitOutput(nullptr),
-								parser(nullptr), vm(nullptr), hostData(nullptr) {
+								parser(nullptr), vm(nullptr), hostData(nullptr), memoryLimit(0) {
 		
 	}
 
 	Interpreter::Interpreter(String source) : standardOutput(nullptr), errorOutput(nullptr), implicitOutput(nullptr),
-	parser(nullptr), vm(nullptr), hostData(nullptr) {
+	parser(nullptr), vm(nullptr), hostData(nullptr), memoryLimit(0) {
 		Reset(source);
 	}
 	
 	Interpreter::Interpreter(List<String> source) : standardOutput(nullptr), errorOutput(nullptr), implicitOutput(nullptr),
-	parser(nullptr), vm(nullptr), hostData(nullptr) {
+	parser(nullptr), vm(nullptr), hostData(nullptr), memoryLimit(0) {
 		Reset(source);
 	}
 
 	Interpreter::~Interpreter() {
+		MemoryAccount::Scope scope(memory);
 		// We own the parser and the VM...
 		delete(parser); parser = nullptr;
 		delete(vm); vm = nullptr;
@@ -40,11 +42,13 @@ namespace MiniScript {
 
 	void Interpreter::Compile() {
 		if (vm) return;		// already compiled
+		MemoryAccount::Scope scope(memory);
 		if (not parser) parser = new Parser();
 		try {
 			parser->Parse(source);
 			vm = parser->CreateVM(standardOutput);
 			vm->interpreter = this;
+			vm->memoryLimit = memoryLimit;
 		} catch (const MiniscriptException& mse) {
 			ReportError(mse);
 		}
@@ -55,6 +59,7 @@ namespace MiniScript {
 	/// except in special cases; usually you will use RunUntilDone (above) instead.
 	/// </summary>
 	void Interpreter::Step() {
+		MemoryAccount::Scope scope(memory);
 		try {
 			Compile();
 			if (vm) vm->Step();
@@ -81,6 +86,7 @@ namespace MiniScript {
 	/// <param name="returnEarly">if true, return as soon as we reach an intrinsic that returns a partial result</param>
 	void Interpreter::RunUntilDone(double timeLimit, bool returnEarly) {
 		long startImpResultCount = 0;
+		MemoryAccount::Scope scope(memory);
 		try {
 			if (not vm) {
 				Compile();
@@ -96,7 +102,7 @@ namespace MiniScript {
 					checkRuntimeIn = 15;
 				}
 				vm->Step();		// update the machine
-				if (returnEarly and not vm->GetTopContext()->partialResult.Done()) return;	// waiting for something
+				if (returnEarly and vm->GetTopContext()->Waiting()) return;	// waiting for something
 			}
 		} catch (const MiniscriptException& mse) {
 			ReportError(mse);
@@ -113,10 +119,12 @@ namespace MiniScript {
 	/// <param name="sourceLine">Source line.</param>
 	/// <param name="timeLimit">Time limit.</param>
 	void Interpreter::REPL(String sourceLine, double timeLimit) {
+		MemoryAccount::Scope scope(memory);
 		if (not parser) parser = new Parser();
 		if (not vm) {
 			vm = parser->CreateVM(standardOutput);
 			vm->interpreter = this;
+			vm->memoryLimit = memoryLimit;
         } else if (vm->Done() && !parser->NeedMoreInput()) {
             // Since the machine and parser are both done, we don't really need the previously-compiled
             // code.  So let's clear it out, as a memory optimization.
@@ -173,6 +181,7 @@ namespace MiniScript {
     /// <returns>Value of the named variable, or null if not found</returns>
     Value Interpreter::GetGlobalValue(String varName) {
         if (not vm) return Value::null;
+		MemoryAccount::Scope scope(memory);
 
 		Context* globalContext = vm->GetGlobalContext();
         if (globalContext == nullptr) return Value::null;
@@ -194,6 +203,7 @@ namespace MiniScript {
     /// <param name="value">value to set</param>	
 	void Interpreter::SetGlobalValue(String varName, Value value)
     {
+		MemoryAccount::Scope scope(memory);
         if (vm) vm->GetGlobalContext()->SetVar(varName, value);
 	}
 
@@ -216,4 +226,42 @@ namespace MiniScript {
 		if (errorOutput) (*errorOutput)(mse.Description(), true);
 	}
 
+	//--------------------------------------------------------------------------------
+	// Unit Tests
+	//--------------------------------------------------------------------------------
+
+	class TestInterpreter : public UnitTest
+	{
+	public:
+		TestInterpreter() : UnitTest("Interpreter") {}
+		virtual void Run();
+	private:
+		static String lastError;
+		static void CaptureError(String s, bool) { lastError = s; }
+	};
+
+	String TestInterpreter::lastError;
+
+	void TestInterpreter::Run()
+	{
+		// A script that stays within its memory limit runs normally...
+		Interpreter small("x = range(1, 100)\ndone = 1");
+		small.errorOutput = &CaptureError;
+		small.SetMemoryLimit(1000000);
+		small.RunUntilDone(60, false);
+		Assert(small.GetGlobalValue("done").IntValue() == 1);
+		Assert(small.MemoryInUse() > 0 and small.MemoryInUse() < 1000000);
+
+		// ...but one that goes over it is stopped with an error.
+		lastError = "";
+		Interpreter big("x = []\nfor i in range(1, 100000)\n  x.push str(i)\nend for\ndone = 1");
+		big.errorOutput = &CaptureError;
+		big.SetMemoryLimit(1000000);
+		big.RunUntilDone(60, false);
+		Assert(lastError.Contains("Memory limit exceeded"));
+		Assert(big.GetGlobalValue("done").IsNull());
+	}
+
+	RegisterUnitTest(TestInterpreter);
+
 }
@@ -50,7 +50,7 @@ namespace MiniScript {
 		Interpreter(List<String> source);
 		
 		/// Destructor
-		~Interpreter();
+		virtual ~Interpreter();
 		
 		/// <summary>
 		/// done: returns true when we don't have a virtual machine, or we do have
@@ -145,6 +145,20 @@ namespace MiniScript {
         /// <param name="value">Global Variable Value</param>
         void SetGlobalValue(String varName, Value value);
 
+		/// <summary>
+		/// Limit how much memory (in bytes) this interpreter's scripts may hold
+		/// in strings, lists, maps, and other data; a script that goes over
+		/// gets a LimitExceededException.  0 means no limit.
+		/// </summary>
+		/// <param name="bytes">maximum bytes, or 0</param>
+		void SetMemoryLimit(long bytes) { memoryLimit = bytes; if (vm) vm->memoryLimit = bytes; }
+		long MemoryLimit() const { return memoryLimit; }
+
+		/// <summary>
+		/// Get the number of bytes of data currently charged to this interpreter.
+		/// </summary>
+		long MemoryInUse() const { return memory.Bytes(); }
+
 	protected:
 		void CheckImplicitResult(long previousImpResultCount);
 
@@ -153,6 +167,8 @@ namespace MiniScript {
 	private:
 		String source;
 		Parser *parser;
+		MemoryAccount memory;	// what we allocate (made current whenever we run)
+		long memoryLimit;
 	};
 }
 
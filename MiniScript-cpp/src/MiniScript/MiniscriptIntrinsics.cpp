@@ -28,6 +28,23 @@ namespace MiniScript {
 	static Value _stringType;
 	static Value _EOL("\n");
 
+	// hidden (unnamed) intrinsics, used as methods of StringBuilder
+	static Intrinsic *i_sbAppend = nullptr;
+	static Intrinsic *i_sbAppendLine = nullptr;
+	static Intrinsic *i_sbAppendNumber = nullptr;
+	static Intrinsic *i_sbClear = nullptr;
+	static Intrinsic *i_sbLen = nullptr;
+	static Intrinsic *i_sbToString = nullptr;
+
+	// hidden intrinsics used as list methods (not globals, since "map" is taken)
+	static Intrinsic *i_listFilter = nullptr;
+	static Intrinsic *i_listMap = nullptr;
+	static Intrinsic *i_listReduce = nullptr;
+	static Intrinsic *i_listSortBy = nullptr;
+
+	// temp (in an intrinsic's context) that receives the result of CallFromIntrinsic
+	static const int callResultTemp = 1;
+
 	List<Intrinsic*> Intrinsic::all;
 	Dictionary<String, Intrinsic*, hashString> Intrinsic::nameMap;
 	IntrinsicResult IntrinsicResult::Null;	// represents a completed, null result
@@ -36,19 +53,49 @@ namespace MiniScript {
 	bool Intrinsics::initialized = false;
 	static ValueDict _intrinsicsMap;
 
-	static bool randInitialized = false;
+	static bool hostSeedSet = false;
+	static uint64_t hostSeed = 0;
+
+	// splitmix64: used to expand a single seed into a full xoshiro state.
+	static inline uint64_t SplitMix64(uint64_t& x) {
+		uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	void RandomGenerator::Seed(uint64_t seed) {
+		for (int i=0; i<4; i++) state[i] = SplitMix64(seed);
+		seeded = true;
+	}
 
-	static inline void InitRand() {
-		if (!randInitialized) {
-			srand((unsigned int)time(nullptr));
-			for (int i=0; i<10; i++) rand();
-			randInitialized = true;
+	void RandomGenerator::SeedDefault() {
+		if (hostSeedSet) {
+			Seed(hostSeed);
+			return;
+		}
+		// Mix the time with this generator's address, so that machines started
+		// in the same second still get distinct sequences.
+		uint64_t seed = (uint64_t)time(nullptr);
+		seed ^= (uint64_t)clock() << 32;
+		seed ^= (uint64_t)(uintptr_t)this;
+		Seed(seed);
+	}
+
+	uint64_t RandomGenerator::NextBelow(uint64_t n) {
+		if (n <= 1) return 0;
+		// Reject the few values at the bottom of the range that would make
+		// some results more likely than others.
+		uint64_t threshold = (0 - n) % n;
+		while (true) {
+			uint64_t r = Next();
+			if (r >= threshold) return r % n;
 		}
 	}
 
 	void InitRand(unsigned int seed) {
-		srand(seed);
-		randInitialized = true;
+		hostSeed = seed;
+		hostSeedSet = true;
 	}
 
 	static IntrinsicResult intrinsic_abs(Context *context, IntrinsicResult partialResult) {
@@ -103,6 +150,7 @@ namespace MiniScript {
 
 	static IntrinsicResult intrinsic_char(Context *context, IntrinsicResult partialResult) {
 		long codePoint = context->GetVar("codePoint").IntValue();
+		if (codePoint >= 0 and codePoint < 128) return IntrinsicResult(String::ASCIIChar((unsigned char)codePoint));
 		char buf[5];
 		long len = UTF8Encode((unsigned long)codePoint, (unsigned char*)buf);
 		String s(buf, (size_t)len);
@@ -126,11 +174,319 @@ namespace MiniScript {
 		return IntrinsicResult(cos(radians.DoubleValue()));
 	}
 
+	static IntrinsicResult intrinsic_extend(Context *context, IntrinsicResult partialResult) {
+		Value self = context->GetVar("self");
+		Value items = context->GetVar("items");
+		if (self.type != ValueType::List) TypeException("Type Error: 'extend' requires a list").raise();
+		if (items.IsNull()) return IntrinsicResult(self);
+		if (items.type != ValueType::List) TypeException("Type Error: 'extend' items must be a list").raise();
+		ValueList list = self.GetList();
+		ValueList newItems = items.GetList();
+		if (list.Count() + newItems.Count() > Value::maxListSize) LimitExceededException("list too large").raise();
+		list.AddRange(newItems);
+		return IntrinsicResult(self);
+	}
+	
 	static IntrinsicResult intrinsic_floor(Context *context, IntrinsicResult partialResult) {
 		Value x = context->GetVar("x");
 		return IntrinsicResult(floor(x.DoubleValue()));
 	}
 	
+	//------------------------------------------------------------------------------------------
+	// Support for the `format` intrinsic.  A template like "{name:>10} {1:.2f}"
+	// is parsed once into a FormatTemplateStorage and cached by template string,
+	// so repeated calls only walk the precompiled fields.
+
+	// One replacement field of a format template, together with the literal
+	// text that precedes it.  (Plain data, so it can live in a SimpleVector.)
+	struct FormatField {
+		long litStart, litLen;	// literal text before this field (byte range in the template)
+		bool isField;			// false only for the trailing literal
+		long keyIndex;			// index into keys, or -1 for the next positional argument
+		long autoIndex;			// positional argument number (when keyIndex < 0)
+		char fill[5];			// padding character (UTF-8, null-terminated)
+		char align;				// '<', '>', '^', or 0 for the default
+		bool plusSign;			// always show the sign of a number
+		bool zeroPad;			// pad numbers with zeros after the sign
+		bool grouping;			// use commas between thousands
+		int width;				// minimum width in characters (0 for none)
+		int precision;			// digits after the point, or max characters for strings (-1 for none)
+		char kind;				// 'd', 'f', 'e', 'E', 'x', 'X', 's', or 0
+	};
+
+	class FormatTemplateStorage : public RefCountedStorage {
+	public:
+		String source;
+		SimpleVector<FormatField> fields;
+		ValueList keys;
+		long fixedBytes;		// total size of the literal text
+	};
+
+	static ValueDict _formatCache;
+	static const long kMaxFormatCacheSize = 1000;
+
+	static void FormatError(const String& source, const char *msg) {
+		RuntimeException(String("format: ") + msg + " in template \"" + source + "\"").raise();
+	}
+
+	// Parse a template.  The result is a handle to a FormatTemplateStorage; it
+	// holds the storage from the start, so a FormatError can't leak it.
+	static Value CompileFormat(String source) {
+		FormatTemplateStorage *tmpl = new FormatTemplateStorage();
+		Value result = Value::NewHandle(tmpl);
+		tmpl->source = source;
+		tmpl->fixedBytes = 0;
+		const char *s = source.c_str();
+		long len = source.LengthB();
+		long autoIndex = 0;
+		long pos = 0;
+		FormatField field;
+		// Literal text is accumulated as byte ranges; but "{{" and "}}" split the
+		// text, so each escape ends a (field-less) chunk that keeps its brace.
+		while (true) {
+			memset(&field, 0, sizeof(field));
+			field.litStart = pos;
+			field.keyIndex = -1;
+			field.precision = -1;
+			strcpy(field.fill, " ");
+			while (pos < len and s[pos] != '{' and s[pos] != '}') pos++;
+			field.litLen = pos - field.litStart;
+			if (pos >= len) {
+				tmpl->fixedBytes += field.litLen;
+				tmpl->fields.push_back(field);		// (trailing literal)
+				break;
+			}
+			if (pos + 1 < len and s[pos+1] == s[pos]) {
+				// escaped brace: keep one, skip the other
+				field.litLen++;
+				tmpl->fixedBytes += field.litLen;
+				tmpl->fields.push_back(field);
+				pos += 2;
+				continue;
+			}
+			if (s[pos] == '}') FormatError(source, "unmatched '}'");
+			pos++;	// skip '{'
+			field.isField = true;
+
+			// key: empty (next positional), a number (list index), or a name (map key)
+			long keyStart = pos;
+			while (pos < len and s[pos] != ':' and s[pos] != '}') pos++;
+			if (pos >= len) FormatError(source, "unmatched '{'");
+			if (pos > keyStart) {
+				String keyStr = source.SubstringB(keyStart, pos - keyStart);
+				bool numeric = true;
+				for (long i=keyStart; i<pos; i++) if (s[i] < '0' or s[i] > '9') numeric = false;
+				field.keyIndex = tmpl->keys.Count();
+				if (numeric) tmpl->keys.Add(Value(keyStr.DoubleValue()));
+				else tmpl->keys.Add(Value(keyStr));
+			} else {
+				field.autoIndex = autoIndex++;
+			}
+
+			// spec: [[fill]align][+][0][width][,][.precision][kind]
+			if (s[pos] == ':') {
+				pos++;
+				long charLen = 1;
+				while (pos + charLen < len and IsUTF8IntraChar(s[pos + charLen])) charLen++;
+				char next = pos + charLen < len ? s[pos + charLen] : 0;
+				if (charLen <= 4 and (next == '<' or next == '>' or next == '^') and s[pos] != '}') {
+					memcpy(field.fill, s + pos, charLen);
+					field.fill[charLen] = 0;
+					field.align = next;
+					pos += charLen + 1;
+				} else if (s[pos] == '<' or s[pos] == '>' or s[pos] == '^') {
+					field.align = s[pos++];
+				}
+				if (pos < len and s[pos] == '+') { field.plusSign = true; pos++; }
+				if (pos < len and s[pos] == '0') { field.zeroPad = true; pos++; }
+				while (pos < len and s[pos] >= '0' and s[pos] <= '9') field.width = field.width * 10 + (s[pos++] - '0');
+				if (pos < len and s[pos] == ',') { field.grouping = true; pos++; }
+				if (pos < len and s[pos] == '.') {
+					pos++;
+					field.precision = 0;
+					if (pos >= len or s[pos] < '0' or s[pos] > '9') FormatError(source, "missing precision");
+					while (pos < len and s[pos] >= '0' and s[pos] <= '9') field.precision = field.precision * 10 + (s[pos++] - '0');
+				}
+				if (pos < len and strchr("dfeExXs", s[pos]) and s[pos]) field.kind = s[pos++];
+				if (pos >= len or s[pos] != '}') FormatError(source, "bad format spec");
+			}
+			pos++;	// skip '}'
+			tmpl->fixedBytes += field.litLen;
+			tmpl->fields.push_back(field);
+		}
+		return result;
+	}
+
+	static FormatTemplateStorage *GetFormatTemplate(Value templateVal) {
+		Value cached;
+		if (_formatCache.Get(templateVal, &cached)) return (FormatTemplateStorage*)cached.data.ref;
+		Value compiled = CompileFormat(templateVal.ToString());
+		if (_formatCache.Count() >= kMaxFormatCacheSize) _formatCache = ValueDict();
+		_formatCache.SetValue(templateVal, compiled);
+		return (FormatTemplateStorage*)compiled.data.ref;
+	}
+
+	// Insert commas between groups of three digits in the integer part of buf.
+	static int AddThousandsSeparators(char *buf, int len, int bufSize) {
+		int start = (buf[0] == '-' or buf[0] == '+') ? 1 : 0;
+		int end = start;
+		while (end < len and buf[end] >= '0' and buf[end] <= '9') end++;
+		int digits = end - start;
+		int commas = (digits - 1) / 3;
+		if (commas <= 0 or len + commas >= bufSize) return len;
+		memmove(buf + end + commas, buf + end, len - end + 1);
+		int src = end - 1, dst = end + commas - 1;
+		for (int n = 1; src >= start; n++) {
+			buf[dst--] = buf[src--];
+			if (n % 3 == 0 and src >= start) buf[dst--] = ',';
+		}
+		return len + commas;
+	}
+
+	static void AppendFormatted(StringBuilder& out, const FormatField& field, Value value, Machine *vm) {
+		char numBuf[512];
+		StringBuilder strBuf;
+		String strVal;
+		const char *text;
+		long textLen;
+		bool isNumber = (field.kind != 's' and (field.kind != 0 or value.type == ValueType::Number));
+		if (isNumber) {
+			if (value.type != ValueType::Number) TypeException("format: number required for numeric field").raise();
+			double num = value.data.number;
+			int len;
+			switch (field.kind) {
+				case 'd':
+					num = round(num);
+					if (num == 0) num = 0;	// (avoid "-0")
+					len = snprintf(numBuf, sizeof(numBuf), "%.0f", num);
+					break;
+				case 'e':
+				case 'E':
+					len = snprintf(numBuf, sizeof(numBuf), field.kind == 'e' ? "%.*e" : "%.*E",
+								   field.precision < 0 ? 6 : field.precision, num);
+					break;
+				case 'x':
+				case 'X':
+				{
+					long long n = (long long)round(num);
+					unsigned long long u = n < 0 ? -(unsigned long long)n : n;
+					len = snprintf(numBuf, sizeof(numBuf), field.kind == 'x' ? "%s%llx" : "%s%llX", n < 0 ? "-" : "", u);
+				} break;
+				case 'f':
+					len = snprintf(numBuf, sizeof(numBuf), "%.*f", field.precision < 0 ? 6 : field.precision, num);
+					break;
+				default:
+					if (field.precision >= 0) {
+						len = snprintf(numBuf, sizeof(numBuf), "%.*f", field.precision, num);
+					} else {
+						value.AppendString(strBuf, vm);
+						len = (int)strBuf.LengthB();
+						if (len >= (int)sizeof(numBuf)) len = sizeof(numBuf) - 1;
+						memcpy(numBuf, strBuf.data(), len);
+						numBuf[len] = 0;
+					}
+			}
+			if (len < 0) len = 0;
+			if (len >= (int)sizeof(numBuf)) len = sizeof(numBuf) - 1;
+			if (field.plusSign and numBuf[0] != '-' and len + 1 < (int)sizeof(numBuf)) {
+				memmove(numBuf + 1, numBuf, len + 1);
+				numBuf[0] = '+';
+				len++;
+			}
+			if (field.grouping) len = AddThousandsSeparators(numBuf, len, sizeof(numBuf));
+			if (field.zeroPad and field.align == 0 and len < field.width) {
+				// pad with zeros between the sign and the digits
+				int signLen = (numBuf[0] == '-' or numBuf[0] == '+') ? 1 : 0;
+				int pad = field.width - len;
+				if (len + pad >= (int)sizeof(numBuf)) pad = sizeof(numBuf) - 1 - len;
+				memmove(numBuf + signLen + pad, numBuf + signLen, len - signLen + 1);
+				memset(numBuf + signLen, '0', pad);
+				len += pad;
+			}
+			text = numBuf;
+			textLen = len;
+		} else {
+			if (value.type == ValueType::String) {
+				strVal = value.ToString();		// (shares the storage; no copy)
+				text = strVal.c_str();
+				textLen = strVal.LengthB();
+			} else {
+				if (value.IsNull()) strBuf.Append("null");
+				else value.AppendString(strBuf, vm);
+				text = strBuf.data();
+				textLen = strBuf.LengthB();
+			}
+			if (field.precision >= 0) {
+				// truncate to the given number of characters
+				const unsigned char *p = (const unsigned char*)text;
+				const unsigned char *end = p + textLen;
+				for (int i=0; i < field.precision and p < end; i++) {
+					p++;
+					while (p < end and IsUTF8IntraChar(*p)) p++;
+				}
+				textLen = (const char*)p - text;
+			}
+		}
+
+		// Now pad to the desired width (counted in characters).
+		long chars = 0;
+		if (field.width > 0) {
+			for (long i=0; i<textLen; i++) if (!IsUTF8IntraChar((unsigned char)text[i])) chars++;
+		}
+		long pad = field.width > chars ? field.width - chars : 0;
+		char align = field.align ? field.align : (isNumber ? '>' : '<');
+		long padLeft = (align == '>' ? pad : (align == '^' ? pad / 2 : 0));
+		long padRight = pad - padLeft;
+		size_t fillLen = strlen(field.fill);
+		for (long i=0; i<padLeft; i++) out.Append(field.fill, fillLen);
+		out.Append(text, textLen);
+		for (long i=0; i<padRight; i++) out.Append(field.fill, fillLen);
+	}
+
+	static IntrinsicResult intrinsic_format(Context *context, IntrinsicResult partialResult) {
+		Value self = context->GetVar("self");
+		if (self.type != ValueType::String) TypeException("Type Error: 'format' requires a string template").raise();
+		Value args = context->GetVar("args");
+		FormatTemplateStorage *tmpl = GetFormatTemplate(self);
+		Value keepAlive = Value::NewHandle(tmpl);		// (in case the cache is cleared meanwhile)
+		tmpl->retain();
+
+		ValueList argList;
+		ValueDict argMap;
+		if (args.type == ValueType::List) argList = args.GetList();
+		else if (args.type == ValueType::Map) argMap = args.GetDict();
+		else if (!args.IsNull()) argList.Add(args);
+
+		const char *src = tmpl->source.c_str();
+		StringBuilder out(tmpl->fixedBytes + tmpl->fields.size() * 8);
+		for (long i=0, n=tmpl->fields.size(); i<n; i++) {
+			const FormatField& field = tmpl->fields[i];
+			out.Append(src + field.litStart, field.litLen);
+			if (!field.isField) continue;
+			Value value;
+			if (args.type == ValueType::Map) {
+				Value key = field.keyIndex >= 0 ? tmpl->keys[field.keyIndex] : Value((double)field.autoIndex);
+				if (!argMap.Get(key, &value)) {
+					// a numeric key like {0} may also name a string key "0"
+					if (key.type != ValueType::Number or !argMap.Get(key.ToString(), &value)) {
+						KeyException(key.ToString()).raise();
+					}
+				}
+			} else {
+				Value key = field.keyIndex >= 0 ? tmpl->keys[field.keyIndex] : Value((double)field.autoIndex);
+				if (key.type != ValueType::Number) KeyException(key.ToString()).raise();
+				long idx = (long)key.data.number;
+				if (idx >= argList.Count()) {
+					IndexException(String("format: index ") + key.ToString() + " out of range (" + String::Format(argList.Count()) + " arguments)").raise();
+				}
+				value = argList[idx];
+			}
+			AppendFormatted(out, field, value, context->vm);
+		}
+		if (out.LengthB() > (size_t)Value::maxStringSize) LimitExceededException("string too large").raise();
+		return IntrinsicResult(out.ToString());
+	}
+
 	static IntrinsicResult intrinsic_function(Context *context, IntrinsicResult partialResult) {
 		if (context->vm->functionType.IsNull()) {
 			context->vm->functionType = Intrinsics::FunctionType().EvalCopy(context->vm->GetGlobalContext());
@@ -323,6 +679,24 @@ namespace MiniScript {
 	};
 	
 	
+	// memoize: return a new function that does the same as the given one, but
+	// remembers its results; calling it again with the same arguments returns
+	// the remembered result without running the function at all.  With a
+	// maxSize > 0, only that many results are kept (least recently used go first).
+	static IntrinsicResult intrinsic_memoize(Context *context, IntrinsicResult partialResult) {
+		Value func = context->GetVar("func");
+		if (func.type != ValueType::Function) TypeException("memoize: function required (use @ to refer to it)").raise();
+		long maxSize = context->GetVar("maxSize").IntValue();
+		if (maxSize < 0) maxSize = 0;
+		FunctionStorage *src = (FunctionStorage*)func.data.ref;
+		FunctionStorage *result = new FunctionStorage();
+		result->parameters = src->parameters;
+		result->code = src->code;
+		result->outerVars = src->outerVars;
+		result->memo = new MemoCache(maxSize);
+		return IntrinsicResult(Value(result));
+	}
+	
 	static IntrinsicResult intrinsic_number(Context *context, IntrinsicResult partialResult) {
 		if (context->vm->numberType.IsNull()) {
 			context->vm->numberType = Intrinsics::NumberType().EvalCopy(context->vm->GetGlobalContext());
@@ -339,12 +713,16 @@ namespace MiniScript {
 		Value s = context->GetVar("s");
 		if (s.IsNull()) s = "null";
 		Value delimiter = context->GetVar("delimiter");
+		// A StringBuilder prints straight from its buffer (without ToString,
+		// which would make the next append copy the whole thing).
+		StringBuilderStorage *sb = StringBuilderStorage::Get(s);
+		String str = sb ? String(sb->data(), sb->LengthB()) : s.ToString();
 		if (delimiter.IsNull()) {
-			(*context->vm->standardOutput)(s.ToString(), false);
+			(*context->vm->standardOutput)(str, false);
 		} else if (delimiter == _EOL) {
-			(*context->vm->standardOutput)(s.ToString(), true);
+			(*context->vm->standardOutput)(str, true);
 		} else {
-			(*context->vm->standardOutput)(s.ToString() + delimiter.ToString(), false);
+			(*context->vm->standardOutput)(str + delimiter.ToString(), false);
 		}
 		return IntrinsicResult::Null;
 	}
@@ -484,6 +862,23 @@ namespace MiniScript {
 		return IntrinsicResult::Null;
 	}
 	
+	// removeRange: remove the elements self[from:to] from the list, in place.
+	static IntrinsicResult intrinsic_removeRange(Context *context, IntrinsicResult partialResult) {
+		Value self = context->GetVar("self");
+		if (self.type != ValueType::List) TypeException("Type Error: 'removeRange' requires a list").raise();
+		ValueList list = self.GetList();
+		long count = list.Count();
+		long fromIdx = context->GetVar("from").IntValue();
+		Value toVal = context->GetVar("to");
+		long toIdx = toVal.IsNull() ? count : toVal.IntValue();
+		if (fromIdx < 0) fromIdx += count;
+		if (fromIdx < 0) fromIdx = 0;
+		if (toIdx < 0) toIdx += count;
+		if (toIdx > count) toIdx = count;
+		if (toIdx > fromIdx) list.RemoveRange(fromIdx, toIdx - fromIdx);
+		return IntrinsicResult::Null;
+	}
+	
 	static IntrinsicResult intrinsic_replace(Context *context, IntrinsicResult partialResult) {
 		Value self = context->GetVar("self");
 		Value oldval = context->GetVar("oldval");
@@ -547,10 +942,30 @@ namespace MiniScript {
 	
 	static IntrinsicResult intrinsic_rnd(Context *context, IntrinsicResult partialResult) {
 		Value seed = context->GetVar("seed");
-		if (seed.IsNull()) InitRand();
-		else InitRand((unsigned int)seed.IntValue());
-		double d = (double)rand() / (RAND_MAX + 1.0);
-		return IntrinsicResult(d);
+		RandomGenerator& random = context->vm->random;
+		if (!seed.IsNull()) random.Seed((uint64_t)(int64_t)seed.DoubleValue());
+		return IntrinsicResult(random.NextDouble());
+	};
+
+	static IntrinsicResult intrinsic_rndInt(Context *context, IntrinsicResult partialResult) {
+		double lo = floor(context->GetVar("lo").DoubleValue());
+		double hi = floor(context->GetVar("hi").DoubleValue());
+		if (!std::isfinite(lo) or !std::isfinite(hi)) RuntimeException("rndInt: bounds must be finite numbers").raise();
+		if (hi < lo) std::swap(lo, hi);
+		// (hi - lo must fit in a uint64_t, i.e. be below 2^64, before we convert it.)
+		if (hi - lo >= 18446744073709551616.0) RuntimeException("rndInt: range too large").raise();
+		uint64_t span = (uint64_t)(hi - lo) + 1;
+		return IntrinsicResult(lo + (double)context->vm->random.NextBelow(span));
+	};
+
+	static IntrinsicResult intrinsic_rndList(Context *context, IntrinsicResult partialResult) {
+		long count = context->GetVar("n").IntValue();
+		if (count < 0) count = 0;
+		if (count > Value::maxListSize) LimitExceededException("list too large").raise();
+		RandomGenerator& random = context->vm->random;
+		ValueList result(count);
+		for (long i=0; i<count; i++) result.Add(random.NextDouble());
+		return IntrinsicResult(result);
 	};
 
 	static IntrinsicResult intrinsic_sign(Context *context, IntrinsicResult partialResult) {
@@ -565,6 +980,42 @@ namespace MiniScript {
 		return IntrinsicResult(sin(radians.DoubleValue()));
 	}
 	
+	// splice: remove deleteCount elements starting at index, and insert the
+	// given items in their place.  Returns a list of the removed elements.
+	static IntrinsicResult intrinsic_splice(Context *context, IntrinsicResult partialResult) {
+		Value self = context->GetVar("self");
+		Value index = context->GetVar("index");
+		Value items = context->GetVar("items");
+		if (self.type != ValueType::List) TypeException("Type Error: 'splice' requires a list").raise();
+		if (index.type != ValueType::Number) RuntimeException("splice: number required for index argument").raise();
+		if (!items.IsNull() and items.type != ValueType::List) TypeException("Type Error: 'splice' items must be a list").raise();
+		ValueList list = self.GetList();
+		long count = list.Count();
+		long idx = index.IntValue();
+		if (idx < 0) idx += count;
+		CheckRange(idx, 0, count);
+		long deleteCount = context->GetVar("deleteCount").IntValue();
+		if (deleteCount < 0) deleteCount = 0;
+		if (deleteCount > count - idx) deleteCount = count - idx;
+		
+		ValueList removed(deleteCount);
+		for (long i = 0; i < deleteCount; i++) removed.Add(list[idx + i]);
+		if (!items.IsNull()) {
+			ValueList newItems = items.GetList();
+			if (count - deleteCount + newItems.Count() > Value::maxListSize) LimitExceededException("list too large").raise();
+			if (items.RefEquals(self)) {
+				// Splicing a list into itself: insert what it held beforehand.
+				newItems = ValueList(count);
+				newItems.AddRange(list);
+			}
+			list.RemoveRange(idx, deleteCount);
+			list.InsertRange(newItems, idx);
+		} else {
+			list.RemoveRange(idx, deleteCount);
+		}
+		return IntrinsicResult(removed);
+	}
+	
 	static IntrinsicResult intrinsic_slice(Context *context, IntrinsicResult partialResult) {
 		Value seq = context->GetVar("seq");
 		long fromIdx = context->GetVar("from").IntValue();
@@ -636,6 +1087,37 @@ namespace MiniScript {
 		return sort_lesser(b.sortKey, a.sortKey);
 	}
 
+	// Sort the given list in place, by the corresponding entries of keys.
+	static void SortByKeys(ValueList& list, ValueList& keys, bool ascending) {
+		long count = list.Count();
+		KeyedValue *arr = new KeyedValue[count];
+		for (long i=0; i<count; i++) {
+			arr[i].value = list[i];
+			arr[i].sortKey = keys[i];
+			arr[i].valueIndex = (int)i;
+		}
+		std::stable_sort(arr, arr + count, ascending ? &sort_KeyedValue : &sort_KeyedValueDesc);
+		for (long i=0; i<count; i++) list[i] = arr[i].value;
+		delete[] arr;
+	}
+
+	// Call func on each element of list in turn, collecting the results.
+	// Each call runs on the VM stack above us (see Machine::CallFromIntrinsic),
+	// so until the last one returns, this gives back a partial result holding
+	// the results so far; once done, the result is the complete list.
+	static IntrinsicResult CallForEach(Context *context, IntrinsicResult partialResult, ValueList list, const Value& func) {
+		ValueList results;
+		if (partialResult.Done()) results = ValueList(list.Count());
+		else {
+			results = partialResult.Result().GetList();
+			results.Add(context->GetTemp(callResultTemp));
+		}
+		long i = results.Count();
+		if (i >= list.Count()) return IntrinsicResult(results);
+		context->vm->CallFromIntrinsic(context, func, &list[i], 1, Value::Temp(callResultTemp));
+		return partialResult.Done() ? IntrinsicResult(results, false) : partialResult;
+	}
+
 	static IntrinsicResult intrinsic_sort(Context *context, IntrinsicResult partialResult) {
 		Value self = context->GetVar("self");
 		if (self.type != ValueType::List) return IntrinsicResult(self);
@@ -650,7 +1132,15 @@ namespace MiniScript {
 			std::stable_sort(&list[0], &list[0] + list.Count(), ascending ? &sort_lesser : &sort_greater);
 			return IntrinsicResult(list);
 		}
-		// Harder case: sorting values by a given map key or function.
+		if (byKey.type == ValueType::Function) {
+			// Sorting by the result of a function: get the key for each element, then sort by those.
+			IntrinsicResult keys = CallForEach(context, partialResult, list, byKey);
+			if (not keys.Done()) return keys;
+			ValueList keyList = keys.Result().GetList();
+			SortByKeys(list, keyList, ascending);
+			return IntrinsicResult(list);
+		}
+		// Harder case: sorting values by a given map key.
 		// Construct an array of ValuePair, sort that, and then convert back into a list of values.
 		KeyedValue *arr = new KeyedValue[list.Count()];
 		for (int i=0; i<list.Count(); i++) {
@@ -678,6 +1168,84 @@ namespace MiniScript {
 		return IntrinsicResult(list);
 	}
 	
+	static IntrinsicResult intrinsic_listFilter(Context *context, IntrinsicResult partialResult) {
+		Value self = context->GetVar("self");
+		Value func = context->GetVar("func");
+		if (self.type != ValueType::List) TypeException("Type Error: 'filter' requires a list").raise();
+		ValueList list = self.GetList();
+		long count = list.Count();
+		long kept = 0;
+		if (func.type == ValueType::Function) {
+			IntrinsicResult results = CallForEach(context, partialResult, list, func);
+			if (not results.Done()) return results;
+			ValueList keep = results.Result().GetList();
+			if (count > keep.Count()) count = keep.Count();		// (in case func shortened the list)
+			for (long i=0; i<count; i++) {
+				if (not keep[i].BoolValue()) continue;
+				if (kept != i) list[kept] = list[i];
+				kept++;
+			}
+		} else {
+			// Not a function, but an index (e.g. the name of a map key) that must be
+			// true to keep an element.  Look it up as item[func] would, so this works
+			// with lists, strings, and maps (including their __isa chain) alike.
+			for (long i=0; i<count; i++) {
+				Value item = list[i];
+				if (not Value::SeqElem(item, func).Val(context).BoolValue()) continue;
+				if (kept != i) list[kept] = item;
+				kept++;
+			}
+		}
+		list.RemoveRange(kept, list.Count() - kept);
+		return IntrinsicResult::Null;
+	}
+
+	static IntrinsicResult intrinsic_listMap(Context *context, IntrinsicResult partialResult) {
+		Value self = context->GetVar("self");
+		Value func = context->GetVar("func");
+		if (self.type != ValueType::List) TypeException("Type Error: 'map' requires a list").raise();
+		if (func.type != ValueType::Function) TypeException("map: function required (use @ to refer to it)").raise();
+		return CallForEach(context, partialResult, self.GetList(), func);
+	}
+
+	static IntrinsicResult intrinsic_listReduce(Context *context, IntrinsicResult partialResult) {
+		Value self = context->GetVar("self");
+		Value func = context->GetVar("func");
+		if (self.type != ValueType::List) TypeException("Type Error: 'reduce' requires a list").raise();
+		if (func.type != ValueType::Function) TypeException("reduce: function required (use @ to refer to it)").raise();
+		ValueList list = self.GetList();
+		long count = list.Count();
+		Value args[2];
+		long next;		// index of the next element to fold in
+		if (partialResult.Done()) {
+			// First call: func(first, second), or with nulls where the list runs short.
+			if (count > 0) args[0] = list[0];
+			if (count > 1) args[1] = list[1];
+			next = count < 2 ? count : 2;
+		} else {
+			next = partialResult.Result().IntValue();
+			if (next >= count) return IntrinsicResult(context->GetTemp(callResultTemp));
+			args[0] = context->GetTemp(callResultTemp);
+			args[1] = list[next++];
+		}
+		context->vm->CallFromIntrinsic(context, func, args, 2, Value::Temp(callResultTemp));
+		return IntrinsicResult(Value(next), false);
+	}
+
+	static IntrinsicResult intrinsic_listSortBy(Context *context, IntrinsicResult partialResult) {
+		Value self = context->GetVar("self");
+		Value func = context->GetVar("func");
+		if (self.type != ValueType::List) return IntrinsicResult(self);
+		if (func.type != ValueType::Function) TypeException("sortBy: function required (use @ to refer to it)").raise();
+		ValueList list = self.GetList();
+		if (list.Count() < 2) return IntrinsicResult(list);
+		IntrinsicResult keys = CallForEach(context, partialResult, list, func);
+		if (not keys.Done()) return keys;
+		ValueList keyList = keys.Result().GetList();
+		SortByKeys(list, keyList, context->GetVar("ascending").BoolValue());
+		return IntrinsicResult(list);
+	}
+
 	static IntrinsicResult intrinsic_sqrt(Context *context, IntrinsicResult partialResult) {
 		return IntrinsicResult(sqrt(context->GetVar("x").DoubleValue()));
 	}
@@ -700,6 +1268,103 @@ namespace MiniScript {
 		return IntrinsicResult(context->GetVar("x").ToString());
 	}
 
+	void StringBuilderStorage::Append(Value v, Machine *vm) {
+		if (frozen) Thaw();
+		StringBuilderStorage *other = Get(v);
+		if (other) buffer.Append(other->data(), other->LengthB());
+		else v.AppendString(buffer, vm);
+		if (buffer.LengthB() > (size_t)Value::maxStringSize) {
+			buffer.Clear();
+			LimitExceededException("string too large").raise();
+		}
+	}
+
+	long StringBuilderStorage::Length() const {
+		const unsigned char *c = (const unsigned char*)data();
+		long count = 0;
+		for (size_t i = 0, n = LengthB(); i < n; i++) {
+			if (!IsUTF8IntraChar(c[i])) count++;
+		}
+		return count;
+	}
+
+	String StringBuilderStorage::ToString() {
+		if (frozen) return snapshot;
+		// A builder that's still being appended to after an earlier ToString
+		// probably will be again; so give it a copy, and keep our buffer.
+		if (thawed) return String(buffer.data(), buffer.LengthB());
+		snapshot = buffer.ToString();	// (takes over the buffer; no copy)
+		frozen = true;
+		return snapshot;
+	}
+
+	void StringBuilderStorage::Thaw() {
+		// Our contents were handed out by ToString; start a new buffer with a
+		// copy of them (leaving room to grow), and leave the snapshot alone.
+		buffer.Reserve(snapshot.LengthB() * 2);
+		buffer.Append(snapshot);
+		snapshot = String();
+		frozen = false;
+		thawed = true;
+	}
+
+	static NativeObject *NewStringBuilder() {
+		return new StringBuilderStorage();
+	}
+
+	NativeClass& StringBuilderStorage::Class() {
+		static NativeClass cls("StringBuilder", &NewStringBuilder);
+		return cls;
+	}
+
+	static IntrinsicResult intrinsic_stringBuilder(Context *context, IntrinsicResult partialResult) {
+		return IntrinsicResult(Intrinsics::StringBuilderType());
+	}
+
+	static IntrinsicResult intrinsic_sbAppend(Context *context, IntrinsicResult partialResult) {
+		Value self = context->GetVar("self");
+		StringBuilderStorage *sb = StringBuilderStorage::Get(self);
+		if (!sb) TypeException("Type Error: 'append' requires a StringBuilder").raise();
+		sb->Append(context->GetVar("s"), context->vm);
+		return IntrinsicResult(self);
+	}
+
+	static IntrinsicResult intrinsic_sbAppendLine(Context *context, IntrinsicResult partialResult) {
+		Value self = context->GetVar("self");
+		StringBuilderStorage *sb = StringBuilderStorage::Get(self);
+		if (!sb) TypeException("Type Error: 'appendLine' requires a StringBuilder").raise();
+		sb->Append(context->GetVar("s"), context->vm);
+		sb->Append("\n", 1);
+		return IntrinsicResult(self);
+	}
+
+	static IntrinsicResult intrinsic_sbAppendNumber(Context *context, IntrinsicResult partialResult) {
+		Value self = context->GetVar("self");
+		StringBuilderStorage *sb = StringBuilderStorage::Get(self);
+		if (!sb) TypeException("Type Error: 'appendNumber' requires a StringBuilder").raise();
+		Value x = context->GetVar("x");
+		if (x.type != ValueType::Number) TypeException("Type Error: 'appendNumber' requires a number").raise();
+		sb->Append(x, context->vm);
+		return IntrinsicResult(self);
+	}
+
+	static IntrinsicResult intrinsic_sbClear(Context *context, IntrinsicResult partialResult) {
+		StringBuilderStorage *sb = StringBuilderStorage::Get(context->GetVar("self"));
+		if (sb) sb->Clear();
+		return IntrinsicResult::Null;
+	}
+
+	static IntrinsicResult intrinsic_sbLen(Context *context, IntrinsicResult partialResult) {
+		StringBuilderStorage *sb = StringBuilderStorage::Get(context->GetVar("self"));
+		return IntrinsicResult(sb ? (double)sb->Length() : 0.0);
+	}
+
+	static IntrinsicResult intrinsic_sbToString(Context *context, IntrinsicResult partialResult) {
+		StringBuilderStorage *sb = StringBuilderStorage::Get(context->GetVar("self"));
+		if (!sb) return IntrinsicResult::EmptyString;
+		return IntrinsicResult(sb->ToString());
+	}
+
 	static IntrinsicResult intrinsic_string(Context *context, IntrinsicResult partialResult) {
 		if (context->vm->stringType.IsNull()) {
 			context->vm->stringType = Intrinsics::StringType().EvalCopy(context->vm->GetGlobalContext());
@@ -707,15 +1372,38 @@ namespace MiniScript {
 		return IntrinsicResult(context->vm->stringType);
 	};
 	
+	static IntrinsicResult intrinsic_sample(Context *context, IntrinsicResult partialResult) {
+		Value self = context->GetVar("self");
+		if (self.type != ValueType::List) return IntrinsicResult::Null;
+		ValueList src = self.GetList();
+		long count = src.Count();
+		long k = context->GetVar("k").IntValue();
+		if (k > count) k = count;
+		if (k < 0) k = 0;
+		RandomGenerator& random = context->vm->random;
+		// Partial Fisher-Yates over a copy: the first k slots end up holding
+		// k distinct elements chosen uniformly at random.
+		ValueList pool(count);
+		for (long i=0; i<count; i++) pool.Add(src[i]);
+		for (long i=0; i<k; i++) {
+			long j = i + (long)random.NextBelow(count - i);
+			Value temp = pool[j];
+			pool[j] = pool[i];
+			pool[i] = temp;
+		}
+		pool.Resize(k);
+		return IntrinsicResult(pool);
+	}
+
 	static IntrinsicResult intrinsic_shuffle(Context *context, IntrinsicResult partialResult) {
 		Value self = context->GetVar("self");
-		InitRand();
+		RandomGenerator& random = context->vm->random;
 		if (self.type == ValueType::List) {
 			ValueList list = self.GetList();
 			// We'll do a Fisher-Yates shuffle, i.e., swap each element
 			// with a randomly selected one.
 			for (long i=list.Count()-1; i >= 1; i--) {
-				int j = rand() % (i+1);
+				long j = (long)random.NextBelow(i+1);
 				Value temp = list[j];
 				list[j] = list[i];
 				list[i] = temp;
@@ -726,7 +1414,7 @@ namespace MiniScript {
 			// is the values associated with the keys, not the keys themselves.
 			ValueList keys = map.Keys();
 			for (long i=keys.Count()-1; i >= 1; i--) {
-				int j = rand() % (i+1);
+				long j = (long)random.NextBelow(i+1);
 				Value keyi = keys[i];
 				Value keyj = keys[j];
 				Value temp = map[keyj];
@@ -905,7 +1593,7 @@ namespace MiniScript {
 	
 	/// GetFunc is used internally by the compiler to get the MiniScript function
 	/// that makes an intrinsic call.
-	Value Intrinsic::GetFunc() {
+	const Value& Intrinsic::GetFunc() {
 		if (function->code.Count() == 0) {
 			// Our little wrapper function is a single opcode: CallIntrinsicA.
 			// It really exists only to provide a local variable context for the parameters.
@@ -967,10 +1655,20 @@ namespace MiniScript {
 		f->AddParam("radians", 0);
 		f->code = &intrinsic_cos;
 		
+		f = Intrinsic::Create("extend");
+		f->AddParam("self");
+		f->AddParam("items");
+		f->code = &intrinsic_extend;
+		
 		f = Intrinsic::Create("floor");
 		f->AddParam("x", 0);
 		f->code = &intrinsic_floor;
 		
+		f = Intrinsic::Create("format");
+		f->AddParam("self");
+		f->AddParam("args");
+		f->code = &intrinsic_format;
+		
 		f = Intrinsic::Create("funcRef");
 		f->code = &intrinsic_function;
 		
@@ -1026,6 +1724,11 @@ namespace MiniScript {
 		f = Intrinsic::Create("map");
 		f->code = &intrinsic_map;
 		
+		f = Intrinsic::Create("memoize");
+		f->AddParam("func");
+		f->AddParam("maxSize", 0);
+		f->code = &intrinsic_memoize;
+		
 		f = Intrinsic::Create("number");
 		f->code = &intrinsic_number;
 		
@@ -1066,6 +1769,12 @@ namespace MiniScript {
 		f->AddParam("k");
 		f->code = &intrinsic_remove;
 		
+		f = Intrinsic::Create("removeRange");
+		f->AddParam("self");
+		f->AddParam("from", 0);
+		f->AddParam("to");
+		f->code = &intrinsic_removeRange;
+		
 		f = Intrinsic::Create("replace");
 		f->AddParam("self");
 		f->AddParam("oldval");
@@ -1082,6 +1791,20 @@ namespace MiniScript {
 		f->AddParam("seed");
 		f->code = &intrinsic_rnd;
 
+		f = Intrinsic::Create("rndInt");
+		f->AddParam("lo", 0);
+		f->AddParam("hi", 1);
+		f->code = &intrinsic_rndInt;
+
+		f = Intrinsic::Create("rndList");
+		f->AddParam("n", 1);
+		f->code = &intrinsic_rndList;
+
+		f = Intrinsic::Create("sample");
+		f->AddParam("self");
+		f->AddParam("k", 1);
+		f->code = &intrinsic_sample;
+
 		f = Intrinsic::Create("sign");
 		f->AddParam("x", 0);
 		f->code = &intrinsic_sign;
@@ -1096,12 +1819,40 @@ namespace MiniScript {
 		f->AddParam("to");
 		f->code = &intrinsic_slice;
 
+		f = Intrinsic::Create("splice");
+		f->AddParam("self");
+		f->AddParam("index", 0);
+		f->AddParam("deleteCount", 0);
+		f->AddParam("items");
+		f->code = &intrinsic_splice;
+
 		f = Intrinsic::Create("sort");
 		f->AddParam("self", 0);
 		f->AddParam("byKey");
 		f->AddParam("ascending", 1);
 		f->code = &intrinsic_sort;
 		
+		i_listFilter = Intrinsic::Create("");
+		i_listFilter->AddParam("self");
+		i_listFilter->AddParam("func");
+		i_listFilter->code = &intrinsic_listFilter;
+
+		i_listMap = Intrinsic::Create("");
+		i_listMap->AddParam("self");
+		i_listMap->AddParam("func");
+		i_listMap->code = &intrinsic_listMap;
+
+		i_listReduce = Intrinsic::Create("");
+		i_listReduce->AddParam("self");
+		i_listReduce->AddParam("func");
+		i_listReduce->code = &intrinsic_listReduce;
+
+		i_listSortBy = Intrinsic::Create("");
+		i_listSortBy->AddParam("self");
+		i_listSortBy->AddParam("func");
+		i_listSortBy->AddParam("ascending", 1);
+		i_listSortBy->code = &intrinsic_listSortBy;
+
 		f = Intrinsic::Create("split");
 		f->AddParam("self");
 		f->AddParam("delimiter", " ");
@@ -1121,6 +1872,36 @@ namespace MiniScript {
 
 		f = Intrinsic::Create("string");
 		f->code = &intrinsic_string;
+
+		f = Intrinsic::Create("StringBuilder");
+		f->code = &intrinsic_stringBuilder;
+
+		i_sbAppend = Intrinsic::Create("");
+		i_sbAppend->AddParam("self");
+		i_sbAppend->AddParam("s", "");
+		i_sbAppend->code = &intrinsic_sbAppend;
+
+		i_sbAppendLine = Intrinsic::Create("");
+		i_sbAppendLine->AddParam("self");
+		i_sbAppendLine->AddParam("s", "");
+		i_sbAppendLine->code = &intrinsic_sbAppendLine;
+
+		i_sbAppendNumber = Intrinsic::Create("");
+		i_sbAppendNumber->AddParam("self");
+		i_sbAppendNumber->AddParam("x", 0);
+		i_sbAppendNumber->code = &intrinsic_sbAppendNumber;
+
+		i_sbClear = Intrinsic::Create("");
+		i_sbClear->AddParam("self");
+		i_sbClear->code = &intrinsic_sbClear;
+
+		i_sbLen = Intrinsic::Create("");
+		i_sbLen->AddParam("self");
+		i_sbLen->code = &intrinsic_sbLen;
+
+		i_sbToString = Intrinsic::Create("");
+		i_sbToString->AddParam("self");
+		i_sbToString->code = &intrinsic_sbToString;
 		
 		f = Intrinsic::Create("shuffle");
 		f->AddParam("self");
@@ -1202,16 +1983,24 @@ namespace MiniScript {
 			d.SetValue("indexes", Intrinsic::GetByName("indexes")->GetFunc());
 			d.SetValue("indexOf",  Intrinsic::GetByName("indexOf")->GetFunc());
 			d.SetValue("insert",  Intrinsic::GetByName("insert")->GetFunc());
+			d.SetValue("extend",  Intrinsic::GetByName("extend")->GetFunc());
+			d.SetValue("filter",  i_listFilter->GetFunc());
 			d.SetValue("join",  Intrinsic::GetByName("join")->GetFunc());
 			d.SetValue("len",  Intrinsic::GetByName("len")->GetFunc());
+			d.SetValue("map",  i_listMap->GetFunc());
 			d.SetValue("pop",  Intrinsic::GetByName("pop")->GetFunc());
 			d.SetValue("pull",  Intrinsic::GetByName("pull")->GetFunc());
 			d.SetValue("push",  Intrinsic::GetByName("push")->GetFunc());
+			d.SetValue("reduce",  i_listReduce->GetFunc());
 			d.SetValue("shuffle",  Intrinsic::GetByName("shuffle")->GetFunc());
 			d.SetValue("sort",  Intrinsic::GetByName("sort")->GetFunc());
+			d.SetValue("sortBy",  i_listSortBy->GetFunc());
 			d.SetValue("sum",  Intrinsic::GetByName("sum")->GetFunc());
 			d.SetValue("remove",  Intrinsic::GetByName("remove")->GetFunc());
+			d.SetValue("removeRange",  Intrinsic::GetByName("removeRange")->GetFunc());
 			d.SetValue("replace",  Intrinsic::GetByName("replace")->GetFunc());
+			d.SetValue("sample",  Intrinsic::GetByName("sample")->GetFunc());
+			d.SetValue("splice",  Intrinsic::GetByName("splice")->GetFunc());
 			d.SetValue("values",  Intrinsic::GetByName("values")->GetFunc());
 			_listType = d;
 		}
@@ -1254,6 +2043,7 @@ namespace MiniScript {
 			d.SetValue("indexOf",  Intrinsic::GetByName("indexOf")->GetFunc());
 			d.SetValue("insert",  Intrinsic::GetByName("insert")->GetFunc());
 			d.SetValue("code",  Intrinsic::GetByName("code")->GetFunc());
+			d.SetValue("format",  Intrinsic::GetByName("format")->GetFunc());
 			d.SetValue("len",  Intrinsic::GetByName("len")->GetFunc());
 			d.SetValue("lower",  Intrinsic::GetByName("lower")->GetFunc());
 			d.SetValue("val",  Intrinsic::GetByName("val")->GetFunc());
@@ -1267,4 +2057,17 @@ namespace MiniScript {
 		return _stringType;
 	}
 
+	Value Intrinsics::StringBuilderType() {
+		NativeClass& cls = StringBuilderStorage::Class();
+		if (cls.classMap.Count() == 0) {
+			cls.AddMethod("append", i_sbAppend->GetFunc());
+			cls.AddMethod("appendLine", i_sbAppendLine->GetFunc());
+			cls.AddMethod("appendNumber", i_sbAppendNumber->GetFunc());
+			cls.AddMethod("clear", i_sbClear->GetFunc());
+			cls.AddMethod("len", i_sbLen->GetFunc());
+			cls.AddMethod("toString", i_sbToString->GetFunc());
+		}
+		return cls.classMap;
+	}
+
 }
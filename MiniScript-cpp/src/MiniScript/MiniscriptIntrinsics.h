@@ -53,15 +53,86 @@ namespace MiniScript {
 		static Value MapType();
 		static Value NumberType();
 		static Value StringType();
+		static Value StringBuilderType();
 	private:
 		static bool initialized;
 	};
 	
+	/// RandomGenerator: a small, fast pseudo-random number generator (xoshiro256**).
+	/// Each Machine owns one, so separate interpreters never share random state.
+	/// It seeds itself on first use unless Seed has been called.
+	class RandomGenerator {
+	public:
+		RandomGenerator() : seeded(false) {}
+
+		void Seed(uint64_t seed);
+
+		// Next raw 64-bit value.
+		uint64_t Next() {
+			if (!seeded) SeedDefault();
+			uint64_t result = rotl(state[1] * 5, 7) * 9;
+			uint64_t t = state[1] << 17;
+			state[2] ^= state[0];
+			state[3] ^= state[1];
+			state[1] ^= state[2];
+			state[0] ^= state[3];
+			state[2] ^= t;
+			state[3] = rotl(state[3], 45);
+			return result;
+		}
+
+		// Uniformly distributed double in [0, 1), with full 53-bit resolution.
+		double NextDouble() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+		// Uniformly distributed integer in [0, n), without modulo bias.
+		uint64_t NextBelow(uint64_t n);
+
+	private:
+		static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+		void SeedDefault();
+
+		uint64_t state[4];
+		bool seeded;
+	};
+
+	/// StringBuilderStorage: the native object behind a MiniScript StringBuilder.
+	/// ToString shares the buffer with the String it returns instead of copying
+	/// it; the next change after that starts a new buffer.
+	class StringBuilderStorage : public NativeObject {
+	public:
+		StringBuilderStorage() : NativeObject(Class()), frozen(false), thawed(false) {}
+		static NativeClass& Class();
+
+		const char *data() const { return frozen ? snapshot.c_str() : buffer.data(); }
+		size_t LengthB() const { return frozen ? snapshot.LengthB() : buffer.LengthB(); }
+		long Length() const;	// (in characters, like String::Length)
+
+		void Append(const char *c, size_t bytes) { if (frozen) Thaw(); buffer.Append(c, bytes); }
+		void Append(Value v, Machine *vm);
+		void Clear() { frozen = false; snapshot = String(); buffer.Clear(); }
+		String ToString();
+
+		// Get the storage behind a StringBuilder object, or nullptr if the given
+		// value is not one.
+		static StringBuilderStorage *Get(const Value& obj) { return (StringBuilderStorage*)NativeObject::Get(obj, Class()); }
+
+	private:
+		void Thaw();
+
+		StringBuilder buffer;
+		String snapshot;	// contents as last returned by ToString (valid when frozen)
+		bool frozen;		// true when our contents live in snapshot rather than buffer
+		bool thawed;		// true once appended to after a ToString (so ToString copies from then on)
+	};
+
 	class IntrinsicResultStorage : public RefCountedStorage {
 	public:
 		bool done;			// true if our work is complete; false if we need to Continue
 		Value result;		// final result if done; in-progress data if not done
 		
+		static void *operator new(size_t size) { return RecyclingPool<sizeof(IntrinsicResultStorage)>::Allocate(size); }
+		static void operator delete(void *p, size_t size) { RecyclingPool<sizeof(IntrinsicResultStorage)>::Release(p, size); }
+		
 	private:
 		IntrinsicResultStorage() : done(true) {}
 		virtual ~IntrinsicResultStorage() {}
@@ -114,7 +185,7 @@ namespace MiniScript {
 
 		/// GetFunc is used internally by the compiler to get the MiniScript function
 		/// that makes an intrinsic call.
-		Value GetFunc();
+		const Value& GetFunc();
 
 		// Look up an Intrinsic by its internal numeric ID.
 		static Intrinsic *GetByID(long id) { return all[id]; }
@@ -149,6 +220,8 @@ namespace MiniScript {
 		static Dictionary<String, Intrinsic*, hashString> nameMap;
 	};
 
+	// Seed the random generator of every Machine that has not yet seeded its own
+	// (via rnd(seed) or first use).  Useful for reproducible runs.
 	void InitRand(unsigned int seed);
 }
 
@@ -29,6 +29,75 @@ namespace MiniScript {
 		}
 	}
 	
+	// Does the given TAC operand refer to the given identifier (directly,
+	// or as part of a sequence-element reference)?
+	static bool MentionsVar(const Value& v, const String& identifier) {
+		if (v.type == ValueType::Var) return v.GetString() == identifier;
+		if (v.type == ValueType::SeqElem) {
+			SeqElemStorage *se = (SeqElemStorage*)v.data.ref;
+			return MentionsVar(se->sequence, identifier) or MentionsVar(se->index, identifier);
+		}
+		return false;
+	}
+
+	static bool CodeMentionsVar(List<TACLine>& code, const String& identifier) {
+		for (long i = 0; i < code.Count(); i++) {
+			TACLine& line = code[i];
+			if (MentionsVar(line.lhs, identifier) or MentionsVar(line.rhsA, identifier)
+				or MentionsVar(line.rhsB, identifier)) return true;
+		}
+		return false;
+	}
+
+	// Make the strings in a completed block of code (literals and identifiers)
+	// immortal, so that copying them around at run time costs no refcounting.
+	static void MakeConstantsImmortal(List<TACLine>& code) {
+		for (long i = 0; i < code.Count(); i++) {
+			TACLine& line = code[i];
+			line.lhs.MakeImmortal();
+			line.rhsA.MakeImmortal();
+			line.rhsB.MakeImmortal();
+		}
+	}
+
+	// Let reads of global variables in a completed function body go through
+	// a per-line cache (see GlobalRef).  That's only safe for identifiers which
+	// can never be local: not parameters, not assigned anywhere in the body,
+	// and not in a function that could add locals some other way (by using
+	// `locals` or `import`, or by defining functions that use `outer`).
+	static void EnableGlobalCaching(ParseState& state) {
+		List<TACLine>& code = state.code;
+		if (CodeMentionsVar(code, "locals") or CodeMentionsVar(code, "import")) return;
+		
+		Dictionary<String, bool, hashString> mayBeLocal;
+		mayBeLocal.SetValue("self", true);
+		mayBeLocal.SetValue("super", true);
+		mayBeLocal.SetValue("locals", true);
+		mayBeLocal.SetValue("globals", true);
+		mayBeLocal.SetValue("outer", true);
+		if (state.function) {
+			for (long i = 0; i < state.function->parameters.Count(); i++) {
+				mayBeLocal.SetValue(state.function->parameters[i].name, true);
+			}
+		}
+		for (long i = 0; i < code.Count(); i++) {
+			TACLine& line = code[i];
+			if (line.lhs.type == ValueType::Var) mayBeLocal.SetValue(line.lhs.GetString(), true);
+			if (line.op == TACLine::Op::BindAssignA and line.rhsA.type == ValueType::Function) {
+				FunctionStorage *inner = (FunctionStorage*)line.rhsA.data.ref;
+				if (CodeMentionsVar(inner->code, "outer")) return;
+			}
+		}
+		
+		for (long i = 0; i < code.Count(); i++) {
+			TACLine& line = code[i];
+			if (line.rhsA.type == ValueType::Var and line.rhsA.localOnly == LocalOnlyMode::Off
+				and not mayBeLocal.ContainsKey(line.rhsA.GetString())) line.globalA.enabled = true;
+			if (line.rhsB.type == ValueType::Var and line.rhsB.localOnly == LocalOnlyMode::Off
+				and not mayBeLocal.ContainsKey(line.rhsB.GetString())) line.globalB.enabled = true;
+		}
+	}
+
 	JumpPoint ParseState::CloseJumpPoint(String keyword) {
 		long idx = jumpPoints.Count() - 1;
 		if (idx < 0 || jumpPoints[idx].keyword != keyword) {
@@ -179,6 +248,7 @@ namespace MiniScript {
 		Lexer tokens(partialInput + sourceCode);
 		partialInput = "";
 		ParseMultipleLines(tokens);
+		if (outputStack.Count() == 1) MakeConstantsImmortal(outputStack[0].code);
 		
 		if (not replMode and NeedMoreInput()) {
 			// Whoops, we need more input but we don't have any.  This is an error.
@@ -214,6 +284,8 @@ namespace MiniScript {
 					// Apply type specialization optimization to the completed function
 					TypeSpecializationEngine engine;
 					engine.specializeFunction(output->code);
+					EnableGlobalCaching(*output);
+					MakeConstantsImmortal(output->code);
 					
 					outputStack.Pop();
 					output = &outputStack.Last();
@@ -447,8 +519,20 @@ namespace MiniScript {
 			if (lhs.type == ValueType::Var) output->localOnlyIdentifier = lhs.GetString();
 			rhs = ParseExpr(tokens);
 
-			Value opA = FullyEvaluate(lhs, LocalOnlyMode::Strict);
 			Value opB = FullyEvaluate(rhs);
+			// For a variable or element target, first try updating it in place (which
+			// resolves the target only once); if that can't be done, that opcode
+			// falls through to the next two lines, which do it the general way.
+			bool canUpdate = !lhs.noInvoke and (lhs.type == ValueType::SeqElem or (lhs.type == ValueType::Var
+				and lhs.GetString() != "self" and lhs.GetString() != "super"));
+			if (canUpdate) {
+				output->Add(TACLine(lhs, TACLine::Op::UpdateAByB, Value((int)op), opB));
+				Value opA = FullyEvaluate(lhs, LocalOnlyMode::Strict);
+				output->Add(TACLine(lhs, op, opA, opB));
+				output->localOnlyIdentifier = "";
+				return;
+			}
+			Value opA = FullyEvaluate(lhs, LocalOnlyMode::Strict);
 			int tempNum = output->nextTempNum++;
 			output->Add(TACLine(Value::Temp(tempNum), op, opA, opB));
 			rhs = Value::Temp(tempNum);
@@ -564,6 +648,7 @@ namespace MiniScript {
 		pendingState = ParseState();
 		pendingState.code = List<TACLine>(16);	// Important to ensure we have storage, which will get shared with that in outputStack.
 		pendingState.nextTempNum = 1;			// (since 0 is used to hold return value)
+		pendingState.function = func;
 		pending = true;
 		//			Console.WriteLine("STARTED FUNCTION");
 		
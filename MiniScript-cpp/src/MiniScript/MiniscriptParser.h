@@ -48,6 +48,7 @@ namespace MiniScript {
 		int nextTempNum;
 		String localOnlyIdentifier;		// identifier to be looked up in local scope *only*
 		bool localOnlyStrict;			// whether localOnlyIdentifier applies strictly, or merely warns
+		FunctionStorage *function;		// function whose body this is (nullptr at global scope)
 		
 		bool empty() { return code.Count() == 0; }
 		
@@ -60,6 +61,7 @@ namespace MiniScript {
 			nextTempNum = 0;
 			localOnlyIdentifier = "";
 			localOnlyStrict = false;
+			function = nullptr;
 		}
 		
 		void Add(TACLine line) { code.Add(line); }
@@ -19,6 +19,10 @@
 
 namespace MiniScript {
 
+	// Identifiers bound on method calls (kept around, so we needn't make a new string for each call).
+	static const String selfIdentifier("self");
+	static const String superIdentifier("super");
+
 	static inline double AbsClamp01(double d) {
 		if (std::signbit(d)) d = -d;
 		if (d > 1) return 1;
@@ -124,6 +128,20 @@ namespace MiniScript {
 			case Op::LengthOfA:
 				text = lhs.ToString() + " := len(" + rhsA.ToString() + ")";
 				break;
+			case Op::UpdateAByB:
+			{
+				const char *opStr = "?";
+				switch ((Op)rhsA.IntValue()) {
+					case Op::APlusB:		opStr = "+";	break;
+					case Op::AMinusB:		opStr = "-";	break;
+					case Op::ATimesB:		opStr = "*";	break;
+					case Op::ADividedByB:	opStr = "/";	break;
+					case Op::AModB:			opStr = "%";	break;
+					case Op::APowB:			opStr = "^";	break;
+					default: break;
+				}
+				text = lhs.ToString() + " " + opStr + "= " + rhsB.ToString() + " (in place)";
+			}	break;
 				
 			// Type-Specialized Instructions - Enhanced toString for debugging
 			case Op::ADD_NUM_NUM:
@@ -191,7 +209,8 @@ namespace MiniScript {
 			} else if (rhsA.IsNull()) {
 				return Value::null;
 			} else {
-				return rhsA.Val(context);
+				Value scratch;
+				return ValA(context, scratch);
 			}
 		}
 		if (op == Op::CopyA) {
@@ -243,15 +262,13 @@ namespace MiniScript {
 			// Specialized container access operations
 			case Op::MAP_GET_STR: {
 				// Direct map string key lookup - types guaranteed
-				Value opA = rhsA.Val(context);
-				Value opB = rhsB.Val(context);
-				return opA.GetElem(opB);
+				Value scratchA, scratchB;
+				return ValA(context, scratchA).GetElem(ValB(context, scratchB));
 			}
 			case Op::LIST_GET_NUM: {
 				// Direct list numeric index access - types guaranteed  
-				Value opA = rhsA.Val(context);
-				Value opB = rhsB.Val(context);
-				return opA.GetElem(opB);
+				Value scratchA, scratchB;
+				return ValA(context, scratchA).GetElem(ValB(context, scratchB));
 			}
 			
 			default:
@@ -304,8 +321,11 @@ namespace MiniScript {
 			// Fall through to original error handling if too large
 		}
 		
-		Value opA = rhsA.type == ValueType::Null ? rhsA : rhsA.Val(context);
-		Value opB = rhsB.type == ValueType::Null ? rhsB : rhsB.Val(context);
+		// Borrow the operands (rather than copying them), since we only need to
+		// inspect them; whatever we return is a new value.
+		Value scratchA, scratchB;
+		const Value& opA = rhsA.type == ValueType::Null ? rhsA : ValA(context, scratchA);
+		const Value& opB = rhsB.type == ValueType::Null ? rhsB : ValB(context, scratchB);
 		
 		if (op == Op::AisaB) {
 			if (opA.IsNull()) return Value::Truth(opB.IsNull());
@@ -314,7 +334,8 @@ namespace MiniScript {
 
 		if (op == Op::NewA) {
 			// Create a new map, and set __isa on it to operand A (after
-			// verifying that this is a valid map to subclass).
+			// verifying that this is a valid map to subclass).  The class map
+			// of a native class makes a native object instead.
 			if (opA.type != ValueType::Map) {
 				RuntimeException("argument to 'new' must be a map").raise();
 			} else if (opA.RefEquals(context->vm->stringType)) {
@@ -326,6 +347,8 @@ namespace MiniScript {
 			} else if (opA.RefEquals(context->vm->functionType)) {
 				RuntimeException("invalid use of 'new'; to create a function, use the 'function' keyword").raise();
 			}
+			NativeClass *nativeClass = NativeClass::ForClassMap(opA);
+			if (nativeClass) return nativeClass->NewInstance();
 			ValueDict newMap;
 			newMap.SetValue(Value::magicIsA, opA);
 			return newMap;
@@ -395,6 +418,7 @@ namespace MiniScript {
 					// they execute directly in the current context.  (But usually, the
 					// current context is a wrapper function that was invoked via
 					// Op::CallFunction, so it got a parameter context at that time.)
+					context->awaitingCall = false;
 					IntrinsicResult result = Intrinsic::Execute((int)fA, context, context->partialResult);
 					if (result.Done()) {
 //						context->partialResult = null;
@@ -626,6 +650,20 @@ namespace MiniScript {
 				default:
 					break;
 			}
+		} else if (opA.type == ValueType::Handle) {
+			// Handles (including native objects) are equal only if they are the same object.
+			switch (op) {
+				case Op::AEqualB:
+					return Value::Truth(opB.type == ValueType::Handle and opA.data.ref == opB.data.ref);
+				case Op::ANotEqualB:
+					return Value::Truth(opB.type != ValueType::Handle or opA.data.ref != opB.data.ref);
+				case Op::NotA:
+					return Value::Truth(!opA.BoolValue());
+				case Op::ElemBofA:
+					TypeException("Type Exception: can't index into this type").raise();
+				default:
+					break;
+			}
 		} else {
 			// something else... perhaps null
 			switch (op) {
@@ -667,7 +705,7 @@ namespace MiniScript {
 	}
 	
 	
-	void Context::StoreValue(Value lhs, Value value) {
+	void Context::StoreValue(const Value& lhs, const Value& value) {
 //		std::cout << "Storing into " << lhs.ToString().c_str() << ": " << value.ToString().c_str() << std::endl;
 		if (lhs.type == ValueType::Temp) {
 			SetTemp(lhs.data.tempNum, value);
@@ -675,19 +713,67 @@ namespace MiniScript {
 			SetVar(lhs.GetString(), value);
 		} else if (lhs.type == ValueType::SeqElem) {
 			SeqElemStorage *seqElem = (SeqElemStorage*)(lhs.data.ref);
-			Value seq = seqElem->sequence.Val(this);
+			Value seqScratch, indexScratch;
+			const Value& seq = seqElem->sequence.ValRef(this, seqScratch);
 			if (seq.IsNull()) RuntimeException("can't set indexed element of null").raise();
 			if (not seq.CanSetElem()) RuntimeException("can't set an indexed element in this type").raise();
-			Value index = seqElem->index;
-			if (index.type == ValueType::Var or index.type == ValueType::SeqElem or
-				index.type == ValueType::Temp) index = index.Val(this);
+			const Value& index = seqElem->index.ValRef(this, indexScratch);
 			seq.SetElem(index, value);
 		} else {
 			if (!lhs.IsNull()) RuntimeException("not an lvalue").raise();
 		}
 	}
 
-	void Context::SetVar(String identifier, Value value) {
+	// Apply a math-assignment operator to the current value of its target.
+	static Value ApplyMathOp(TACLine::Op op, const Value& opA, const Value& opB, Context *context) {
+		if (opA.type == ValueType::Number and opB.type == ValueType::Number) {
+			double fA = opA.data.number, fB = opB.data.number;
+			switch (op) {
+				case TACLine::Op::APlusB:		return Value(fA + fB);
+				case TACLine::Op::AMinusB:		return Value(fA - fB);
+				case TACLine::Op::ATimesB:		return Value(fA * fB);
+				case TACLine::Op::ADividedByB:	return Value(fA / fB);
+				case TACLine::Op::AModB:		return Value(fmod(fA, fB));
+				case TACLine::Op::APowB:		return Value(pow(fA, fB));
+				default: break;
+			}
+		}
+		return TACLine(Value::null, op, opA, opB).Evaluate(context);
+	}
+
+	/// <summary>
+	/// Do a math-assignment (like x += 1 or obj.count *= 2) directly on the
+	/// stored value, when that's a plain local variable, a map entry found in
+	/// the map itself, or a list element.  Return false (having changed
+	/// nothing) in any other case, including when the current value is a
+	/// function, so the caller can do it the long way instead.
+	/// </summary>
+	bool Context::UpdateValue(Value lhs, TACLine::Op op, Value operand) {
+		Value *target = nullptr;
+		if (lhs.type == ValueType::Var) {
+			if (!variables.HasOverrides()) target = variables.GetValuePtr(lhs.GetString());
+		} else if (lhs.type == ValueType::SeqElem) {
+			SeqElemStorage *seqElem = (SeqElemStorage*)(lhs.data.ref);
+			Value seq = seqElem->sequence.Val(this);
+			Value index = seqElem->index;
+			if (index.type == ValueType::Var or index.type == ValueType::SeqElem or
+				index.type == ValueType::Temp) index = index.Val(this);
+			if (seq.type == ValueType::Map) {
+				ValueDict dict = seq.GetDict();
+				if (!dict.HasOverrides()) target = dict.GetValuePtr(index);
+			} else if (seq.type == ValueType::List and index.type == ValueType::Number) {
+				ValueList list = seq.GetList();
+				long i = index.IntValue();
+				if (i < 0) i += list.Count();
+				if (i >= 0 and i < list.Count()) target = &list[i];
+			}
+		}
+		if (target == nullptr or target->type == ValueType::Function) return false;
+		*target = ApplyMathOp(op, *target, operand, this);
+		return true;
+	}
+
+	void Context::SetVar(const String& identifier, const Value& value) {
 		if (identifier == "globals" or identifier == "locals" or identifier == "outer") {
 			RuntimeException("can't assign to " + identifier).raise();
 		}
@@ -742,6 +828,107 @@ namespace MiniScript {
 		return Value::null;
 	}
 
+	/// <summary>
+	/// Look up a variable that can't be local (as for GetGlobal), and fill in
+	/// the cache so that we can find it again quickly.  We can do that only for
+	/// functions defined at global scope (i.e., whose outer variables are the
+	/// globals), and only for globals and intrinsics.
+	/// </summary>
+	Value Context::FindGlobal(const Value& var, GlobalRef& ref) {
+		ref.value = nullptr;
+		String identifier = var.GetString();
+		ValueDict& globals = vm->GetGlobalContext()->variables;
+		if ((outerVars.empty() or outerVars.Epoch() == globals.Epoch()) and not variables.ContainsKey(identifier)) {
+			const Value *value = globals.GetValuePtr(identifier);
+			if (value == nullptr) {
+				Intrinsic* intrinsic = Intrinsic::GetByName(identifier);
+				if (intrinsic != nullptr) value = &intrinsic->GetFunc();
+			}
+			if (value != nullptr) {
+				ref.epoch = globals.Epoch();
+				ref.value = value;
+				return *value;
+			}
+		}
+		return GetVar(identifier);
+	}
+
+	bool MemoCache::Get(const Value& key, Value *outResult) {
+		Value slotVal;
+		if (!index.Get(key, &slotVal)) return false;
+		long slot = (long)slotVal.data.number;
+		if (maxSize > 0 and slot != head) {
+			Unlink(slot);
+			LinkAtHead(slot);
+		}
+		*outResult = results[slot];
+		return true;
+	}
+	
+	void MemoCache::Store(const Value& key, const Value& result) {
+		Value slotVal;
+		long slot;
+		if (index.Get(key, &slotVal)) {
+			// (Can happen when a recursive call stored this same key first.)
+			slot = (long)slotVal.data.number;
+			results[slot] = result;
+			return;
+		}
+		if (maxSize > 0 and keys.Count() >= maxSize) {
+			// Full: reuse the least recently used slot.
+			slot = tail;
+			Unlink(slot);
+			index.Remove(keys[slot]);
+			keys[slot] = key;
+			results[slot] = result;
+		} else {
+			slot = keys.Count();
+			keys.Add(key);
+			results.Add(result);
+			prev.push_back(-1);
+			next.push_back(-1);
+		}
+		index.SetValue(key, Value((double)slot));
+		LinkAtHead(slot);
+	}
+	
+	void MemoCache::Unlink(long slot) {
+		if (prev[slot] >= 0) next[prev[slot]] = next[slot]; else head = next[slot];
+		if (next[slot] >= 0) prev[next[slot]] = prev[slot]; else tail = prev[slot];
+	}
+	
+	void MemoCache::LinkAtHead(long slot) {
+		prev[slot] = -1;
+		next[slot] = head;
+		if (head >= 0) prev[head] = slot;
+		head = slot;
+		if (tail < 0) tail = slot;
+	}
+	
+	// Build the cache key for a call to a memoized function, from the pushed
+	// arguments (plus self, and defaults for any missing ones).  Returns false
+	// if the call has too many arguments (which we leave for the normal call
+	// path to report).
+	static bool MemoKey(FunctionStorage *func, const ValueList& args, long argCount, const Value& self, Value *outKey) {
+		long paramCount = func->parameters.Count();
+		bool gotSelf = !self.IsNull();
+		long selfParam = (gotSelf and paramCount > 0 and func->parameters[0].name == "self" ? 1 : 0);
+		if (argCount + selfParam > paramCount) return false;
+		long firstArg = args.Count() - argCount;
+		if (!gotSelf and paramCount == 1) {
+			*outKey = argCount ? args[firstArg] : func->parameters[0].defaultValue;
+			return true;
+		}
+		ValueList key(paramCount + 1);
+		if (gotSelf) key.Add(self);
+		for (long i = selfParam; i < paramCount; i++) {
+			if (i - selfParam < argCount) key.Add(args[firstArg + i - selfParam]);
+			else key.Add(func->parameters[i].defaultValue);
+		}
+		*outKey = key;
+		return true;
+	}
+	
 	/// <summary>
 	/// Get a context for the next call, which includes any parameter arguments
 	/// that have been set.
@@ -797,7 +984,7 @@ namespace MiniScript {
 //
 //	}
 	
-	Machine::Machine(Context *root, TextOutputMethod output) : stack(16), storeImplicit(false), standardOutput(output), startTime(0), yielding(false) {
+	Machine::Machine(Context *root, TextOutputMethod output) : stack(16), storeImplicit(false), standardOutput(output), startTime(0), yielding(false), memoryLimit(0) {
 		// Note: this constructor adopts the given context, and destroys it later.
 		root->vm = this;
 		stack.Add(root);
@@ -826,6 +1013,9 @@ namespace MiniScript {
 		TACLine& line = context->code[context->lineNum++];
 		try {
 			DoOneLine(line, context);
+			if (memoryLimit and MemoryAccount::Current() > memoryLimit) {
+				LimitExceededException("Memory limit exceeded").raise();
+			}
 		} catch (MiniscriptException& mse) {
 			mse.location = line.location;
 			throw;
@@ -851,15 +1041,38 @@ namespace MiniScript {
 		stack.Add(nextContext);
 	}
 
+	/// <summary>
+	/// Call a MiniScript function on behalf of an intrinsic.  The call is pushed
+	/// onto the stack above the intrinsic's context, and runs like any other
+	/// (so time limits, yield, and wait all still apply).  The intrinsic should
+	/// then return a partial result; once the call returns, its result is in
+	/// resultStorage, and the intrinsic is invoked again with that partial result.
+	/// </summary>
+	/// <param name="context">context of the intrinsic making the call (top of the stack)</param>
+	/// <param name="func">function to call</param>
+	/// <param name="args">arguments to pass</param>
+	/// <param name="argCount">number of arguments</param>
+	/// <param name="resultStorage">where to store the result, in the intrinsic's context</param>
+	void Machine::CallFromIntrinsic(Context *context, const Value& func, const Value *args, long argCount, Value resultStorage) {
+		FunctionStorage *fs = (FunctionStorage*)(func.data.ref);
+		for (long i = 0; i < argCount; i++) context->PushParamArgument(args[i]);
+		Context* nextContext = context->NextCallContext(fs, argCount, false, resultStorage);
+		nextContext->outerVars = fs->outerVars;
+		context->awaitingCall = true;
+		stack.Add(nextContext);
+	}
+
 	void Machine::DoOneLine(TACLine& line, Context *context) {
 		if (line.op == TACLine::Op::PushParam) {
-			Value val = line.rhsA.IsNull() ? line.rhsA : line.rhsA.Val(context);
-			context->PushParamArgument(val);
+			Value scratch;
+			context->PushParamArgument(line.rhsA.IsNull() ? line.rhsA : line.ValA(context, scratch));
 		} else if (line.op == TACLine::Op::CallFunctionA) {
 			// Resolve rhsA.  If it's a function, invoke it; otherwise,
 			// just store it directly.
 			ValueDict valueFoundIn;
-			Value funcVal = line.rhsA.Val(context, &valueFoundIn);		// resolves the whole dot chain, if any
+			Value scratch;
+			Value funcVal = line.globalA.enabled ? context->GetGlobal(line.rhsA, line.globalA, scratch)
+				: line.rhsA.Val(context, &valueFoundIn);		// resolves the whole dot chain, if any
 			if (funcVal.type == ValueType::Function) {
 				Value self;
 				// bind "super" to the parent of the map the function was found in
@@ -873,10 +1086,27 @@ namespace MiniScript {
 				}
 				long argCount = line.rhsB.IntValue();
 				FunctionStorage *fs = (FunctionStorage*)(funcVal.data.ref);
+				Value memoKey;
+				bool memoized = fs->memo and MemoKey(fs, context->args, argCount, self, &memoKey);
+				if (memoized) {
+					// Memoized function: on a cache hit, skip the call entirely.
+					MemoCache *memo = (MemoCache*)fs->memo;
+					Value result;
+					if (memo->Get(memoKey, &result)) {
+						for (long i = 0; i < argCount; i++) context->args.Pop();
+						context->StoreValue(line.lhs, result);
+						return;
+					}
+				}
 				Context* nextContext = context->NextCallContext(fs, argCount, not self.IsNull(), line.lhs);
 				nextContext->outerVars = fs->outerVars;
-				if (!valueFoundIn.empty()) nextContext->SetVar("super", super);
-				if (not self.IsNull()) nextContext->SetVar("self", self);
+				if (!valueFoundIn.empty()) nextContext->SetVar(superIdentifier, super);
+				if (not self.IsNull()) nextContext->SetVar(selfIdentifier, self);
+				if (memoized) {
+					fs->memo->retain();
+					nextContext->memo = (MemoCache*)fs->memo;
+					nextContext->memoKey = memoKey;
+				}
 				stack.Add(nextContext);
 			} else {
 				// The user is attempting to call something that's not a function.
@@ -890,6 +1120,12 @@ namespace MiniScript {
 			Value val = line.Evaluate(context);
 			context->StoreValue(line.lhs, val);
 			PopContext();
+		} else if (line.op == TACLine::Op::UpdateAByB) {
+			// If we can update the target in place, skip the general
+			// read-compute-store lines which follow this one.
+			if (context->UpdateValue(line.lhs, (TACLine::Op)line.rhsA.IntValue(), line.rhsB.Val(context))) {
+				context->lineNum += 2;
+			}
 		} else if (line.op == TACLine::Op::AssignImplicit) {
 			Value val = line.Evaluate(context);
 			if (storeImplicit) {
@@ -908,6 +1144,7 @@ namespace MiniScript {
 		Context* context = stack.Pop();
 		Value result = context->GetTemp(0, Value::null);
 		Value storage = context->resultStorage;
+		if (context->memo) context->memo->Store(context->memoKey, result);
 		ContextPool::instance().release(context);
 		context = stack.Last();
 		context->StoreValue(storage, result);
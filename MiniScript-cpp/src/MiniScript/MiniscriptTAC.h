@@ -18,6 +18,17 @@ namespace MiniScript {
 	class Machine;
 	class IntrinsicResult;
 	class Interpreter;
+
+	/// GlobalRef: where a TAC operand last found the global variable (or
+	/// intrinsic) it names.  The pointer is good as long as the globals map
+	/// keeps the same epoch, i.e., nothing has been added to or removed from it.
+	/// The parser enables this only for identifiers that can't be local.
+	struct GlobalRef {
+		GlobalRef() : enabled(false), epoch(0), value(nullptr) {}
+		bool enabled;
+		unsigned long epoch;
+		const Value *value;
+	};
 	
 	class TACLine {
 	public:
@@ -55,6 +66,7 @@ namespace MiniScript {
 			ElemBofA,
 			ElemBofIterA,
 			LengthOfA,
+			UpdateAByB,			// lhs := lhs (op given by rhsA) rhsB, in place; then skip 2 lines
 			
 			// Type-Specialized Instructions for enhanced performance
 			// Added by Type-Specialized Instructions optimization
@@ -87,6 +99,8 @@ namespace MiniScript {
 		Value rhsB;
 		String comment;
 		SourceLoc location;
+		GlobalRef globalA;		// cached global for rhsA (if enabled)
+		GlobalRef globalB;		// cached global for rhsB (if enabled)
 		
 		TACLine() : op(Op::Noop) {}
 		TACLine(Value lhs, Op op, Value rhsA, Value rhsB=Value::null) : lhs(lhs), op(op), rhsA(rhsA), rhsB(rhsB) {}
@@ -94,8 +108,38 @@ namespace MiniScript {
 
 		String ToString();
 		Value Evaluate(Context *context);
+		
+		// Get (or borrow; see Value::ValRef) the value of operand A or B,
+		// going through our global cache if we can.
+		inline const Value& ValA(Context *context, Value& scratch);
+		inline const Value& ValB(Context *context, Value& scratch);
 	};
 		
+	/// MemoCache: the results of past calls to a function made by memoize,
+	/// keyed by argument value (or by a list of arguments, when the function
+	/// takes more than one).  With a maxSize, the least recently used entries
+	/// are dropped to make room for new ones.
+	class MemoCache : public RefCountedStorage {
+	public:
+		MemoCache(long maxSize) : maxSize(maxSize), head(-1), tail(-1) {}
+		
+		bool Get(const Value& key, Value *outResult);
+		void Store(const Value& key, const Value& result);
+		
+		long maxSize;				// 0 means no limit
+		
+	private:
+		void Unlink(long slot);
+		void LinkAtHead(long slot);
+		
+		ValueDict index;			// key -> slot number
+		ValueList keys;				// key and result in each slot
+		ValueList results;
+		SimpleVector<long> prev;	// LRU order: head is the most recently used slot
+		SimpleVector<long> next;
+		long head, tail;
+	};
+	
 	class Context {
 	public:
 		List<TACLine> code;			// TAC lines we're executing
@@ -108,10 +152,23 @@ namespace MiniScript {
 		Machine *vm;				// virtual machine
 		IntrinsicResult partialResult;	// work-in-progress of our current intrinsic
 		long implicitResultCounter;	// how many times we have stored an implicit result
+		MemoCache *memo;			// where to cache our result, for a call to a memoized function
+		Value memoKey;				// key to cache it under
+		bool awaitingCall;			// true while our intrinsic waits on a call it made (see Machine::CallFromIntrinsic)
 		
-		Context() : lineNum(0), parent(nullptr), vm(nullptr), implicitResultCounter(0) {}
+		Context() : lineNum(0), parent(nullptr), vm(nullptr), implicitResultCounter(0), memo(nullptr), awaitingCall(false) {}
+		~Context() { ClearMemo(); }
+		
+		void ClearMemo() {
+			if (memo) memo->release();
+			memo = nullptr;
+			memoKey = Value::null;
+		}
 		
 		bool Done() { return lineNum >= code.Count(); }
+		
+		// Whether our intrinsic is waiting for something (other than a call it made).
+		bool Waiting() { return not partialResult.Done() and not awaitingCall; }
 
 		Context* Root() {
 			Context* c = this;
@@ -137,6 +194,8 @@ namespace MiniScript {
             vm = nullptr;
             partialResult = IntrinsicResult::Null;
             implicitResultCounter = 0;
+            ClearMemo();
+            awaitingCall = false;
             temps.Clear();
         }
         
@@ -148,6 +207,8 @@ namespace MiniScript {
             vm = nullptr;
             partialResult = IntrinsicResult::Null;
             implicitResultCounter = 0;
+            ClearMemo();
+            awaitingCall = false;
             // Keep variables/outerVars/args/temps allocated but empty for reuse
             variables.RemoveAll();
             outerVars.RemoveAll(); 
@@ -155,7 +216,8 @@ namespace MiniScript {
             temps.Clear();
         }
         
-		void StoreValue(Value lhs, Value value);
+		void StoreValue(const Value& lhs, const Value& value);
+		bool UpdateValue(Value lhs, TACLine::Op op, Value operand);
 
 		void SetTemp(int tempNum, Value value) {
 			while (temps.Count() <= tempNum) temps.Add(Value::null);
@@ -163,21 +225,23 @@ namespace MiniScript {
 		}
 		
 		Value GetTemp(int tempNum) { return temps.Count() ? temps[tempNum] : Value::null; }
+		const Value& GetTempRef(int tempNum) const { return tempNum < temps.Count() ? temps[tempNum] : Value::null; }
 
 		Value GetTemp(int tempNum, Value defaultValue) {
 			if (tempNum < temps.Count()) return temps[tempNum];
 			return defaultValue;
 		}
 	
-		void SetVar(String identifier, Value value);
+		void SetVar(const String& identifier, const Value& value);
 		Value GetVar(String identifier, LocalOnlyMode localOnly=LocalOnlyMode::Off);
+		inline const Value& GetGlobal(const Value& var, GlobalRef& ref, Value& scratch);
 		
 		/// <summary>
 		/// Store a parameter argument in preparation for an upcoming call
 		/// (which should be executed in the context returned by NextCallContext).
 		/// </summary>
 		/// <param name="arg">Argument.</param>
-		void PushParamArgument(Value arg) {
+		void PushParamArgument(const Value& arg) {
 			if (args.Count() > 255) RuntimeException("Argument limit exceeded").raise();
 			args.Add(arg);
 		}
@@ -198,6 +262,8 @@ namespace MiniScript {
 		SourceLoc GetSourceLoc();
 		
 	private:
+		Value FindGlobal(const Value& var, GlobalRef& ref);
+
 		List<Value> temps;			// values of temporaries; temps[0] is always return value
 	};
 	
@@ -212,6 +278,7 @@ namespace MiniScript {
 		void Stop();
 		void Reset();
 		void ManuallyPushCall(FunctionStorage* func, Value resultStorage=Value::null);
+		void CallFromIntrinsic(Context *context, const Value& func, const Value *args, long argCount, Value resultStorage);
 
 		Context* GetGlobalContext() { return stack[0]; }
 		Context* GetTopContext() { return stack.Last(); }
@@ -225,12 +292,14 @@ namespace MiniScript {
 		bool storeImplicit;
 		Interpreter *interpreter;		// (weak reference to interpreter that owns this VM)
 		bool yielding;					// set to true by the yield intrinsic
+		long memoryLimit;				// if nonzero, most bytes the current MemoryAccount may hold
 		Value functionType;
 		Value listType;
 		Value mapType;
 		Value numberType;
 		Value stringType;
 		Value versionMap;
+		RandomGenerator random;			// used by rnd, shuffle, etc. (private to this VM)
 
 	private:
 		static double CurrentWallClockTime();
@@ -241,6 +310,25 @@ namespace MiniScript {
 		List<Context*> stack;
 		double startTime;		// value of CurrentWallClockTime() when machine began its run
 	};
+	
+	/// <summary>
+	/// Get the value of a variable that the parser has determined can't be
+	/// local, using (and updating) the given cache of where we found it.
+	/// </summary>
+	inline const Value& Context::GetGlobal(const Value& var, GlobalRef& ref, Value& scratch) {
+		unsigned long epoch = vm->GetGlobalContext()->variables.Epoch();
+		if (ref.epoch == epoch and ref.value and (outerVars.empty() or outerVars.Epoch() == epoch)) return *ref.value;
+		scratch = FindGlobal(var, ref);
+		return scratch;
+	}
+
+	inline const Value& TACLine::ValA(Context *context, Value& scratch) {
+		return globalA.enabled ? context->GetGlobal(rhsA, globalA, scratch) : rhsA.ValRef(context, scratch);
+	}
+
+	inline const Value& TACLine::ValB(Context *context, Value& scratch) {
+		return globalB.enabled ? context->GetGlobal(rhsB, globalB, scratch) : rhsB.ValRef(context, scratch);
+	}
 }
 
 
@@ -27,17 +27,21 @@ namespace MiniScript {
 
 	Value Value::zero(0.0);
 	Value Value::one(1.0);
-	Value Value::emptyString("");
-	Value Value::magicIsA("__isa");
+	Value Value::emptyString = Value("").MakeImmortal();
+	Value Value::magicIsA = Value("__isa").MakeImmortal();
 	Value Value::null;
-	Value Value::keyString("key");
-	Value Value::valueString("value");
-	Value Value::implicitResult = Value::Var("_");
+	Value Value::keyString = Value("key").MakeImmortal();
+	Value Value::valueString = Value("value").MakeImmortal();
+	Value Value::implicitResult = Value::Var("_").MakeImmortal();
 
 	static int rotateBits(int n) {
 		return (n >> 1) | (n << (sizeof(int) * 8 - 1));
 	}
 
+	FunctionStorage::~FunctionStorage() {
+		if (memo) memo->release();
+	}
+	
 	FunctionStorage *FunctionStorage::BindAndCopy(ValueDict contextVariables) {
 		FunctionStorage *result = new FunctionStorage();
 		result->parameters = parameters;
@@ -63,103 +67,201 @@ namespace MiniScript {
 		return "Unknown";
 	}
 
-	String Value::ToString(Machine *vm) {
-		if (type == ValueType::Number) {
-			// Convert number to string in the standard Miniscript way.
-			double value = data.number;
-			if (fmod(value, 1.0) == 0.0) {
-				return String::Format(value, "%.0f");
-			} else if (value > 1E10 || value < -1E10 || (value < 1E-6 && value > -1E-6)) {
-				// very large/small numbers in exponential form
-				return String::Format(value, "%.6E");
-			} else {
-				// all others in decimal form, with 1-6 digits past the decimal point
-				String s = String::Format(value, "%.6f");
-				long i = s.LengthB() - 1;
-				while (i > 1 && s[i] == '0' && s[i-1] != '.') i--;
-				if (i+1 < s.LengthB()) s = s.SubstringB(0, i+1);
-				return s;
+	// Append a number formatted in the standard MiniScript way.
+	static void AppendNumber(StringBuilder& out, double value) {
+		char buf[512];		// (big enough for %.0f of any double)
+		int len;
+		if (fmod(value, 1.0) == 0.0) {
+			if (value < 1E15 and value > -1E15 and (value != 0 or !signbit(value))) {
+				// Common case: a smallish whole number; write the digits directly.
+				long long n = (long long)value;
+				unsigned long long u = n < 0 ? -(unsigned long long)n : n;
+				char *p = buf + sizeof(buf);
+				do { *--p = '0' + (u % 10); u /= 10; } while (u);
+				if (n < 0) *--p = '-';
+				out.Append(p, buf + sizeof(buf) - p);
+				return;
 			}
+			len = snprintf(buf, sizeof(buf), "%.0f", value);
+		} else if (value > 1E10 || value < -1E10 || (value < 1E-6 && value > -1E-6)) {
+			// very large/small numbers in exponential form
+			len = snprintf(buf, sizeof(buf), "%.6E", value);
+		} else {
+			// all others in decimal form, with 1-6 digits past the decimal point
+			len = snprintf(buf, sizeof(buf), "%.6f", value);
+			int i = len - 1;
+			while (i > 1 && buf[i] == '0' && buf[i-1] != '.') i--;
+			len = i + 1;
 		}
+		out.Append(buf, len);
+	}
+
+	String Value::ToString(Machine *vm) const {
 		if (type == ValueType::String) { retain(); return String((StringStorage*)data.ref, false); }
-		if (type == ValueType::List) return CodeForm(vm, 3);
-		if (type == ValueType::Map) return CodeForm(vm, 3);
+		if (type == ValueType::Number and data.number >= 0 and data.number < String::smallIntStrings
+				and data.number == (long)data.number and !signbit(data.number)) {
+			return String::SmallInt((long)data.number);
+		}
 		if (type == ValueType::Var) {
 			retain();
 			String ident((StringStorage*)data.ref, false);
 			if (noInvoke) return String("@") + ident;
 			return ident;
 		}
-		if (type == ValueType::Temp) return String("_") + String::Format((int)data.tempNum);
-		if (type == ValueType::Function) {
-			String s("FUNCTION(");
-			FunctionStorage *fs = (FunctionStorage*)data.ref;
-			for (long i=0; i < fs->parameters.Count(); i++) {
-				if (i > 0) s += ", ";
-				s += fs->parameters[i].name;
-				if (not fs->parameters[i].defaultValue.IsNull()) s += String("=") + fs->parameters[i].defaultValue.CodeForm(vm);
-			}
-			return s + ")";
-		}
-		if (type == ValueType::SeqElem) {
-			SeqElemStorage *se = (SeqElemStorage*)data.ref;
-			String s = se->sequence.ToString(vm) + "[" + se->index.ToString(vm) + "]";
-			if (noInvoke) s = String("@") + s;
-			return s;
-		}
-		if (type == ValueType::Handle) {
-			return "Handle";
-		}
-		return String();
+		StringBuilder out;
+		AppendString(out, vm);
+		return out.ToString();
 	}
 
-	String Value::CodeForm(Machine *vm, int recursionLimit) {
+	void Value::AppendString(StringBuilder& out, Machine *vm) const {
 		switch (type) {
+			case ValueType::Number:
+				AppendNumber(out, data.number);
+				break;
+			case ValueType::String:
+			case ValueType::Var:
+			{
+				if (type == ValueType::Var and noInvoke) out += '@';
+				StringStorage *ss = (StringStorage*)data.ref;
+				if (ss and ss->dataSize > 1) out.Append(ss->data, ss->dataSize - 1);
+			} break;
+			case ValueType::List:
+			case ValueType::Map:
+				AppendCodeForm(out, vm, 3);
+				break;
+			case ValueType::Temp:
+				out += '_';
+				AppendNumber(out, data.tempNum);
+				break;
+			case ValueType::Function:
+			{
+				out += "FUNCTION(";
+				FunctionStorage *fs = (FunctionStorage*)data.ref;
+				for (long i=0; i < fs->parameters.Count(); i++) {
+					if (i > 0) out += ", ";
+					out += fs->parameters[i].name;
+					if (not fs->parameters[i].defaultValue.IsNull()) {
+						out += '=';
+						fs->parameters[i].defaultValue.AppendCodeForm(out, vm);
+					}
+				}
+				out += ')';
+			} break;
+			case ValueType::SeqElem:
+			{
+				SeqElemStorage *se = (SeqElemStorage*)data.ref;
+				if (noInvoke) out += '@';
+				se->sequence.AppendString(out, vm);
+				out += '[';
+				se->index.AppendString(out, vm);
+				out += ']';
+			} break;
+			case ValueType::Handle:
+			{
+				NativeObject *obj = dynamic_cast<NativeObject*>(data.ref);
+				out += obj ? obj->nativeClass->name : String("Handle");
+			} break;
+			default:
+				break;
+		}
+	}
 
+	String Value::CodeForm(Machine *vm, int recursionLimit) const {
+		switch (type) {
 			case ValueType::Null:
 				return "null";
-				
 			case ValueType::Number:
+			case ValueType::List:
+			case ValueType::Map:
+			case ValueType::String:
+				break;
+			default:
 				return ToString(vm);
+		}
+		StringBuilder out;
+		AppendCodeForm(out, vm, recursionLimit);
+		return out.ToString();
+	}
 
+	void Value::AppendCodeForm(StringBuilder& out, Machine *vm, int recursionLimit) const {
+		switch (type) {
+
+			case ValueType::Null:
+				out += "null";
+				break;
+				
 			case ValueType::String:
 			{
-				String temp((StringStorage*)data.ref);
-				String result = "\"" + temp.Replace("\"", "\"\"") + "\"";
-				return result;
+				// Quote the string, doubling any quotation marks within it.
+				StringStorage *ss = (StringStorage*)data.ref;
+				const char *c = ss ? ss->data : "";
+				const char *end = c + (ss and ss->dataSize ? ss->dataSize - 1 : 0);
+				out += '"';
+				while (c < end) {
+					const char *q = (const char*)memchr(c, '"', end - c);
+					if (!q) { out.Append(c, end - c); break; }
+					out.Append(c, q - c + 1);
+					out += '"';
+					c = q + 1;
+				}
+				out += '"';
 			} break;
 
 			case ValueType::List:
 			{
-				if (recursionLimit <= 0) return "[...]";
-				List<Value> list((ListStorage<Value>*)data.ref);
+				if (recursionLimit <= 0) { out += "[...]"; break; }
+				ValueList list((ValueListStorage*)data.ref);
 				long count = list.Count();
-				if (count == 0) {
-					 return "[]";
+				out += '[';
+				for (long i=0; i<count; i++) {
+					if (i > 0) out += ", ";
+					list[i].AppendCodeForm(out, vm, recursionLimit-1);
 				}
-				List<String> strs(count);
-				for (long i=0; i<count; i++) strs.Add(list[i].CodeForm(vm, recursionLimit-1));
-				String result = String("[") + Join(", ", strs) + "]";
-				return result;
+				out += ']';
 			} break;
 
 			case ValueType::Map:
 			{
-				if (recursionLimit == 0) return "{...}";
+				if (recursionLimit == 0) { out += "{...}"; break; }
 				if (recursionLimit > 0 && recursionLimit < 3 && vm != nullptr) {
 					String shortName = vm->FindShortName(*this);
-					if (!shortName.empty()) return shortName;
+					if (!shortName.empty()) { out += shortName; break; }
 				}
 				ValueDict map((ValueDictStorage*)data.ref);
-				List<String> strs = List<String>(map.Count());
+				out += '{';
+				bool first = true;
 				for (ValueDictIterator kv = map.GetIterator(); not kv.Done(); kv.Next()) {
-					strs.Add(kv.Key().CodeForm(vm, recursionLimit-1) + ": " + kv.Value().CodeForm(vm, recursionLimit-1));
+					if (!first) out += ", ";
+					first = false;
+					kv.Key().AppendCodeForm(out, vm, recursionLimit-1);
+					out += ": ";
+					kv.Value().AppendCodeForm(out, vm, recursionLimit-1);
 				}
-				return String("{") + Join(", ", strs) + String("}");
-			}
+				out += '}';
+			} break;
 				
 			default:
-				return ToString(vm);
+				AppendString(out, vm);
+		}
+	}
+	
+	const Value& Value::ValRef(Context *context, Value& scratch) const {
+		switch (type) {
+			case ValueType::Temp:
+				return context->GetTempRef(data.tempNum);
+			case ValueType::Var:
+			{
+				String ident((StringStorage*)(data.ref));
+				const Value *local = context->variables.GetValuePtr(ident);
+				if (local and ident != "locals" and ident != "globals" and ident != "outer") return *local;
+				scratch = context->GetVar(ident, localOnly);
+				return scratch;
+			}
+			case ValueType::SeqElem:
+				scratch = Val(context);
+				return scratch;
+			default:
+				return *this;
 		}
 	}
 	
@@ -393,7 +495,7 @@ namespace MiniScript {
 	/// </summary>
 	/// <param name="index">index/key for the value to set</param>
 	/// <param name="value">value to set</param>
-	void Value::SetElem(Value index, Value value) {
+	void Value::SetElem(const Value& index, const Value& value) const {
 		if (type == ValueType::List) {
 			long i = index.IntValue();
 			ValueList list = GetList();
@@ -407,10 +509,46 @@ namespace MiniScript {
 			if (!dict.ApplyAssignOverride(index, value)) {
 				dict.SetValue(index, value);
 			}
+		} else if (type == ValueType::Handle) {
+			NativeObject *obj = dynamic_cast<NativeObject*>(data.ref);
+			if (!obj) RuntimeException("can't set an indexed element in this type").raise();
+			obj->nativeClass->SetMember(obj, index.ToString(), value);
 		}
 	}
 
-	Value Value::GetElem(Value index) {
+	Value& Value::MakeImmortal() {
+		switch (type) {
+			case ValueType::String:
+			case ValueType::Var:
+				if (data.ref) data.ref->makeImmortal();
+				break;
+			case ValueType::SeqElem:
+			{
+				SeqElemStorage *se = (SeqElemStorage*)data.ref;
+				se->sequence.MakeImmortal();
+				se->index.MakeImmortal();
+			} break;
+			case ValueType::List:
+			{
+				// (Note that we leave the list itself mortal; only its contents change.)
+				ValueList list = GetList();
+				for (long i=0; i<list.Count(); i++) list[i].MakeImmortal();
+			} break;
+			case ValueType::Map:
+			{
+				ValueDict dict = GetDict();
+				for (ValueDictIterator kv = dict.GetIterator(); !kv.Done(); kv.Next()) {
+					kv.Key().MakeImmortal();
+					kv.Value().MakeImmortal();
+				}
+			} break;
+			default:
+				break;
+		}
+		return *this;
+	}
+
+	Value Value::GetElem(const Value& index) const {
 		if (type == ValueType::List) {
 			if (index.type == ValueType::Number) {
 				ValueList baseLst((ValueListStorage*)(data.ref));
@@ -500,6 +638,12 @@ namespace MiniScript {
 			} else if (sequence.type == ValueType::Function) {
 				sequence = Intrinsics::FunctionType();
 				includeMapType = false;
+			} else if (sequence.type == ValueType::Handle and dynamic_cast<NativeObject*>(sequence.data.ref)) {
+				// Native object: its class has the property or method, or nobody does.
+				NativeObject *obj = (NativeObject*)sequence.data.ref;
+				Value result;
+				if (!obj->nativeClass->GetMember(obj, identifier, &result, outFoundInMap)) KeyException(identifier).raise();
+				return result;
 			} else {
 				TypeException("Type Error (while attempting to look up " + identifier + ")").raise();
 			}
@@ -513,7 +657,7 @@ namespace MiniScript {
 	/// Determine whether this value is the given type (or some subclass)
 	/// in the context of the given virtual machine.
 	/// </summary>
-	bool Value::IsA(Value type, Machine *vm) {
+	bool Value::IsA(const Value& type, Machine *vm) const {
 		if (type.IsNull()) return IsNull();
 		switch (this->type) {
 			case ValueType::Number:
@@ -548,6 +692,12 @@ namespace MiniScript {
 				}
 			}
 
+			case ValueType::Handle:
+			{
+				NativeObject *obj = dynamic_cast<NativeObject*>(data.ref);
+				return obj and type.type == ValueType::Map and type.data.ref == Value(obj->nativeClass->classMap).data.ref;
+			}
+
 			default:
 				return false;
 		}
@@ -703,55 +853,87 @@ namespace MiniScript {
 		return 0;
 	}
 
-	bool Value::RecursiveEqual(Value rhs) const {
-		struct ValuePair {
-			Value a;
-			Value b;
-			ValuePair(const Value& inA, const Value& inB) : a(inA), b(inB) {}
-			ValuePair() {}
-			bool operator==(const ValuePair& rhs) {
-				// Careful: we must use RefEqual here to detect reference loops
-				// below; if we used ==, which does a deep comparison, it could
-				// just send us into an infinite recursion right here.
-				return Value::RefEqual(a, rhs.a) && Value::RefEqual(b, rhs.b);
+	// A pair of list or map storages, used to track which containers we have
+	// already queued while walking nested data (so reference loops terminate).
+	struct StoragePair {
+		RefCountedStorage *a;
+		RefCountedStorage *b;
+		bool isList;		// (not part of the identity; just says how to walk it)
+		StoragePair() : a(nullptr), b(nullptr), isList(false) {}
+		StoragePair(RefCountedStorage *a, RefCountedStorage *b, bool isList=false) : a(a), b(b), isList(isList) {}
+		bool operator==(const StoragePair& rhs) const { return a == rhs.a and b == rhs.b; }
+	};
+
+	static unsigned int HashStoragePair(const StoragePair& p) {
+		uintptr_t x = (uintptr_t)p.a * 31 + (uintptr_t)p.b;
+		return hashUInt((unsigned int)(x ^ (x >> 32)));
+	}
+
+	typedef Dictionary<StoragePair, bool, HashStoragePair> StoragePairSet;
+
+	/// Compare two elements met while walking a list or map.  Numbers and strings
+	/// are compared on the spot; two distinct containers of the same type are
+	/// queued (once) for a later visit.  Returns false only on a definite mismatch.
+	static inline bool ElementsMatch(const Value& a, const Value& b,
+									 SimpleVector<StoragePair>& toDo, StoragePairSet& queued) {
+		if (a.type != b.type) return false;
+		switch (a.type) {
+			case ValueType::Null:
+				return true;
+			case ValueType::Number:
+				return a.data.number == b.data.number;
+			case ValueType::List:
+			case ValueType::Map:
+			{
+				if (a.data.ref == b.data.ref) return true;
+				StoragePair pair(a.data.ref, b.data.ref, a.type == ValueType::List);
+				if (queued.ContainsKey(pair)) return true;
+				queued.SetValue(pair, true);
+				toDo.push_back(pair);
+				return true;
 			}
-		};
-		SimpleVector<ValuePair> toDo;
-		SimpleVector<ValuePair> visited;
-		toDo.push_back(ValuePair(*this, rhs));
+			default:
+				return a == b;
+		}
+	}
+
+	/// Deep comparison of this list or map with another of the same type.
+	/// Works from an explicit stack rather than recursion, skips any pair of
+	/// containers that are identical or already queued, and fails fast on a
+	/// count mismatch before looking at any elements.
+	bool Value::RecursiveEqual(Value rhs) const {
+		if (type != rhs.type) return false;
+		if (data.ref == rhs.data.ref) return true;
+		SimpleVector<StoragePair> toDo;
+		StoragePairSet queued;
+		toDo.push_back(StoragePair(data.ref, rhs.data.ref, type == ValueType::List));
 		while (!toDo.empty()) {
-			ValuePair pair = toDo.pop_back();
-			visited.push_back(pair);
-			if (pair.a.type == ValueType::List) {
-				if (pair.b.type != ValueType::List) return false;
-				ValueList listA((ListStorage<Value>*)pair.a.data.ref);
-				long aCount = listA.Count();
-				ValueList listB((ListStorage<Value>*)pair.b.data.ref);
-				if (listB.Count() != aCount) return false;
-				if (Value::RefEqual(pair.a, pair.b)) continue;
-				for (int i=0; i < aCount; i++) {
-					ValuePair newPair(listA[i], listB[i]);
-					if (!visited.Contains(newPair)) toDo.push_back(newPair);
+			StoragePair pair = toDo.pop_back();
+			if (pair.isList) {
+				ValueList listA((ValueListStorage*)pair.a);
+				ValueList listB((ValueListStorage*)pair.b);
+				long count = listA.Count();
+				if (listB.Count() != count) return false;
+				long i = 0;
+				// Tight loop for the common run of plain numbers.
+				for (; i < count; i++) {
+					const Value& x = listA[i];
+					const Value& y = listB[i];
+					if (x.type != ValueType::Number or y.type != ValueType::Number) break;
+					if (x.data.number != y.data.number) return false;
 				}
-			} else if (pair.a.type == ValueType::Map) {
-				if (pair.b.type != ValueType::Map) return false;
-				ValueDict dictA((DictionaryStorage<Value, Value>*)pair.a.data.ref);
-				long countA = dictA.Count();
-				ValueDict dictB((DictionaryStorage<Value, Value>*)pair.b.data.ref);
-				if (dictB.Count() != countA) return false;
-				if (Value::RefEqual(pair.a, pair.b)) continue;
-				ValueList keys = dictA.Keys();
-				for (int i=0; i<countA; i++) {
-					Value key = keys[i];
-					Value valFromB;
-					if (!dictB.Get(key, &valFromB)) return false;
-					Value valFromA = dictA[key];
-					ValuePair newPair(valFromA, valFromB);
-					if (!visited.Contains(newPair)) toDo.push_back(newPair);
+				for (; i < count; i++) {
+					if (!ElementsMatch(listA[i], listB[i], toDo, queued)) return false;
 				}
 			} else {
-				// No other types can recurse, so can safely do:
-				if (Equality(pair.a, pair.b) == 0) return false;
+				ValueDict dictA((ValueDictStorage*)pair.a);
+				ValueDict dictB((ValueDictStorage*)pair.b);
+				if (dictB.Count() != dictA.Count()) return false;
+				Value valFromB;
+				for (ValueDictIterator kv = dictA.GetIterator(); !kv.Done(); kv.Next()) {
+					if (!dictB.Get(kv.Key(), &valFromB)) return false;
+					if (!ElementsMatch(kv.Value(), valFromB, toDo, queued)) return false;
+				}
 			}
 		}
 		// If we clear out our toDo list without finding anything unequal,
@@ -760,41 +942,46 @@ namespace MiniScript {
 	}
 
 	unsigned int Value::RecursiveHash() const {
+		// Hash of a value without descending into it (lists and maps hash by size).
+		auto shallowHash = [](const Value& v) -> unsigned int {
+			if (v.type == ValueType::List) return IntHash((int)ValueList((ValueListStorage*)v.data.ref).Count());
+			if (v.type == ValueType::Map) return ~IntHash((int)ValueDict((ValueDictStorage*)v.data.ref).Count());
+			return v.Hash();
+		};
 		unsigned int result = 0;
 		SimpleVector<Value> toDo;
-		SimpleVector<void*> visited;
+		StoragePairSet visited;
 		toDo.push_back(*this);
-		visited.push_back(data.ref);
+		visited.SetValue(StoragePair(data.ref, nullptr), true);
 		while (!toDo.empty()) {
 			Value item = toDo.pop_back();
 			if (item.type == ValueType::List) {
 				ValueList list((ListStorage<Value>*)item.data.ref);
 				long count = list.Count();
 				result = rotateBits(result) ^ IntHash((int)count);
-				for (int i=0; i<count; i++) {
-					Value child = list[i];
-					if (!(child.type == ValueType::List || child.type == ValueType::Map) || !visited.Contains(child.data.ref)) {
+				for (long i=0; i<count; i++) {
+					const Value& child = list[i];
+					if (child.type == ValueType::List || child.type == ValueType::Map) {
+						StoragePair key(child.data.ref, nullptr);
+						if (visited.ContainsKey(key)) continue;
+						visited.SetValue(key, true);
 						toDo.push_back(child);
-						visited.push_back(child.data.ref);
+					} else {
+						result = rotateBits(result) ^ child.Hash();
 					}
 				}
 			} else if (item.type == ValueType::Map) {
 				ValueDict dict((DictionaryStorage<Value, Value>*)item.data.ref);
 				long count = dict.Count();
 				result = rotateBits(result) ^ IntHash((int)count);
-				ValueList keys = dict.Keys();
-				for (int i=0; i<count; i++) {
-					Value key = keys[i];
-					if (!(key.type == ValueType::List || key.type == ValueType::Map) || !visited.Contains(key.data.ref)) {
-						toDo.push_back(key);
-						visited.push_back(key.data.ref);
-					}
-					Value value = dict[key];
-					if (!(value.type == ValueType::List || value.type == ValueType::Map) || !visited.Contains(value.data.ref)) {
-						toDo.push_back(value);
-						visited.push_back(value.data.ref);
-					}
+				// Map entries may come out in any order, so combine each key/value
+				// pair commutatively (equal maps must hash equally).  Containers
+				// nested in a map contribute only their size, for the same reason.
+				unsigned int entries = 0;
+				for (ValueDictIterator kv = dict.GetIterator(); !kv.Done(); kv.Next()) {
+					entries += rotateBits(shallowHash(kv.Key())) ^ shallowHash(kv.Value());
 				}
+				result = rotateBits(result) ^ entries;
 			} else {
 				// Anything else, we can safely use the standard hash method
 				result = rotateBits(result) ^ item.Hash();
@@ -804,12 +991,13 @@ namespace MiniScript {
 	}
 
 	bool Value::Equal(StringStorage *lhs, StringStorage *rhs) {
-		String a(lhs);
-		String b(rhs);
-		bool result = (a == b);
-//		a.forget();
-//		b.forget();
-		return result;
+		// Strings of different byte lengths can't be equal; check that before
+		// looking at the bytes.  (dataSize <= 1 means empty, however it's stored.)
+		size_t sizeA = lhs->dataSize > 1 ? lhs->dataSize : 1;
+		size_t sizeB = rhs->dataSize > 1 ? rhs->dataSize : 1;
+		if (sizeA != sizeB) return false;
+		if (sizeA == 1) return true;
+		return memcmp(lhs->data, rhs->data, sizeA - 1) == 0;
 	}
 
 	bool Value::Equal(ListStorage<Value> *lhs, ListStorage<Value> *rhs) {
@@ -851,6 +1039,50 @@ namespace MiniScript {
 		return lhs->sequence == rhs->sequence and lhs->index == rhs->index;
 	}
 
+//--------------------------------------------------------------------------------
+// NativeClass
+
+	NativeClass::NativeClass(String name, Factory factory) : name(name), factory(factory) {
+		classMap.SetOwner(this);	// (so that `new` can recognize our class map)
+	}
+
+	void NativeClass::AddProperty(String name, Getter getter, Setter setter) {
+		Property prop;
+		prop.getter = getter;
+		prop.setter = setter;
+		properties.SetValue(name, prop);
+	}
+
+	bool NativeClass::GetMember(NativeObject *obj, const String& name, Value *outValue, ValueDict *outFoundInMap) {
+		Property prop;
+		if (properties.Get(name, &prop)) {
+			*outValue = prop.getter(obj);
+			return true;
+		}
+		if (classMap.Get(name, outValue)) {
+			if (outFoundInMap) *outFoundInMap = classMap;
+			return true;
+		}
+		return false;
+	}
+
+	void NativeClass::SetMember(NativeObject *obj, const String& name, Value value) {
+		Property prop;
+		if (!properties.Get(name, &prop)) RuntimeException(this->name + " has no property " + name).raise();
+		if (!prop.setter) RuntimeException("can't assign to read-only property " + name + " of " + this->name).raise();
+		prop.setter(obj, value);
+	}
+
+	Value NativeClass::NewInstance() {
+		if (!factory) RuntimeException("invalid use of 'new'; " + name + " objects can't be created that way").raise();
+		return Value::NewHandle(factory());
+	}
+
+	NativeClass *NativeClass::ForClassMap(const Value& map) {
+		if (map.type != ValueType::Map or !map.data.ref) return nullptr;
+		return (NativeClass*)map.GetDict().Owner();
+	}
+
 
 //--------------------------------------------------------------------------------
 // Unit Tests
@@ -902,6 +1134,11 @@ void TestValue::TestBasics()
 	Assert(a.type == ValueType::List);
 	String s = a.ToString(nullptr);
 	Assert(s == "[1, \"two\", 3.14157]");
+	
+	a.MakeImmortal();
+	Assert(a.GetList()[1].data.ref->isImmortal());
+	Assert(!a.data.ref->isImmortal());
+	Assert(Value::magicIsA.data.ref->isImmortal());
 }
 
 void TestValue::TestHashAndEquality() {
@@ -58,6 +58,11 @@ namespace MiniScript {
 		// Local variables where the function was defined {#8}
 		ValueDict outerVars;
 		
+		// Cache of past results (a MemoCache), if this function was made by memoize
+		RefCountedStorage *memo = nullptr;
+		
+		virtual ~FunctionStorage();
+		
 		FunctionStorage *BindAndCopy(ValueDict contextVariables);
 	};
 
@@ -137,8 +142,11 @@ namespace MiniScript {
 		inline ~Value() { if (usesRef()) release(); }
 
 		// conversions
-		String ToString(Machine *vm=nullptr);
-		String CodeForm(Machine *vm, int recursionLimit=-1);
+		String ToString(Machine *vm=nullptr) const;
+		String CodeForm(Machine *vm, int recursionLimit=-1) const;
+		// Same as above, but appending to an existing buffer (no intermediate strings).
+		void AppendString(StringBuilder& out, Machine *vm=nullptr) const;
+		void AppendCodeForm(StringBuilder& out, Machine *vm, int recursionLimit=-1) const;
 		int32_t IntValue() const noexcept;
 		uint32_t UIntValue() const noexcept;
 		float FloatValue() const noexcept;
@@ -155,6 +163,7 @@ namespace MiniScript {
 			return String(ss, false); }
 		ValueList GetList() const { Assert(type == ValueType::List); ValueList l((ValueListStorage*)(data.ref), false); return l; }
 		ValueDict GetDict() { Assert(type == ValueType::Map); if (not data.ref) data.ref = new ValueDictStorage(); ValueDict d((ValueDictStorage*)(data.ref)); d.retain(); return d; }
+		ValueDict GetDict() const { Assert(type == ValueType::Map); ValueDict d((ValueDictStorage*)(data.ref)); d.retain(); return d; }
 
 		// evaluation
 		bool IsNull() const {
@@ -163,6 +172,12 @@ namespace MiniScript {
 
 		Value Val(Context *context, ValueDict *outFoundInMap=nullptr) const;
 		
+		/// Like Val, but borrow rather than copy: for a constant, temp, or local
+		/// variable, return a reference to the stored value itself; otherwise,
+		/// look up the value into scratch, and return that.  The result is
+		/// good only until the next change to the context (so copy it to keep it).
+		const Value& ValRef(Context *context, Value& scratch) const;
+		
 		/// Evaluate each of our contained elements, and if any of those is a variable
 		/// or temp, then resolve them now.  CAUTION: do not mutate the original list
 		/// or map!  We may need it in its original form on future iterations.
@@ -174,23 +189,28 @@ namespace MiniScript {
 		/// mutable object, rather than the same object referenced each time.
 		Value EvalCopy(Context *context);
 		
+		/// Make the strings in this value (including any within a list, map,
+		/// or sequence-element reference) immortal, so that they are never
+		/// reference-counted or freed.  Used for constants, e.g. in compiled code.
+		Value& MakeImmortal();
+		
 		/// <summary>
-		/// Can we set elements within this value?  (I.e., is it a list or map?)
+		/// Can we set elements within this value?  (I.e., is it a list, map, or native object?)
 		/// </summary>
 		/// <returns>true if SetElem can work; false if it does nothing</returns>
-		bool CanSetElem() { return type == ValueType::List or type == ValueType::Map; }
+		bool CanSetElem() const { return type == ValueType::List or type == ValueType::Map or type == ValueType::Handle; }
 		
 		/// <summary>
 		/// Set an element associated with the given index within this Value.
 		/// </summary>
 		/// <param name="index">index/key for the value to set</param>
 		/// <param name="value">value to set</param>
-		void SetElem(Value index, Value value);
+		void SetElem(const Value& index, const Value& value) const;
 
 		/// <summary
 		/// Get the element associated with the given index within this value.
 		/// </summary>
-		Value GetElem(Value index);
+		Value GetElem(const Value& index) const;
 		
 		// Look up the given identifier in the given sequence, walking the
 		// type chain until we either find it, or fail.
@@ -202,7 +222,7 @@ namespace MiniScript {
 		/// </summary>
 		/// <param name="key">key to search for</param>
 		/// <returns>value associated with that key, or null if not found</returns>
-		Value Lookup(Value key) {
+		Value Lookup(const Value& key) const {
 			Value result = null;
 			Value obj = *this;
 			while (obj.type == ValueType::Map) {
@@ -218,7 +238,7 @@ namespace MiniScript {
 		/// Determine whether this value is the given type (or some subclass)
 		/// in the context of the given virtual machine.
 		/// </summary>
-		bool IsA(Value type, Machine *vm);
+		bool IsA(const Value& type, Machine *vm) const;
 		
 		// handy statics (DO NOT MUTATE THESE!)
 		static Value zero;			// 0
@@ -243,7 +263,7 @@ namespace MiniScript {
 
 		// reference handling (for types where that applies)
 		bool usesRef() const { return type >= ValueType::String; }
-		void retain() { if (data.ref) data.ref->retain(); }
+		void retain() const { if (data.ref) data.ref->retain(); }
 		void release() { if (data.ref) { data.ref->release(); data.ref = nullptr; } }
 
 		// equality helpers
@@ -323,7 +343,7 @@ namespace MiniScript {
 
 	bool Value::RefEquals(const Value& rhs) const {
 		if (!usesRef()) return *this == rhs;
-		return data.ref == rhs.data.ref;
+		return type == rhs.type and data.ref == rhs.data.ref;
 	}
 	
 	/// <summary>
@@ -346,6 +366,9 @@ namespace MiniScript {
 		Value index;
 
 		SeqElemStorage(Value seq, Value idx) : sequence(seq), index(idx) {}
+		
+		static void *operator new(size_t size) { return RecyclingPool<sizeof(SeqElemStorage)>::Allocate(size); }
+		static void operator delete(void *p, size_t size) { RecyclingPool<sizeof(SeqElemStorage)>::Release(p, size); }
 	};
 
 	inline Value::Value(SeqElemStorage *s) : type(ValueType::SeqElem), noInvoke(false) {
@@ -356,6 +379,76 @@ namespace MiniScript {
 		return Value(new SeqElemStorage(seq, idx));
 	}
 
+	class NativeObject;
+
+	/// NativeClass: describes a kind of host object, which scripts see as a
+	/// Handle value.  Its methods live in a class map, which is also what
+	/// `isa` compares against and what `new` may be applied to; its properties
+	/// are read and written through C++ getter and setter functions.  Looking
+	/// up a member of a native object goes straight to its class, with no
+	/// per-object map at all.
+	///
+	/// Native classes are meant to be created once and live for the life of
+	/// the program (e.g. as function-local statics).
+	class NativeClass {
+	public:
+		typedef Value (*Getter)(NativeObject *obj);
+		typedef void (*Setter)(NativeObject *obj, Value value);
+		typedef NativeObject *(*Factory)();
+
+		NativeClass(String name, Factory factory=nullptr);
+
+		// Add a method (or any other shared value) to the class map.
+		void AddMethod(String name, Value func) { classMap.SetValue(name, func); }
+
+		// Add a property; without a setter, it is read-only.
+		void AddProperty(String name, Getter getter, Setter setter=nullptr);
+
+		// Look up a property or class member of the given object.  Returns false if
+		// there is none by that name.  When found in the class map, that map is
+		// stored in outFoundInMap (if given).
+		bool GetMember(NativeObject *obj, const String& name, Value *outValue, ValueDict *outFoundInMap=nullptr);
+
+		// Set a property of the given object, raising an error if there's no
+		// settable property by that name.
+		void SetMember(NativeObject *obj, const String& name, Value value);
+
+		// Make a new instance for the `new` operator, or raise an error if this
+		// class has no factory.
+		Value NewInstance();
+
+		// Find the native class whose class map is the given value, or nullptr.
+		static NativeClass *ForClassMap(const Value& map);
+
+		String name;
+		ValueDict classMap;
+
+	private:
+		struct Property {
+			Getter getter;
+			Setter setter;
+		};
+		Dictionary<String, Property, hashString> properties;
+		Factory factory;
+	};
+
+	/// NativeObject: base class for the storage behind a host object.  Wrap one
+	/// with Value::NewHandle to hand it to scripts.
+	class NativeObject : public RefCountedStorage {
+	public:
+		NativeObject(NativeClass& cls) : nativeClass(&cls) {}
+
+		// Get the native object behind the given value, if it is a handle to an
+		// object of the given class; otherwise return nullptr.
+		static NativeObject *Get(const Value& v, const NativeClass& cls) {
+			if (v.type != ValueType::Handle) return nullptr;
+			NativeObject *obj = dynamic_cast<NativeObject*>(v.data.ref);
+			return (obj and obj->nativeClass == &cls) ? obj : nullptr;
+		}
+
+		NativeClass *nativeClass;
+	};
+
 	/// TextOutputMethod: function pointer that receives text to be output to the user
 	/// (or whatever the host environment wants to do with it).
 	typedef void (*TextOutputMethod)(String text, bool addLineBreak);
@@ -0,0 +1,82 @@
+//
+//  RecyclingPool.h
+//  MiniScript
+//
+//	A per-thread free list of memory blocks of one fixed size.  Classes whose
+//	instances are created and destroyed constantly (string storage, map
+//	entries, intrinsic results, and so on) allocate through this, so that
+//	short-lived values -- most of which die before the call that made them
+//	returns -- recycle the same few blocks instead of going back to the
+//	general-purpose heap each time.  Blocks in use are charged to the
+//	current MemoryAccount; blocks on the free list are not.
+//
+//	Usage, within the class:
+//		static void *operator new(size_t size) { return RecyclingPool<sizeof(Foo)>::Allocate(size); }
+//		static void operator delete(void *p, size_t size) { RecyclingPool<sizeof(Foo)>::Release(p, size); }
+//
+
+#ifndef RECYCLINGPOOL_H
+#define RECYCLINGPOOL_H
+
+#include <new>
+#include <stddef.h>
+#include "MemoryAccount.h"
+
+namespace MiniScript {
+
+	template <size_t SIZE>
+	class RecyclingPool {
+	public:
+		// Most free blocks we'll hang on to (per thread); beyond this, we give them back.
+		static const long maxFree = 4096;
+
+		static void *Allocate(size_t size) {
+			MemoryAccount::Charge((long)size);
+			FreeList& list = Free();
+			if (size != SIZE or list.head == nullptr) return ::operator new(size);
+			Node *node = list.head;
+			list.head = node->next;
+			list.count--;
+			return node;
+		}
+
+		static void Release(void *p, size_t size) {
+			if (p == nullptr) return;
+			MemoryAccount::Charge(-(long)size);
+			FreeList& list = Free();
+			if (size != SIZE or list.count >= maxFree) {
+				::operator delete(p);
+				return;
+			}
+			Node *node = (Node*)p;
+			node->next = list.head;
+			list.head = node;
+			list.count++;
+		}
+
+	private:
+		struct Node { Node *next; };
+
+		struct FreeList {
+			Node *head = nullptr;
+			long count = 0;
+			~FreeList() {
+				while (head) {
+					Node *next = head->next;
+					::operator delete(head);
+					head = next;
+				}
+			}
+		};
+
+		static FreeList& Free() {
+			static thread_local FreeList list;
+			return list;
+		}
+
+		static_assert(SIZE >= sizeof(Node), "RecyclingPool blocks must be big enough to hold a pointer");
+	};
+
+}
+
+#endif /* RECYCLINGPOOL_H */
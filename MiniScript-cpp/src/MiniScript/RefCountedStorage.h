@@ -10,6 +10,9 @@
 #define REFCOUNTEDSTORAGE_H
 
 #include <stdio.h>
+#include <stddef.h>
+#include <new>
+#include "MemoryAccount.h"
 
 namespace MiniScript {
 
@@ -19,8 +22,16 @@ extern long _stringInstanceCount();
 
 	class RefCountedStorage {
 	public:
-		void retain() { refCount++; }
-		void release() { if (--refCount == 0) delete this; }
+		void retain() { if (refCount >= 0) refCount++; }
+		void release() { if (refCount >= 0 and --refCount == 0) delete this; }
+		
+		// An immortal storage is shared freely, never counted, and never freed.
+		void makeImmortal() { refCount = -1; }
+		bool isImmortal() const { return refCount < 0; }
+		
+		// All storage is charged to the current MemoryAccount.
+		static void *operator new(size_t size) { MemoryAccount::Charge((long)size); return ::operator new(size); }
+		static void operator delete(void *p, size_t size) { MemoryAccount::Charge(-(long)size); ::operator delete(p); }
 		
 	protected:
 		RefCountedStorage() : refCount(1) {
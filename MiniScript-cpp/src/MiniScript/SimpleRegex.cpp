@@ -0,0 +1,796 @@
+//
+//  SimpleRegex.cpp
+//  MiniScript
+//
+//	See SimpleRegex.h for an overview.  The compiler here is a recursive-descent
+//	parser that builds a small syntax tree, then emits Pike VM instructions
+//	from it (repeating a subtree as needed for counted repetition).  The VM
+//	runs all threads in lock step over the text, so each position is looked
+//	at once, and each instruction at most once per position.
+//
+
+#include "SimpleRegex.h"
+#include "UnicodeUtil.h"
+#include "UnitTest.h"
+
+namespace MiniScript {
+
+	static const long kMaxProgramSize = 50000;	// instructions
+	static const long kMaxRepeat = 1000;		// largest n or m in {n,m}
+	static const int kMaxNesting = 500;			// deepest group nesting
+	static const int kMaxEmitDepth = 2000;		// deepest tree (other than Cat/Alt chains) to emit
+
+	enum AssertKind { assertBOL, assertEOL, assertWordB, assertNotWordB };
+
+	enum NotSet { notDigit = 1, notWord = 2, notSpace = 4 };
+
+	// Decode one UTF-8 character at text[pos], without reading past len;
+	// returns the code point and advances pos.  Invalid bytes decode as themselves.
+	static inline unsigned long DecodeAt(const char *text, long len, long& pos) {
+		unsigned char b = (unsigned char)text[pos++];
+		if (b < 0x80) return b;
+		int extra;
+		unsigned long c;
+		if ((b & 0xE0) == 0xC0) { extra = 1; c = b & 0x1F; }
+		else if ((b & 0xF0) == 0xE0) { extra = 2; c = b & 0x0F; }
+		else if ((b & 0xF8) == 0xF0) { extra = 3; c = b & 0x07; }
+		else return b;
+		for (int i=0; i<extra and pos < len; i++) {
+			unsigned char cb = (unsigned char)text[pos];
+			if ((cb & 0xC0) != 0x80) break;
+			c = (c << 6) | (cb & 0x3F);
+			pos++;
+		}
+		return c;
+	}
+
+	static inline bool IsWordChar(unsigned long c) {
+		return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9') or c == '_';
+	}
+
+	static inline bool IsDigitChar(unsigned long c) {
+		return c >= '0' and c <= '9';
+	}
+
+	static inline bool IsSpaceChar(unsigned long c) {
+		return c == ' ' or (c >= '\t' and c <= '\r');
+	}
+
+	#pragma mark - Compiler
+
+	// Syntax tree node.  Cat and Alt are binary (a, b); Repeat and Group have one child (a).
+	struct RegexNode {
+		enum Type { Empty, Char, Any, Class, Cat, Alt, Repeat, Group, Assert } type;
+		long a, b;
+		long min, max;		// Repeat (max < 0 means no limit)
+		bool greedy;		// Repeat
+		unsigned long c;	// Char; class index (Class); capture index or -1 (Group); kind (Assert)
+	};
+
+	class RegexCompiler {
+	public:
+		RegexCompiler(const String& pattern, Regex *re)
+			: src(pattern.c_str()), len(pattern.LengthB()), pos(0), depth(0), emitDepth(0), re(re) {}
+
+		bool Compile(String *outError);
+
+	private:
+		const char *src;
+		long len;
+		long pos;
+		int depth;
+		int emitDepth;
+		Regex *re;
+		String error;
+		SimpleVector<RegexNode> nodes;
+
+		bool AtEnd() const { return pos >= len; }
+		char Peek() const { return pos < len ? src[pos] : 0; }
+		bool Fail(const char *msg) { if (error.empty()) error = msg; return false; }
+
+		long NewNode(RegexNode::Type type, long a=-1, long b=-1) {
+			RegexNode n;
+			n.type = type; n.a = a; n.b = b; n.min = n.max = 0; n.greedy = true; n.c = 0;
+			nodes.push_back(n);
+			return nodes.size() - 1;
+		}
+
+		long ParseAlt();
+		long ParseCat();
+		long ParseRepeat();
+		long ParseAtom();
+		long ParseClass();
+		bool ParseCount(long& outValue);
+		bool ParseEscapeChar(unsigned long& outChar);
+		long NewClass(bool negated) {
+			Regex::CharClass cls;
+			cls.first = re->classRanges.size();
+			cls.count = 0;
+			cls.negated = negated;
+			cls.notSets = 0;
+			re->classes.push_back(cls);
+			return re->classes.size() - 1;
+		}
+		void AddRange(long classIdx, unsigned long lo, unsigned long hi) {
+			Regex::ClassRange r = { lo, hi };
+			re->classRanges.push_back(r);
+			re->classes[classIdx].count++;
+		}
+		void AddSet(long classIdx, char kind);
+
+		bool Emit(long node);
+		bool EmitNode(long node);
+		long EmitInst(Regex::Op op, long x=0, long y=0, unsigned long c=0) {
+			Regex::Inst inst;
+			inst.op = op; inst.x = x; inst.y = y; inst.c = c;
+			re->prog.push_back(inst);
+			return re->prog.size() - 1;
+		}
+	};
+
+	bool RegexCompiler::Compile(String *outError) {
+		// Leading inline flags, e.g. (?i) or (?ms)
+		while (pos + 2 < len and src[pos] == '(' and src[pos+1] == '?' and strchr("ims", src[pos+2])) {
+			long p = pos + 2;
+			bool ok = true;
+			while (p < len and src[p] != ')') {
+				if (src[p] == 'i') re->ignoreCase = true;
+				else if (src[p] == 'm') re->multiline = true;
+				else if (src[p] == 's') re->dotAll = true;
+				else { ok = false; break; }
+				p++;
+			}
+			if (!ok or p >= len) break;
+			pos = p + 1;
+		}
+		re->groupNames.Add(String());	// (group 0 is the whole match)
+		long root = ParseAlt();
+		if (root >= 0 and !AtEnd()) {
+			if (Peek() == ')') Fail("unmatched ')'");
+			else Fail("unexpected character");
+		}
+		if (root >= 0 and error.empty()) {
+			EmitInst(Regex::opSave, 0);
+			if (Emit(root)) {
+				EmitInst(Regex::opSave, 1);
+				EmitInst(Regex::opMatch);
+			}
+		}
+		if (!error.empty()) {
+			if (outError) *outError = error + " at position " + String::Format(pos);
+			return false;
+		}
+		return true;
+	}
+
+	long RegexCompiler::ParseAlt() {
+		long left = ParseCat();
+		if (left < 0) return -1;
+		while (Peek() == '|' and !AtEnd()) {
+			pos++;
+			long right = ParseCat();
+			if (right < 0) return -1;
+			left = NewNode(RegexNode::Alt, left, right);
+		}
+		return left;
+	}
+
+	long RegexCompiler::ParseCat() {
+		long result = -1;
+		while (!AtEnd() and Peek() != '|' and Peek() != ')') {
+			long item = ParseRepeat();
+			if (item < 0) return -1;
+			result = (result < 0) ? item : NewNode(RegexNode::Cat, result, item);
+		}
+		if (result < 0) result = NewNode(RegexNode::Empty);
+		return result;
+	}
+
+	bool RegexCompiler::ParseCount(long& outValue) {
+		if (pos >= len or src[pos] < '0' or src[pos] > '9') return false;
+		outValue = 0;
+		while (pos < len and src[pos] >= '0' and src[pos] <= '9') {
+			outValue = outValue * 10 + (src[pos++] - '0');
+			if (outValue > kMaxRepeat) { Fail("repeat count too large"); return false; }
+		}
+		return true;
+	}
+
+	long RegexCompiler::ParseRepeat() {
+		long atom = ParseAtom();
+		if (atom < 0) return -1;
+		while (!AtEnd()) {
+			long min, max;
+			char ch = Peek();
+			if (ch == '*') { min = 0; max = -1; pos++; }
+			else if (ch == '+') { min = 1; max = -1; pos++; }
+			else if (ch == '?') { min = 0; max = 1; pos++; }
+			else if (ch == '{') {
+				// {n}, {n,}, or {n,m}; anything else is just a literal brace
+				long save = pos;
+				pos++;
+				if (!ParseCount(min)) {
+					if (!error.empty()) return -1;
+					pos = save;
+					break;
+				}
+				max = min;
+				if (Peek() == ',') {
+					pos++;
+					if (Peek() == '}') max = -1;
+					else if (!ParseCount(max)) {
+						if (!error.empty()) return -1;
+						pos = save;
+						break;
+					}
+				}
+				if (Peek() != '}') { pos = save; break; }
+				pos++;
+				if (max >= 0 and max < min) { Fail("bad repeat range"); return -1; }
+			} else break;
+			RegexNode::Type t = nodes[atom].type;
+			if (t == RegexNode::Assert or t == RegexNode::Empty) { Fail("nothing to repeat"); return -1; }
+			long rep = NewNode(RegexNode::Repeat, atom);
+			nodes[rep].min = min;
+			nodes[rep].max = max;
+			if (Peek() == '?' and !AtEnd()) { nodes[rep].greedy = false; pos++; }
+			atom = rep;
+		}
+		return atom;
+	}
+
+	bool RegexCompiler::ParseEscapeChar(unsigned long& outChar) {
+		// (pos is just past the backslash)
+		if (AtEnd()) return Fail("trailing backslash");
+		char ch = src[pos];
+		switch (ch) {
+			case 'n': outChar = '\n'; pos++; return true;
+			case 't': outChar = '\t'; pos++; return true;
+			case 'r': outChar = '\r'; pos++; return true;
+			case 'f': outChar = '\f'; pos++; return true;
+			case 'v': outChar = '\v'; pos++; return true;
+			case '0': outChar = 0; pos++; return true;
+		}
+		if ((ch >= 'a' and ch <= 'z') or (ch >= 'A' and ch <= 'Z') or (ch >= '1' and ch <= '9')) {
+			return Fail("unknown escape");
+		}
+		outChar = DecodeAt(src, len, pos);
+		return true;
+	}
+
+	void RegexCompiler::AddSet(long classIdx, char kind) {
+		switch (kind) {
+			case 'd':
+				AddRange(classIdx, '0', '9');
+				break;
+			case 'w':
+				AddRange(classIdx, 'a', 'z');
+				AddRange(classIdx, 'A', 'Z');
+				AddRange(classIdx, '0', '9');
+				AddRange(classIdx, '_', '_');
+				break;
+			case 's':
+				AddRange(classIdx, ' ', ' ');
+				AddRange(classIdx, '\t', '\r');
+				break;
+			case 'D': re->classes[classIdx].notSets |= notDigit; break;
+			case 'W': re->classes[classIdx].notSets |= notWord; break;
+			case 'S': re->classes[classIdx].notSets |= notSpace; break;
+		}
+	}
+
+	long RegexCompiler::ParseClass() {
+		// (pos is just past the '[')
+		bool negated = false;
+		if (Peek() == '^') { negated = true; pos++; }
+		long cls = NewClass(negated);
+		bool first = true;
+		while (true) {
+			if (AtEnd()) { Fail("unmatched '['"); return -1; }
+			if (src[pos] == ']' and !first) { pos++; break; }
+			first = false;
+			unsigned long lo;
+			if (src[pos] == '\\') {
+				pos++;
+				if (!AtEnd() and strchr("dDwWsS", src[pos])) {
+					AddSet(cls, src[pos++]);
+					continue;
+				}
+				if (!ParseEscapeChar(lo)) return -1;
+			} else {
+				lo = DecodeAt(src, len, pos);
+			}
+			unsigned long hi = lo;
+			if (pos + 1 < len and src[pos] == '-' and src[pos+1] != ']') {
+				pos++;
+				if (src[pos] == '\\') {
+					pos++;
+					if (!ParseEscapeChar(hi)) return -1;
+				} else {
+					hi = DecodeAt(src, len, pos);
+				}
+				if (hi < lo) { Fail("bad character range"); return -1; }
+			}
+			AddRange(cls, lo, hi);
+		}
+		long node = NewNode(RegexNode::Class);
+		nodes[node].c = cls;
+		return node;
+	}
+
+	long RegexCompiler::ParseAtom() {
+		char ch = src[pos];
+		switch (ch) {
+			case '(':
+			{
+				pos++;
+				if (++depth > kMaxNesting) { Fail("groups nested too deeply"); return -1; }
+				long capture = -1;
+				if (Peek() == '?') {
+					pos++;
+					if (Peek() == ':') {
+						pos++;
+					} else if (Peek() == '<' or Peek() == 'P') {
+						if (Peek() == 'P') pos++;
+						if (Peek() != '<') { Fail("bad group syntax"); return -1; }
+						pos++;
+						long nameStart = pos;
+						while (pos < len and IsWordChar((unsigned char)src[pos])) pos++;
+						if (pos == nameStart or Peek() != '>') { Fail("bad group name"); return -1; }
+						String name(src + nameStart, pos - nameStart);
+						pos++;
+						capture = ++re->groupCount;
+						re->groupNames.Add(name);
+					} else {
+						Fail("unsupported group syntax");
+						return -1;
+					}
+				} else {
+					capture = ++re->groupCount;
+					re->groupNames.Add(String());
+				}
+				long inner = ParseAlt();
+				if (inner < 0) return -1;
+				if (Peek() != ')' or AtEnd()) { Fail("unmatched '('"); return -1; }
+				pos++;
+				depth--;
+				long node = NewNode(RegexNode::Group, inner);
+				nodes[node].c = (unsigned long)capture;
+				return node;
+			}
+			case '[':
+				pos++;
+				return ParseClass();
+			case '.':
+				pos++;
+				return NewNode(RegexNode::Any);
+			case '^':
+			case '$':
+			{
+				pos++;
+				long node = NewNode(RegexNode::Assert);
+				nodes[node].c = (ch == '^' ? assertBOL : assertEOL);
+				return node;
+			}
+			case '*':
+			case '+':
+			case '?':
+				Fail("nothing to repeat");
+				return -1;
+			case '\\':
+			{
+				pos++;
+				if (AtEnd()) { Fail("trailing backslash"); return -1; }
+				char e = src[pos];
+				if (e == 'b' or e == 'B') {
+					pos++;
+					long node = NewNode(RegexNode::Assert);
+					nodes[node].c = (e == 'b' ? assertWordB : assertNotWordB);
+					return node;
+				}
+				if (strchr("dDwWsS", e)) {
+					pos++;
+					bool upper = (e >= 'A' and e <= 'Z');
+					long cls = NewClass(upper);
+					AddSet(cls, upper ? e - 'A' + 'a' : e);
+					long node = NewNode(RegexNode::Class);
+					nodes[node].c = cls;
+					return node;
+				}
+				unsigned long c;
+				if (!ParseEscapeChar(c)) return -1;
+				long node = NewNode(RegexNode::Char);
+				nodes[node].c = c;
+				return node;
+			}
+			default:
+			{
+				long node = NewNode(RegexNode::Char);
+				nodes[node].c = DecodeAt(src, len, pos);
+				return node;
+			}
+		}
+	}
+
+	bool RegexCompiler::Emit(long n) {
+		if (re->prog.size() > kMaxProgramSize) return Fail("pattern too large");
+		if (++emitDepth > kMaxEmitDepth) return Fail("pattern too complex");
+		bool ok = EmitNode(n);
+		emitDepth--;
+		return ok;
+	}
+
+	bool RegexCompiler::EmitNode(long n) {
+		RegexNode node = nodes[n];	// (copy, as nodes is not modified here, but be safe)
+		switch (node.type) {
+			case RegexNode::Empty:
+				return true;
+			case RegexNode::Char:
+				EmitInst(Regex::opChar, 0, 0, re->ignoreCase ? UnicodeCharToLower(node.c) : node.c);
+				return true;
+			case RegexNode::Any:
+				EmitInst(re->dotAll ? Regex::opAnyNL : Regex::opAny);
+				return true;
+			case RegexNode::Class:
+				EmitInst(Regex::opClass, node.c);
+				return true;
+			case RegexNode::Assert:
+				EmitInst(Regex::opAssert, node.c);
+				return true;
+			case RegexNode::Cat:
+			{
+				// The parser builds Cat and Alt chains leaning left, one node per
+				// item; so walk down the chain with a loop rather than recursion
+				// (which a long pattern could take deep enough to overflow the stack).
+				SimpleVector<long> parts;
+				long m = n;
+				for (; nodes[m].type == RegexNode::Cat; m = nodes[m].a) parts.push_back(nodes[m].b);
+				if (!Emit(m)) return false;
+				for (long i = parts.size() - 1; i >= 0; i--) {
+					if (!Emit(parts[i])) return false;
+				}
+				return true;
+			}
+			case RegexNode::Alt:
+			{
+				// split L1, L2; L1: first; jmp end; L2: split L3, L4; L3: second; jmp end; ... last; end:
+				SimpleVector<long> alts;
+				long m = n;
+				for (; nodes[m].type == RegexNode::Alt; m = nodes[m].a) alts.push_back(nodes[m].b);
+				alts.push_back(m);
+				SimpleVector<long> jmps;
+				for (long i = alts.size() - 1; i > 0; i--) {
+					long split = EmitInst(Regex::opSplit);
+					re->prog[split].x = re->prog.size();
+					if (!Emit(alts[i])) return false;
+					jmps.push_back(EmitInst(Regex::opJmp));
+					re->prog[split].y = re->prog.size();
+				}
+				if (!Emit(alts[0])) return false;
+				VecIterate(i, jmps) re->prog[jmps[i]].x = re->prog.size();
+				return true;
+			}
+			case RegexNode::Group:
+			{
+				long capture = (long)node.c;
+				if (capture >= 0) EmitInst(Regex::opSave, capture * 2);
+				if (!Emit(node.a)) return false;
+				if (capture >= 0) EmitInst(Regex::opSave, capture * 2 + 1);
+				return true;
+			}
+			case RegexNode::Repeat:
+			{
+				for (long i=0; i<node.min; i++) {
+					if (!Emit(node.a)) return false;
+				}
+				if (node.max < 0) {
+					// loop: L1: split L2, L3; L2: child; jmp L1; L3:
+					long split = EmitInst(Regex::opSplit);
+					if (!Emit(node.a)) return false;
+					EmitInst(Regex::opJmp, split);
+					long after = re->prog.size();
+					re->prog[split].x = node.greedy ? split + 1 : after;
+					re->prog[split].y = node.greedy ? after : split + 1;
+				} else {
+					// optional copies, all bailing out to the same place
+					SimpleVector<long> splits;
+					for (long i=node.min; i<node.max; i++) {
+						splits.push_back(EmitInst(Regex::opSplit));
+						if (!Emit(node.a)) return false;
+					}
+					long after = re->prog.size();
+					for (long i=0, count=splits.size(); i<count; i++) {
+						long split = splits[i];
+						re->prog[split].x = node.greedy ? split + 1 : after;
+						re->prog[split].y = node.greedy ? after : split + 1;
+					}
+				}
+				return true;
+			}
+		}
+		return Fail("internal error");
+	}
+
+	#pragma mark - Regex
+
+	Regex::Regex() : groupCount(0), ignoreCase(false), multiline(false), dotAll(false) {}
+
+	Regex::~Regex() {}
+
+	Regex *Regex::Compile(const String& pattern, String *outError) {
+		Regex *re = new Regex();
+		RegexCompiler compiler(pattern, re);
+		if (!compiler.Compile(outError)) {
+			delete re;
+			return nullptr;
+		}
+		return re;
+	}
+
+	String Regex::GroupName(int group) const {
+		if (group < 1 or group >= groupNames.Count()) return String();
+		return groupNames[group];
+	}
+
+	bool Regex::ClassMatchesOneCase(const CharClass& cls, unsigned long c) const {
+		for (long i=0; i<cls.count; i++) {
+			const ClassRange& r = classRanges[cls.first + i];
+			if (c >= r.lo and c <= r.hi) return true;
+		}
+		if (cls.notSets) {
+			if ((cls.notSets & notDigit) and !IsDigitChar(c)) return true;
+			if ((cls.notSets & notWord) and !IsWordChar(c)) return true;
+			if ((cls.notSets & notSpace) and !IsSpaceChar(c)) return true;
+		}
+		return false;
+	}
+
+	bool Regex::ClassMatches(const CharClass& cls, unsigned long c) const {
+		bool found = ClassMatchesOneCase(cls, c);
+		if (!found and ignoreCase) {
+			unsigned long other = UnicodeCharToLower(c);
+			if (other == c) other = UnicodeCharToUpper(c);
+			if (other != c) found = ClassMatchesOneCase(cls, other);
+		}
+		return found != cls.negated;
+	}
+
+	bool Regex::AssertHolds(long kind, const char *text, long len, long sp) const {
+		switch (kind) {
+			case assertBOL:
+				return sp == 0 or (multiline and text[sp-1] == '\n');
+			case assertEOL:
+				return sp == len or (multiline and text[sp] == '\n');
+			case assertWordB:
+			case assertNotWordB:
+			{
+				bool before = sp > 0 and IsWordChar((unsigned char)text[sp-1]);
+				bool after = sp < len and IsWordChar((unsigned char)text[sp]);
+				return (before != after) == (kind == assertWordB);
+			}
+		}
+		return false;
+	}
+
+	// State for one run of the Pike VM.  A thread list holds, in priority
+	// order, the program counter and capture slots of each live thread.
+	namespace {
+		struct ThreadList {
+			long count;
+			long *pcs;
+			long *caps;		// count * slotCount
+			unsigned long gen;	// marks which pcs are already in this list
+		};
+
+		struct PendingAdd {
+			long pc;		// instruction to follow, or -1 to restore a capture slot
+			long slot;
+			long oldValue;
+		};
+	}
+
+	bool Regex::Search(const char *text, long len, long startB, long *caps, Mode mode) const {
+		long progLen = prog.size();
+		long slotCount = (groupCount + 1) * 2;
+		if (startB < 0 or startB > len or progLen == 0) return false;
+
+		// One allocation for all our scratch space.
+		long longCount = progLen * 2 + progLen * slotCount * 2 + slotCount + progLen * 3;
+		long *scratch = new long[longCount];
+		ThreadList lists[2];
+		long *p = scratch;
+		for (int i=0; i<2; i++) {
+			lists[i].count = 0;
+			lists[i].pcs = p;	p += progLen;
+			lists[i].caps = p;	p += progLen * slotCount;
+			lists[i].gen = 0;
+		}
+		long *work = p;			p += slotCount;
+		unsigned long *mark = new unsigned long[progLen];
+		for (long i=0; i<progLen; i++) mark[i] = 0;
+		PendingAdd *stack = new PendingAdd[progLen * 2 + 2];
+		unsigned long gen = 0;
+
+		bool matched = false;
+		ThreadList *clist = &lists[0];
+		ThreadList *nlist = &lists[1];
+		clist->gen = ++gen;
+
+		// Add a thread at pc (following jumps, splits, saves, and assertions)
+		// to the given list, with capture slots from `work`, at text position sp.
+		auto addThread = [&](ThreadList *list, long pc0, long sp) {
+			long top = 0;
+			stack[top].pc = pc0;
+			stack[top++].slot = -1;
+			while (top > 0) {
+				PendingAdd e = stack[--top];
+				if (e.pc < 0) { work[e.slot] = e.oldValue; continue; }
+				long pc = e.pc;
+				if (mark[pc] == list->gen) continue;
+				mark[pc] = list->gen;
+				const Inst& inst = prog[pc];
+				switch (inst.op) {
+					case opJmp:
+						stack[top].pc = inst.x; stack[top++].slot = -1;
+						break;
+					case opSplit:
+						stack[top].pc = inst.y; stack[top++].slot = -1;
+						stack[top].pc = inst.x; stack[top++].slot = -1;
+						break;
+					case opSave:
+						stack[top].pc = -1; stack[top].slot = inst.x; stack[top++].oldValue = work[inst.x];
+						work[inst.x] = sp;
+						stack[top].pc = pc + 1; stack[top++].slot = -1;
+						break;
+					case opAssert:
+						if (AssertHolds(inst.x, text, len, sp)) {
+							stack[top].pc = pc + 1; stack[top++].slot = -1;
+						}
+						break;
+					default:
+						list->pcs[list->count] = pc;
+						memcpy(list->caps + list->count * slotCount, work, slotCount * sizeof(long));
+						list->count++;
+				}
+			}
+		};
+
+		long sp = startB;
+		while (true) {
+			if (!matched and (mode == Mode::Search or sp == startB)) {
+				for (long i=0; i<slotCount; i++) work[i] = -1;
+				addThread(clist, 0, sp);
+			}
+			long next = sp;
+			long c = -1;
+			if (sp < len) c = (long)DecodeAt(text, len, next);
+			if (clist->count == 0) {
+				// No live threads; we're done unless a search may start later.
+				if (matched or mode != Mode::Search or sp >= len) break;
+				clist->gen = ++gen;
+				sp = next;
+				continue;
+			}
+			long folded = (c >= 0 and ignoreCase) ? (long)UnicodeCharToLower(c) : c;
+
+			nlist->count = 0;
+			nlist->gen = ++gen;
+			for (long i=0; i<clist->count; i++) {
+				long pc = clist->pcs[i];
+				long *threadCaps = clist->caps + i * slotCount;
+				const Inst& inst = prog[pc];
+				bool advance = false;
+				switch (inst.op) {
+					case opMatch:
+						if (mode == Mode::Full and sp != len) break;
+						memcpy(caps, threadCaps, slotCount * sizeof(long));
+						matched = true;
+						i = clist->count;	// lower-priority threads are cut off
+						break;
+					case opChar:
+						advance = (folded >= 0 and (unsigned long)folded == inst.c);
+						break;
+					case opAny:
+						advance = (c >= 0 and c != '\n');
+						break;
+					case opAnyNL:
+						advance = (c >= 0);
+						break;
+					case opClass:
+						advance = (c >= 0 and ClassMatches(classes[inst.x], c));
+						break;
+					default:
+						break;
+				}
+				if (advance) {
+					memcpy(work, threadCaps, slotCount * sizeof(long));
+					addThread(nlist, pc + 1, next);
+				}
+			}
+			ThreadList *temp = clist; clist = nlist; nlist = temp;
+			if (sp >= len) break;
+			sp = next;
+		}
+
+		delete[] stack;
+		delete[] mark;
+		delete[] scratch;
+		return matched;
+	}
+
+	#pragma mark - Unit Tests
+
+	class TestRegex : public UnitTest
+	{
+	public:
+		TestRegex() : UnitTest("Regex") {}
+		virtual void Run();
+	private:
+		String Find(const char *pattern, const char *text, int group=0);
+	};
+
+	String TestRegex::Find(const char *pattern, const char *text, int group) {
+		String err;
+		Regex *re = Regex::Compile(pattern, &err);
+		Assert(re != nullptr);
+		if (!re) return "(error)";
+		long caps[40];
+		String result = "(none)";
+		long len = strlen(text);
+		if (re->Search(text, len, 0, caps)) {
+			if (caps[group*2] < 0) result = "(unset)";
+			else result = String(text + caps[group*2], caps[group*2+1] - caps[group*2]);
+		}
+		re->release();
+		return result;
+	}
+
+	void TestRegex::Run()
+	{
+		Assert(Find("abc", "xxabcxx") == "abc");
+		Assert(Find("a.c", "xxabcxx") == "abc");
+		Assert(Find("a+", "baaab") == "aaa");
+		Assert(Find("a+?", "baaab") == "a");
+		Assert(Find("ab*c", "ac") == "ac");
+		Assert(Find("colou?r", "color") == "color");
+		Assert(Find("a|ab", "ab") == "a");
+		Assert(Find("(a|ab)(c|bcd)", "abcd") == "abcd");
+		Assert(Find("\\d{3}-\\d{4}", "call 555-1234 now") == "555-1234");
+		Assert(Find("x{2,3}", "xxxxx") == "xxx");
+		Assert(Find("[a-c]+", "zzbcaq") == "bca");
+		Assert(Find("[^a-c]+", "abcxyzabc") == "xyz");
+		Assert(Find("^b", "ab") == "(none)");
+		Assert(Find("b$", "ab") == "b");
+		Assert(Find("\\bcat\\b", "concat cat") == "cat");
+		Assert(Find("(\\w+)@(\\w+)", "mail joe@example now", 2) == "example");
+		Assert(Find("(?<user>\\w+)@", "joe@x", 1) == "joe");
+		Assert(Find("(a)|b", "b", 1) == "(unset)");
+		Assert(Find("(?i)HeLLo", "say hello") == "hello");
+		Assert(Find("日本+", "x日本本語") == "日本本");
+		Assert(Find("[日本]+", "x日本本語") == "日本本");
+		Assert(Find("(?m)^b", "a\nb") == "b");
+		Assert(Find("a{,2}", "a{,2}") == "a{,2}");
+
+		// The classic pathological case runs in linear time.
+		String s(30, 'a');
+		Assert(Find("(a*)*b", s.c_str()) == "(none)");
+		Assert(Find("(a?){30}a{30}", s.c_str()) == s);
+
+		String err;
+		Assert(Regex::Compile("(abc", &err) == nullptr);
+		Assert(Regex::Compile("abc)", &err) == nullptr);
+		Assert(Regex::Compile("[abc", &err) == nullptr);
+		Assert(Regex::Compile("*a", &err) == nullptr);
+		Assert(Regex::Compile("a{5,2}", &err) == nullptr);
+
+		// Huge patterns are refused, rather than overflowing the stack.
+		Assert(Regex::Compile(String(100000, 'a'), &err) == nullptr);
+		Assert(err.StartsWith("pattern too large"));
+		Assert(Regex::Compile("a" + String(10000, '?'), &err) == nullptr);
+		Assert(err.StartsWith("pattern too complex"));
+		Assert(Find("x|y|b|z", "abc") == "b");
+	}
+
+	RegisterUnitTest(TestRegex);
+
+}
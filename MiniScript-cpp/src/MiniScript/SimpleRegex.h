@@ -0,0 +1,94 @@
+//
+//  SimpleRegex.h
+//  MiniScript
+//
+//	A small regular-expression engine.  Patterns are compiled into a program
+//	for a Pike VM (a Thompson NFA simulation that tracks submatches), so the
+//	time to match is linear in the length of the text: there is no
+//	backtracking, catastrophic or otherwise.  Text is matched as UTF-8, one
+//	code point at a time.
+//
+//	Supported syntax:
+//		literals, and escapes \n \t \r \f \v \0 \\ \. \( etc.
+//		.  [abc]  [^a-z]  \d \D \w \W \s \S  (\w and \d are ASCII-only)
+//		^  $  \b  \B
+//		(group)  (?:non-capturing)  (?<name>named group)
+//		a|b
+//		*  +  ?  {n}  {n,}  {n,m}, and lazy forms *? +? ?? {n,m}?
+//		inline flags at the very start of the pattern: (?i) ignore case,
+//		(?m) ^ and $ match at line breaks, (?s) . matches newline
+//
+
+#ifndef SIMPLEREGEX_H
+#define SIMPLEREGEX_H
+
+#include "SimpleString.h"
+#include "SimpleVector.h"
+#include "List.h"
+
+namespace MiniScript {
+
+	class Regex : public RefCountedStorage {
+	public:
+		enum class Mode {
+			Search,		// find the leftmost match at or after the start position
+			Anchored,	// match must begin at the start position
+			Full		// match must begin at the start position and run to the end
+		};
+
+		// Compile the given pattern.  On error, returns nullptr and sets outError.
+		// (The result has a refCount of 1, like any new RefCountedStorage.)
+		static Regex *Compile(const String& pattern, String *outError);
+
+		// Number of capture groups (not counting group 0, the whole match).
+		int GroupCount() const { return groupCount; }
+
+		// Name of the given capture group (1-based), or an empty string.
+		String GroupName(int group) const;
+
+		// Look for a match in the text (len bytes), starting at byte startB.
+		// On success, fills caps with 2*(GroupCount()+1) byte offsets -- start
+		// and end of the whole match, then of each group, or -1 for groups that
+		// did not take part -- and returns true.
+		bool Search(const char *text, long len, long startB, long *caps, Mode mode=Mode::Search) const;
+
+		virtual ~Regex();
+
+	private:
+		Regex();
+
+		enum Op : unsigned char {
+			opChar, opAny, opAnyNL, opClass, opMatch, opJmp, opSplit, opSave, opAssert
+		};
+		struct Inst {
+			Op op;
+			long x;				// jump target, class index, save slot, or assertion kind
+			long y;				// second jump target (opSplit)
+			unsigned long c;	// character (opChar)
+		};
+		struct ClassRange { unsigned long lo, hi; };
+		struct CharClass {
+			long first, count;	// ranges in classRanges
+			bool negated;
+			unsigned char notSets;	// bit flags for \D, \W, \S within the brackets
+		};
+
+		bool ClassMatches(const CharClass& cls, unsigned long c) const;
+		bool ClassMatchesOneCase(const CharClass& cls, unsigned long c) const;
+		bool AssertHolds(long kind, const char *text, long len, long sp) const;
+
+		SimpleVector<Inst> prog;
+		SimpleVector<ClassRange> classRanges;
+		SimpleVector<CharClass> classes;
+		List<String> groupNames;	// [0] unused; empty for unnamed groups
+		int groupCount;
+		bool ignoreCase;
+		bool multiline;
+		bool dotAll;
+
+		friend class RegexCompiler;
+	};
+
+}
+
+#endif // SIMPLEREGEX_H
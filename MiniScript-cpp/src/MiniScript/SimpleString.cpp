@@ -68,9 +68,42 @@ namespace MiniScript {
 		return count;
 	}
 
+	// ASCIIChar, SmallInt
+	//
+	//	Get one of our preallocated, immortal strings.
+	String *String::MakeImmortalStrings(long count, bool chars) {
+		String *table = new String[count];
+		char buf[8];
+		for (long i=0; i<count; i++) {
+			if (chars) {
+				buf[0] = (char)i;
+				table[i] = String(buf, 1);
+			} else {
+				table[i] = String::Format(i);
+			}
+			table[i].Length();		// (analyze now, so we never write to it later)
+			table[i].ss->makeImmortal();
+		}
+		return table;
+	}
+	
+	const String& String::ASCIIChar(unsigned char c) {
+		static String *table = MakeImmortalStrings(128, true);
+		return table[c];
+	}
+	
+	const String& String::SmallInt(long n) {
+		static String *table = MakeImmortalStrings(smallIntStrings, false);
+		return table[n];
+	}
+	
 	String String::Substring(long pos, long numChars) const {
 		if (!ss) return *this;
 		long posB = bytePosOfCharPos(pos);	// (also ensures ss->isASCII is known)
+		if (numChars == 1 and pos >= 0 and posB < (long)sizeB() and (unsigned char)ss->data[posB] < 128) {
+			// Single ASCII character: no need to allocate.
+			return ASCIIChar(ss->data[posB]);
+		}
 		if (ss->isASCII) return SubstringB(pos, numChars);
 		unsigned char *startPtr = (unsigned char*)ss->data + posB;
 		unsigned char *endPtr = startPtr;
@@ -146,6 +179,26 @@ namespace MiniScript {
 		return retval;
 	}
 
+	String String::ToLower() const {
+		String out;
+		if (ss == nullptr) return out;
+		unsigned char *buf;
+		unsigned long bytes;
+		UTF8ToLower((unsigned char*)ss->data, LengthB(), &buf, &bytes);
+		buf[bytes] = 0;
+		return out.takeoverBuffer((char*)buf, bytes);
+	}
+
+	String String::ToUpper() const {
+		String out;
+		if (ss == nullptr) return out;
+		unsigned char *buf;
+		unsigned long bytes;
+		UTF8ToUpper((unsigned char*)ss->data, LengthB(), &buf, &bytes);
+		buf[bytes] = 0;
+		return out.takeoverBuffer((char*)buf, bytes);
+	}
+
 	double String::DoubleValue(const char* formatSpec) const {
 		double retval = 0;
 		sscanf(c_str(), formatSpec, &retval);
@@ -339,6 +392,27 @@ namespace MiniScript {
 		Assert(not s.StartsWith("本語"));
 		Assert(s.EndsWith("本語"));
 		Assert(not s.EndsWith("本"));
+		
+		s = "a日b";
+		Assert(s.Substring(2, 1) == "b");
+		Assert(s.Substring(2, 1).data() == String::ASCIIChar('b').data());
+		Assert(s.Substring(1, 1) == "日");
+		Assert(String::SmallInt(0) == "0");
+		Assert(String::SmallInt(String::smallIntStrings - 1) == "1023");
+		
+		StringBuilder sb;
+		Assert(sb.ToString().empty());
+		sb += "foo";
+		sb += String("bar");
+		sb += '!';
+		Assert(sb.LengthB() == 7);
+		Assert(sb.ToString() == "foobar!");
+		Assert(sb.empty());
+		for (int i=0; i<1000; i++) sb += "日本";
+		s = sb.ToString();
+		Assert(s.LengthB() == 6000);
+		Assert(s.Length() == 2000);
+		Assert(s.EndsWith("日本日本"));
 	}
 
 	RegisterUnitTest(TestString);
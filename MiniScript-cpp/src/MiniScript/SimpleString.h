@@ -13,6 +13,7 @@
 #include <cctype>
 #include <cstring>
 #include "RefCountedStorage.h"
+#include "RecyclingPool.h"
 
 namespace MiniScript {
 
@@ -34,6 +35,7 @@ namespace MiniScript {
 		}
 		StringStorage(size_t bufSize) : dataSize(bufSize), charCount(-1) {
 			data = new char[bufSize];
+			MemoryAccount::Charge((long)bufSize);
 			memset(data, 0, bufSize);
 #if(DEBUG)
 			instanceCount++;
@@ -43,7 +45,10 @@ namespace MiniScript {
 #endif
 		}
 		virtual ~StringStorage() {
-			if (data) delete[] data;
+			if (data) {
+				delete[] data;
+				MemoryAccount::Charge(-(long)dataSize);
+			}
 #if(DEBUG)
 			instanceCount--;
 			if (_prev) _prev->_next = _next;
@@ -55,6 +60,9 @@ namespace MiniScript {
 		char *data;
 		size_t dataSize;
 		
+		static void *operator new(size_t size) { return RecyclingPool<sizeof(StringStorage)>::Allocate(size); }
+		static void operator delete(void *p, size_t size) { RecyclingPool<sizeof(StringStorage)>::Release(p, size); }
+		
 		// some cached data for efficiency:
 		long charCount; // -1 when not yet known
 		bool isASCII;   // if charCount > 0 and isASCII==true, then this String is 1 byte per character
@@ -89,7 +97,7 @@ namespace MiniScript {
 		~String() { release(); }
 		
 		// operators
-		String& operator= (const String& other) { if (other != *this) { if (other.ss) other.ss->refCount++; release(); ss = other.ss; isTemp = false; } return *this; }
+		String& operator= (const String& other) { if (other != *this) { if (other.ss) other.ss->retain(); release(); ss = other.ss; isTemp = false; } return *this; }
 		inline String& operator=(const char c);
 		inline String& operator= (const char* c);
 		inline String operator+ (const String& other) const;
@@ -162,6 +170,12 @@ namespace MiniScript {
 		
 		inline String& takeoverBuffer(char *buffer, long strBytes = -1);
 		
+		// Shared, immortal strings for each ASCII character, and for the
+		// decimal form of each integer from 0 to smallIntStrings-1.
+		static const long smallIntStrings = 1024;
+		static const String& ASCIIChar(unsigned char c);	// (c must be < 128)
+		static const String& SmallInt(long n);
+		
 		static String Format(int num, const char* formatSpec = "%d");
 		static String Format(long num, const char* formatSpec = "%ld");
 		static String Format(float num, const char* formatSpec = "%g");
@@ -174,8 +188,8 @@ namespace MiniScript {
 		double DoubleValue(const char* formatSpec = "%lf") const;
 		bool BooleanValue() const;
 		
-		inline String ToLower() const;
-		inline String ToUpper() const;
+		String ToLower() const;
+		String ToUpper() const;
 
 		inline unsigned int Hash() const;
 		
@@ -194,6 +208,7 @@ namespace MiniScript {
 		void forget() { ss = nullptr; }	// used for unretained temps, or when a Value has adopted the reference
 		
 		inline String TrimHelper(char c, bool left, bool right);
+		static String *MakeImmortalStrings(long count, bool chars);
 		
 		StringStorage *ss;
 		bool isTemp;	// true when we are a temp string, and don't participate in reference counting
@@ -474,6 +489,7 @@ namespace MiniScript {
 		newbie->data = buffer;
 		if (strBytes >= 0) newbie->dataSize = strBytes + 1; // +1 for the nullptr character
 		else if (buffer) newbie->dataSize = strlen(buffer) + 1; // (same)
+		if (buffer) MemoryAccount::Charge((long)newbie->dataSize);
 		ss = newbie;
 		isTemp = false;
 		return *this;
@@ -514,30 +530,6 @@ namespace MiniScript {
 		return String(newbie, false);	// LEAK
 	}
 
-	inline String String::ToLower() const {
-		String out;
-		if (ss != nullptr) {
-			out.ss = new StringStorage(ss->dataSize);
-			memcpy(out.ss->data, ss->data, ss->dataSize);
-			for (unsigned int i = 0; i < out.ss->dataSize; i++) {
-				out.ss->data[i] = tolower(out.ss->data[i]);
-			}
-		}
-		return out;
-	}
-
-	inline String String::ToUpper() const {
-		String out;
-		if (ss) {
-			out.ss = new StringStorage(ss->dataSize);
-			memcpy(out.ss->data, ss->data, ss->dataSize);
-			for (unsigned int i = 0; i < out.ss->dataSize; i++) {
-				out.ss->data[i] = toupper(out.ss->data[i]);
-			}
-		}
-		return out;
-	}
-
 	// Comparision between cstrings and strings
 	bool operator==(const char *cstring, const String &str);
 	bool operator!=(const char *cstring, const String &str);
@@ -565,6 +557,85 @@ namespace MiniScript {
 		return key.Hash();
 	}
 
+	#pragma mark -
+
+	// StringBuilder: a growable byte buffer for assembling a String piece by
+	// piece without making a new String for every intermediate step.  Call
+	// ToString when done; that hands the buffer over to the String (no copy)
+	// and leaves the builder empty, ready for reuse.
+	class StringBuilder {
+	public:
+		StringBuilder(size_t capacity=0) : buf(nullptr), len(0), cap(0) { if (capacity) Reserve(capacity); }
+		~StringBuilder() {
+			delete[] buf;
+			MemoryAccount::Charge(-(long)cap);
+		}
+
+		size_t LengthB() const { return len; }
+		bool empty() const { return len == 0; }
+		const char *data() const { return buf; }
+
+		// Ensure room for at least the given number of bytes (plus terminator).
+		inline void Reserve(size_t bytes);
+
+		inline StringBuilder& Append(const char *c, size_t bytes);
+		StringBuilder& Append(const char *c) { return c ? Append(c, strlen(c)) : *this; }
+		StringBuilder& Append(const String& s) { return Append(s.data(), s.LengthB()); }
+		StringBuilder& Append(char c) { if (len + 1 >= cap) Reserve(len + 1); buf[len++] = c; return *this; }
+		StringBuilder& operator+= (const String& s) { return Append(s); }
+		StringBuilder& operator+= (const char *c) { return Append(c); }
+		StringBuilder& operator+= (char c) { return Append(c); }
+
+		void Clear() { len = 0; }
+
+		inline String ToString();
+
+	private:
+		StringBuilder(const StringBuilder& other);				// (not copyable)
+		StringBuilder& operator= (const StringBuilder& other);
+
+		char *buf;
+		size_t len;		// bytes used (not counting the terminator)
+		size_t cap;		// bytes allocated
+	};
+
+	void StringBuilder::Reserve(size_t bytes) {
+		if (bytes < cap) return;
+		size_t newCap = cap ? cap * 2 : 32;
+		while (newCap <= bytes) newCap *= 2;
+		char *newBuf = new char[newCap];
+		if (len) memcpy(newBuf, buf, len);
+		delete[] buf;
+		MemoryAccount::Charge((long)newCap - (long)cap);
+		buf = newBuf;
+		cap = newCap;
+	}
+
+	StringBuilder& StringBuilder::Append(const char *c, size_t bytes) {
+		if (!bytes) return *this;
+		if (len + bytes >= cap) Reserve(len + bytes);
+		memcpy(buf + len, c, bytes);
+		len += bytes;
+		return *this;
+	}
+
+	String StringBuilder::ToString() {
+		String result;
+		if (!len) return result;
+		if (cap > len * 2 + 64) {
+			// Much of our buffer is unused; don't make the String carry it forever.
+			result = String(buf, len);
+			len = 0;
+			return result;
+		}
+		buf[len] = 0;
+		MemoryAccount::Charge(-(long)cap);		// (the String takes over the charge, too)
+		result.takeoverBuffer(buf, len);
+		buf = nullptr;
+		len = cap = 0;
+		return result;
+	}
+
 }
 
 #endif // SIMPLESTRING_H
@@ -16,8 +16,11 @@
 #define SIMPLEVECTOR_H
 
 #include "QA.h"
+#include "MemoryAccount.h"
 
 #include <iostream> // HACK for debugging
+#include <new>
+#include <string.h>
 
 template <class T>
 class SimpleVector {
@@ -62,6 +65,10 @@ class SimpleVector {
 	inline void deleteIdx(long idx);			// delete an item by its index
 	inline void deleteAll();					// delete all items
 
+	// bulk insertion/deletion (following items are shifted just once, bytewise)
+	inline void insertRange(const T* items, long count, long idx);	// insert copies of count items at idx
+	inline void deleteRange(long idx, long count);					// delete count items starting at idx
+
 	// containment inspectors
 	inline long indexOf(const T& item);
 	inline bool Contains(const T& item);
@@ -111,6 +118,7 @@ inline SimpleVector<T>::SimpleVector(long n)
 			mBuf = new T[mBufItems];
 			Assert(mBuf);
 		#endif
+		MiniScript::MemoryAccount::Charge(bufbytes());
 	} else mBuf = nullptr;
 }
 
@@ -127,6 +135,7 @@ template <class T>
 inline SimpleVector<T>& SimpleVector<T>::operator=(const SimpleVector<T>& vec)
 {
 	if (mBuf) delete[] mBuf;
+	MiniScript::MemoryAccount::Charge(-(long)bufbytes());
 	mBuf = nullptr;
 	mBlockItems = vec.mBlockItems;
 	mBufItems = vec.mBufItems;
@@ -144,6 +153,7 @@ inline SimpleVector<T>& SimpleVector<T>::operator=(const SimpleVector<T>& vec)
 			Assert(mBuf);
 		}
 	#endif
+	MiniScript::MemoryAccount::Charge(bufbytes());
 	
 	if (mBuf) {
 		// Mar 04 2002 -- MJS (1)
@@ -162,6 +172,7 @@ template <class T>
 inline SimpleVector<T>::~SimpleVector()
 {
 	if (mBuf) delete[] mBuf;
+	MiniScript::MemoryAccount::Charge(-(long)bufbytes());
 //	std::cout << "Delete SimpleVector at " << (long)(this);
 }
 
@@ -402,10 +413,66 @@ inline void SimpleVector<T>::deleteIdx(const long idx)
 	}
 }
 
+// Note on insertRange and deleteRange: items are relocated with memmove,
+// then the slots they vacated are reinitialized in place (without running
+// the destructor of the now-duplicated bits).  So an item is moved rather
+// than copied, which for ref-counted types means no retain/release churn.
+template <class T>
+inline void SimpleVector<T>::insertRange(const T* items, long count, long idx)
+{
+	if (idx < 0 or idx > (long)mQtyItems) {
+		#if USE_EXCEPTIONS
+			throw memFullErr;
+		#else
+			Error("invalid index in SimpleVector::insertRange");
+		#endif
+		return;
+	}
+	if (count <= 0) return;
+	if (items >= mBuf and items < mBuf + mBufItems) {
+		// Inserting (part of) ourselves: work from a copy.
+		SimpleVector<T> temp(count);
+		for (long i=0; i<count; i++) temp.push_back(items[i]);
+		insertRange(&temp[0], count, idx);
+		return;
+	}
+	
+	// resize the buffer if needed
+	if (mQtyItems + count > mBufItems) {
+		unsigned long expandBy = (mBlockItems > 0 ? mBlockItems : mBufItems);
+		if (expandBy < 16) expandBy = 16;
+		unsigned long newSize = mBufItems + expandBy;
+		if (newSize < mQtyItems + count) newSize = mQtyItems + count;
+		resizeBuffer(newSize);
+	}
+	
+	// clear out the unused slots we're about to take over, move the
+	// following items up, and copy the new items into the gap
+	for (long i=mQtyItems; i<(long)mQtyItems + count; i++) mBuf[i].~T();
+	memmove((void*)&mBuf[idx + count], (void*)&mBuf[idx], sizeof(T) * (mQtyItems - idx));
+	for (long i=0; i<count; i++) new ((void*)&mBuf[idx + i]) T(items[i]);
+	mQtyItems += count;
+}
+
+template <class T>
+inline void SimpleVector<T>::deleteRange(long idx, long count)
+{
+	if (idx < 0 or count <= 0 or idx >= (long)mQtyItems) return;
+	if (idx + count > (long)mQtyItems) count = mQtyItems - idx;
+	
+	// destroy the deleted items, move the following items down,
+	// and reinitialize the slots left at the end
+	for (long i=idx; i<idx + count; i++) mBuf[i].~T();
+	memmove((void*)&mBuf[idx], (void*)&mBuf[idx + count], sizeof(T) * (mQtyItems - idx - count));
+	for (long i=mQtyItems - count; i<(long)mQtyItems; i++) new ((void*)&mBuf[i]) T();
+	mQtyItems -= count;
+}
+
 template <class T>
 inline void SimpleVector<T>::deleteAll()
 {
 	delete[] mBuf;
+	MiniScript::MemoryAccount::Charge(-(long)bufbytes());
 	mBuf = nullptr;
 	mBufItems = mQtyItems = 0;
 }
@@ -430,6 +497,7 @@ inline void SimpleVector<T>::resizeBuffer(long n)
 	if (n == (long)mBufItems) return;
 	T *newbuf = new T[n];
 //	if (!newbuf) throw memFullErr;	// (not needed, as new now throws if it fails)
+	MiniScript::MemoryAccount::Charge((n - (long)mBufItems) * (long)sizeof(T));
 	if (mBuf) {
 		T* src = mBuf;
 		T* dest = newbuf;
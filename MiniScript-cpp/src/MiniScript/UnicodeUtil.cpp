@@ -3,16 +3,23 @@
 //	Various utility functions for dealing with Unicode (especially UTF-8) text.
 
 #include "UnicodeUtil.h"
-#include "Dictionary.h"
 #include "QA.h"
 #include "UnitTest.h"
+#include <stdint.h>
+#include <string.h>
 
 namespace MiniScript {
 	
 	// Case Tables
-	// Maps which convert a Unicode code point into the corresponding upper/lower case code point.
-	static Dictionary<unsigned short, unsigned short, hashUShort> sUpperToLowerMap;
-	static Dictionary<unsigned short, unsigned short, hashUShort> sLowerToUpperMap;
+	// Two-level tables which convert a 16-bit code point into the corresponding
+	// upper/lower case code point.  The high byte of the code point selects a
+	// block of 256 entries, and the low byte selects an entry within it; each
+	// entry is the amount to add (mod 0x10000) to get the converted character.
+	// Blocks with no cased characters all share one block of zeros.
+	static const unsigned short sNoCaseBlock[256] = {0};
+	static const unsigned short *sToLowerBlocks[256];
+	static const unsigned short *sToUpperBlocks[256];
+	static unsigned char sCasedBits[0x10000 / 8];	// bit set for each code point that has case
 	static bool sMapsInitialized = false;
 
 	// table of upper-case code points (each corresponds to the entry at the same
@@ -171,24 +178,47 @@ namespace MiniScript {
 	0xFF4D, 0xFF4E, 0xFF4F, 0xFF50, 0xFF51, 0xFF52, 0xFF53, 0xFF54, 0xFF55, 0xFF56,
 	0xFF57, 0xFF58, 0xFF59, 0xFF5A };
 
+	// SetCaseMapping
+	//
+	//	Store one entry in a two-level case table, allocating its block if needed.
+	static void SetCaseMapping(const unsigned short **blocks, unsigned short from, unsigned short to)
+	{
+		unsigned short *block = (unsigned short*)blocks[from >> 8];
+		if (block == sNoCaseBlock) {
+			block = new unsigned short[256]();
+			blocks[from >> 8] = block;
+		}
+		block[from & 0xFF] = (unsigned short)(to - from);
+	}
+
 	// InitCaseMaps
 	//
-	//	Set up the maps that convert a Unicode code point into the corresponding
-	//	index in our upper and lower case tables.  This is used for case folding.
+	//	Set up the tables that convert a Unicode code point into the corresponding
+	//	upper or lower case code point, and note which code points have case.
+	//	This is used for case folding.
 	static void InitCaseMaps()
 	{
+		for (int i=0; i<256; i++) sToLowerBlocks[i] = sToUpperBlocks[i] = sNoCaseBlock;
 		short qty = (short)(sizeof(sUpperTable) / sizeof(unsigned short));
 		// Note: it's important to iterate backwards, because some entries appear more
 		// than once, and the lower-numbered entry (i.e. earlier one in the table) is
 		// the preferred one.
 		for (short i=qty-1; i>=0; i--) {
-			sUpperToLowerMap.SetValue( sUpperTable[i], sLowerTable[i] );
-			sLowerToUpperMap.SetValue( sLowerTable[i], sUpperTable[i] );
+			SetCaseMapping(sToLowerBlocks, sUpperTable[i], sLowerTable[i]);
+			SetCaseMapping(sToUpperBlocks, sLowerTable[i], sUpperTable[i]);
+			sCasedBits[sUpperTable[i] >> 3] |= (unsigned char)(1 << (sUpperTable[i] & 7));
+			sCasedBits[sLowerTable[i] >> 3] |= (unsigned char)(1 << (sLowerTable[i] & 7));
 		}
 		
 		sMapsInitialized = true;								// Mar 09 2003 -- JJS (1)
 	}
 
+	// Look up a 16-bit code point in a two-level case table (see above).
+	static inline unsigned long CaseLookup(const unsigned short **blocks, unsigned long c)
+	{
+		return (unsigned short)(c + blocks[c >> 8][c & 0xFF]);
+	}
+
 	// MARK: -
 
 	// AdvanceUTF8
@@ -402,9 +432,7 @@ namespace MiniScript {
 	{
 		if (lower > 0xFFFF) return lower;	// (our case folder only handles 16-bit code points)
 		if (!sMapsInitialized) InitCaseMaps();
-		unsigned short result = (unsigned short)lower;
-		result = sLowerToUpperMap.Lookup(result, result);
-		return result;
+		return CaseLookup(sToUpperBlocks, lower);
 	}
 
 	// UnicodeCharToLower
@@ -420,28 +448,90 @@ namespace MiniScript {
 	{
 		if (upper > 0xFFFF) return upper;	// (our case folder only handles 16-bit code points)
 		if (!sMapsInitialized) InitCaseMaps();
-		unsigned short result = (unsigned short)upper;
-		result = sUpperToLowerMap.Lookup(result, result);
-		return result;
+		return CaseLookup(sToLowerBlocks, upper);
 	}
 
-	// UTF8ToUpper
+	// ASCIIToCase
 	//
-	//	Converts a UTF8 String into uppercase
+	//	Convert a run of ASCII text to upper or lower case, 8 bytes at a time
+	//	where possible, stopping at the first non-ASCII byte.
+	//
+	// Gets:	in -- text to convert
+	//			out -- where to write the converted text (may be the same as in)
+	//			byteCount -- maximum number of bytes to convert
+	//			toUpper -- true to convert to upper case, false for lower case
+	// Returns: number of bytes converted
+	static unsigned long ASCIIToCase(const unsigned char *in, unsigned char *out,
+									 unsigned long byteCount, bool toUpper)
+	{
+		const uint64_t ones = 0x0101010101010101ULL;
+		const uint64_t highBits = ones * 0x80;
+		// Adding these sets the high bit of each byte >= first (or > last),
+		// without carrying into the next byte (since all bytes are < 0x80).
+		const uint64_t fromFirst = ones * (0x80 - (toUpper ? 'a' : 'A'));
+		const uint64_t pastLast = ones * (0x80 - (toUpper ? 'z' : 'Z') - 1);
+		unsigned long i = 0;
+		while (i + 8 <= byteCount) {
+			uint64_t chunk;
+			memcpy(&chunk, in + i, 8);
+			if (chunk & highBits) break;
+			uint64_t inRange = (chunk + fromFirst) & ~(chunk + pastLast) & highBits;
+			chunk ^= inRange >> 2;		// (flip the 0x20 bit of each letter in range)
+			memcpy(out + i, &chunk, 8);
+			i += 8;
+		}
+		for (; i < byteCount; i++) {
+			unsigned char c = in[i];
+			if (c & 0x80) break;
+			if (toUpper ? (c >= 'a' and c <= 'z') : (c >= 'A' and c <= 'Z')) c ^= 0x20;
+			out[i] = c;
+		}
+		return i;
+	}
+
+	// UTF8SequenceLength
+	//
+	//	Find the length of the well-formed UTF-8 character at the given position,
+	//	looking at no more than the given number of bytes.
+	//
+	// Gets:	c -- start of the character
+	//			avail -- bytes available from c to the end of the buffer
+	// Returns: length of the character in bytes, or 0 if it is not valid
+	//			UTF-8 (a stray continuation byte, or a truncated sequence)
+	static unsigned long UTF8SequenceLength(const unsigned char *c, unsigned long avail)
+	{
+		unsigned long len;
+		if (0 == (*c & 0x80)) return 1;
+		else if (0xC0 == (*c & 0xE0)) len = 2;
+		else if (0xE0 == (*c & 0xF0)) len = 3;
+		else if (0xF0 == (*c & 0xF8)) len = 4;
+		else return 0;
+		if (len > avail) return 0;
+		for (unsigned long i = 1; i < len; i++) {
+			if (not IsUTF8IntraChar(c[i])) return 0;
+		}
+		return len;
+	}
+
+	// UTF8ToCase
+	//
+	//	Converts a UTF8 String into upper or lower case, using the given case table.
+	//	Runs of ASCII text are converted by ASCIIToCase; anything else goes through
+	//	the table one character at a time.
 	//
-	// Author: AJB
-	// Used in: various
 	// Gets:	utf8String	-- the UTF8 String to convert
 	//			byteCount	-- the number of bytes long the String is
-	//			outBuf -- receives uppercase String in a newly created buffer (may be nil)
-	//			outByteCount -- receives the byte count of the uppercase String (may be nil)
+	//			outBuf -- receives converted String in a newly created buffer (may be nil)
+	//			outByteCount -- receives the byte count of the converted String (may be nil)
+	//			toUpper -- true to convert to upper case, false for lower case
 	// Returns: <nothing>
-	// Comment: Dec 23 2002 -- AJB (1)
-	void UTF8ToUpper( unsigned char *utf8String, unsigned long byteCount,
-					  unsigned char **outBuf, unsigned long *outByteCount )
+	static void UTF8ToCase( unsigned char *utf8String, unsigned long byteCount,
+						   unsigned char **outBuf, unsigned long *outByteCount, bool toUpper )
 	{
 		if (not outBuf and not outByteCount) return;
-		
+		if (!sMapsInitialized) InitCaseMaps();
+		const unsigned short **blocks = toUpper ? sToUpperBlocks : sToLowerBlocks;
+
 		// Note that the size of the buffer needed to hold the output text will never be larger
 		// than the input buffer, though it may sometimes be smaller.  This is because in some
 		// cases there are several upper-case equivalents for a lower-case letter, but when we
@@ -459,20 +549,39 @@ namespace MiniScript {
 		unsigned char *endOfOutputBuffer = retBuffer + retBufSize - 5;
 		
 		//	While we're not at the end of the input buffer
-		while (utf8String != endOfBuffer) {
-			//	Decode a character from the input String, convert it to uppercase
-			unsigned long uniChar = UnicodeCharToUpper( UTF8Decode( utf8String ) );
-			
+		while (utf8String < endOfBuffer) {
+			//	Convert any run of plain ASCII in bulk
+			unsigned long asciiBytes = ASCIIToCase(utf8String, curOutPos, endOfBuffer - utf8String, toUpper);
+			utf8String += asciiBytes;
+			curOutPos += asciiBytes;
+			if (utf8String >= endOfBuffer) break;
+
 			//	Sanity Check: make sure we're not writing out beyond the end of our allocated output buffer
 			if (curOutPos > endOfOutputBuffer) {
 				break;
 			}
 			
-			//	Encode the new letter, and advance out return string's buffer
-			curOutPos += UTF8Encode( uniChar, curOutPos );
+			//	Bytes that aren't valid UTF-8 (including a sequence cut off by the
+			//	end of the buffer) are copied through unchanged, one at a time
+			unsigned long charBytes = UTF8SequenceLength( utf8String, endOfBuffer - utf8String );
+			if (charBytes == 0) {
+				*curOutPos++ = *utf8String++;
+				continue;
+			}
+			
+			//	Decode a character from the input String (advancing past it), and convert it
+			unsigned char *charStart = utf8String;
+			unsigned long uniChar = UTF8DecodeAndAdvance( &utf8String );
+			unsigned long newChar = uniChar <= 0xFFFF ? CaseLookup(blocks, uniChar) : uniChar;
 			
-			//	Advance our input String
-			AdvanceUTF8( &utf8String, endOfBuffer, 1 );
+			//	Encode the new letter (or copy the original bytes, if it has no
+			//	other case), and advance our return string's buffer
+			if (newChar == uniChar) {
+				memcpy(curOutPos, charStart, charBytes);
+				curOutPos += charBytes;
+			} else {
+				curOutPos += UTF8Encode( newChar, curOutPos );
+			}
 		}
 		
 		//	Return the beginning of our output String, and length of output buffer used
@@ -481,6 +590,24 @@ namespace MiniScript {
 		if (outByteCount) *outByteCount = curOutPos - retBuffer;
 	}
 
+	// UTF8ToUpper
+	//
+	//	Converts a UTF8 String into uppercase
+	//
+	// Author: AJB
+	// Used in: various
+	// Gets:	utf8String	-- the UTF8 String to convert
+	//			byteCount	-- the number of bytes long the String is
+	//			outBuf -- receives uppercase String in a newly created buffer (may be nil)
+	//			outByteCount -- receives the byte count of the uppercase String (may be nil)
+	// Returns: <nothing>
+	// Comment: Dec 23 2002 -- AJB (1)
+	void UTF8ToUpper( unsigned char *utf8String, unsigned long byteCount,
+					  unsigned char **outBuf, unsigned long *outByteCount )
+	{
+		UTF8ToCase(utf8String, byteCount, outBuf, outByteCount, true);
+	}
+
 	// UTF8ToLower
 	//
 	//	Converts a UTF8 String into lowercase
@@ -496,45 +623,7 @@ namespace MiniScript {
 	void UTF8ToLower( unsigned char *utf8String, unsigned long byteCount,
 					  unsigned char **outBuf, unsigned long *outByteCount )
 	{
-		if (not outBuf and not outByteCount) return;
-
-		// Note that the size of the buffer needed to hold the output text will never be larger
-		// than the input buffer, though it may sometimes be smaller.  This is because in some
-		// cases there are several upper-case equivalents for a lower-case letter, but when we
-		// convert to upper-case, the "preferred" one is always the same size (in UTF-8) as
-		// the lower-case character.  This was verified by inspecting our case tables.
-		
-		//	Allocate a buffer to return
-		unsigned long retBufSize = byteCount + 5;						// Mar 03 2003 -- JJS (1)
-		unsigned char *retBuffer = new unsigned char[retBufSize];
-		//	Determine the end of the input buffer
-		unsigned char *endOfBuffer = utf8String + byteCount;
-		//	Keep track of our current position the return buffer
-		unsigned char *curOutPos = retBuffer;
-		//	Store the end of the output buffer (minus 5 to allow room for last char)
-		unsigned char *endOfOutputBuffer = retBuffer + retBufSize - 5;
-		
-		//	While we're not at the end of the input buffer
-		while (utf8String != endOfBuffer) {
-			//	Decode a character from the input String, convert it to lowercase
-			unsigned long uniChar = UnicodeCharToLower( UTF8Decode( utf8String ) );
-			
-			//	Sanity Check: make sure we're not writing out beyond the end of our allocated output buffer
-			if (curOutPos > endOfOutputBuffer) {
-				break;
-			}
-			
-			//	Encode the new letter, and advance out return string's buffer
-			curOutPos += UTF8Encode(uniChar, curOutPos);
-			
-			//	Advance our input String
-			AdvanceUTF8(&utf8String, endOfBuffer, 1);
-		}
-		
-		//	Return the beginning of our output String, and length of output buffer used
-		if (outBuf) *outBuf = retBuffer;
-		else delete[] retBuffer;
-		if (outByteCount) *outByteCount = curOutPos - retBuffer;
+		UTF8ToCase(utf8String, byteCount, outBuf, outByteCount, false);
 	}
 
 	// UTF8Capitalize
@@ -616,10 +705,10 @@ namespace MiniScript {
 		unsigned char *ptr = utf8String;
 		unsigned char *pend = utf8String + byteCount;
 		
+		if (!sMapsInitialized) InitCaseMaps();
 		while (ptr < pend) {
 			unsigned long uchar = UTF8DecodeAndAdvance( &ptr );
-			if (uchar <= 0xFFFF and 
-				(sLowerToUpperMap.ContainsKey((unsigned short)uchar ) or sUpperToLowerMap.ContainsKey((unsigned short)uchar))) {
+			if (uchar <= 0xFFFF and (sCasedBits[uchar >> 3] & (1 << (uchar & 7)))) {
 				// if it's in the upper or lower table, then it has case,
 				// hence this String is not caseless
 				return false;
@@ -864,6 +953,14 @@ namespace MiniScript {
 			UTF8Capitalize((unsigned char *)"aB c", 4, &buf, &bufSize);
 			Assert(buf and 4==bufSize and 'A'==buf[0] and 'b'==buf[1] and 'C'==buf[3]);
 			delete[] buf;
+
+			// long enough to go through the 8-bytes-at-a-time ASCII path, then non-ASCII
+			UTF8ToUpper((unsigned char *)"abcdefgh[@`{z\xC3\xA9", 15, &buf, &bufSize);
+			Assert(buf and 15==bufSize and 0==memcmp(buf, "ABCDEFGH[@`{Z\xC3\x89", 15));
+			delete[] buf;
+
+			Assert(UTF8IsCaseless((unsigned char *)"123 !?", 6));
+			Assert(not UTF8IsCaseless((unsigned char *)"12\xC3\xA9", 4));
 		}
 
 	}
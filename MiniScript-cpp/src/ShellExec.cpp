@@ -7,6 +7,8 @@
 //
 
 #include "ShellExec.h"
+#include <chrono>
+#include <vector>
 
 #if _WIN32 || _WIN64
 	#define WINDOWS 1
@@ -19,11 +21,29 @@
 #else
 	#include <unistd.h>	// for read()
 	#include <sys/wait.h>   // for waitpid()
+	#include <fcntl.h>
+	#include <poll.h>
+	#include <signal.h>
+	#include <errno.h>
 #endif
 
 
 namespace MiniScript {
 
+// Seconds on a steady clock (for child process time limits).
+static double Now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Trim a single \n or \r\n from the end of the given output.
+static String TrimFinalLineBreak(const String& s) {
+	long len = s.LengthB();
+	if (len == 0 or s.data()[len-1] != '\n') return s;
+	len--;
+	if (len > 0 and s.data()[len-1] == '\r') len--;
+	return s.SubstringB(0, len);
+}
+
 #if WINDOWS
 
 // Helper function to read from file descriptor into string
@@ -180,6 +200,48 @@ bool FinishExec(ValueList data, double currentTime, String* outStdout, String* o
 }
 
 
+ChildProcess::ChildProcess() : done(true), status(0) {}
+
+ChildProcess::~ChildProcess() {
+	Kill();
+}
+
+bool ChildProcess::Start(String cmd, double timeout) {
+	done = !BeginExec(cmd, timeout, Now(), &execData);
+	return !done;
+}
+
+void ChildProcess::PollAll(ChildProcess **procs, long count) {
+	for (long i=0; i<count; i++) {
+		ChildProcess *p = procs[i];
+		if (!p or p->done) continue;
+		String out, err;
+		int exitStatus;
+		if (FinishExec(p->execData, Now(), &out, &err, &exitStatus)) {
+			p->output = out;
+			p->errors = err;
+			p->Finish(exitStatus);
+		}
+	}
+}
+
+void ChildProcess::Kill() {
+	if (done) return;
+	TerminateProcess((HANDLE)execData[0].IntValue(), 137);
+	String out, err;
+	int exitStatus;
+	FinishExec(execData, Now(), &out, &err, &exitStatus);
+	output = out;
+	errors = err;
+	Finish(137);
+}
+
+void ChildProcess::Finish(int exitStatus) {
+	execData = ValueList();
+	status = exitStatus;
+	done = true;
+}
+
 #else
 
 // Helper function to read from file descriptor into string
@@ -303,6 +365,145 @@ bool FinishExec(ValueList data, double currentTime, String* outStdout, String* o
 	return true;
 }
 
+ChildProcess::ChildProcess() : done(true), status(0), pid(-1), deadline(0) {
+	pipes[0] = pipes[1] = -1;
+}
+
+ChildProcess::~ChildProcess() {
+	Kill();
+}
+
+bool ChildProcess::Start(String cmd, double timeout) {
+	int outPipe[2], errPipe[2];
+	if (pipe(outPipe) != 0) return false;
+	if (pipe(errPipe) != 0) {
+		close(outPipe[0]);
+		close(outPipe[1]);
+		return false;
+	}
+	pid = fork();
+	if (pid == 0) {
+		// Child process: send stdout and stderr to our pipes, and run the command
+		// (in a process group of its own, so Kill can stop everything it starts).
+		setpgid(0, 0);
+		dup2(outPipe[1], STDOUT_FILENO);
+		dup2(errPipe[1], STDERR_FILENO);
+		close(outPipe[0]); close(outPipe[1]);
+		close(errPipe[0]); close(errPipe[1]);
+		signal(SIGPIPE, SIG_DFL);
+		execl("/bin/sh", "sh", "-c", cmd.c_str(), (char*)nullptr);
+		_exit(127);
+	}
+	close(outPipe[1]);
+	close(errPipe[1]);
+	if (pid < 0) {
+		close(outPipe[0]);
+		close(errPipe[0]);
+		return false;
+	}
+	setpgid(pid, pid);	// (also here, so the group exists even if we Kill before the child runs)
+	
+	// Parent process: we'll read the pipes as data comes in, never blocking.
+	pipes[0] = outPipe[0];
+	pipes[1] = errPipe[0];
+	for (int i=0; i<2; i++) {
+		fcntl(pipes[i], F_SETFL, fcntl(pipes[i], F_GETFL) | O_NONBLOCK);
+		fcntl(pipes[i], F_SETFD, FD_CLOEXEC);	// (so later children don't inherit it)
+	}
+	deadline = Now() + timeout;
+	done = false;
+	return true;
+}
+
+// Read all that's available from one of our pipes.  Return false (and close
+// the pipe) once we reach the end of it.
+bool ChildProcess::ReadPipe(int which) {
+	char buf[4096];
+	while (pipes[which] >= 0) {
+		ssize_t got = read(pipes[which], buf, sizeof(buf));
+		if (got > 0) {
+			received[which].Append(buf, got);
+			continue;
+		}
+		if (got < 0 and errno == EINTR) continue;
+		if (got < 0 and (errno == EAGAIN or errno == EWOULDBLOCK)) return true;
+		close(pipes[which]);
+		pipes[which] = -1;
+	}
+	return false;
+}
+
+void ChildProcess::PollAll(ChildProcess **procs, long count) {
+	// Read whatever is ready on any of their pipes (without waiting for more).
+	std::vector<struct pollfd> fds;
+	std::vector<ChildProcess*> owners;
+	for (long i=0; i<count; i++) {
+		ChildProcess *p = procs[i];
+		if (!p or p->done) continue;
+		for (int which=0; which<2; which++) {
+			if (p->pipes[which] < 0) continue;
+			struct pollfd pfd;
+			pfd.fd = p->pipes[which];
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			fds.push_back(pfd);
+			owners.push_back(p);
+		}
+	}
+	if (!fds.empty() and poll(&fds[0], fds.size(), 0) > 0) {
+		for (size_t j=0; j<fds.size(); j++) {
+			if (fds[j].revents == 0) continue;
+			ChildProcess *p = owners[j];
+			p->ReadPipe(fds[j].fd == p->pipes[0] ? 0 : 1);
+		}
+	}
+	
+	// Then see which have finished, or run out of time.
+	double now = Now();
+	for (long i=0; i<count; i++) {
+		ChildProcess *p = procs[i];
+		if (!p or p->done) continue;
+		int waitStatus = 0;
+		pid_t waitResult = waitpid(p->pid, &waitStatus, WNOHANG);
+		if (waitResult == p->pid or (waitResult < 0 and errno != EINTR)) {
+			// Collect anything still in the pipes, and we're done.
+			p->ReadPipe(0);
+			p->ReadPipe(1);
+			int exitStatus = -1;
+			if (waitResult == p->pid) {
+				exitStatus = WIFEXITED(waitStatus) ? WEXITSTATUS(waitStatus) : 128 + WTERMSIG(waitStatus);
+			}
+			p->Finish(exitStatus);
+		} else if (now >= p->deadline) {
+			p->Kill();
+			p->errors = "Timed out";
+			p->status = 124;	// (124 is status code used by `timeout` command)
+		}
+	}
+}
+
+void ChildProcess::Kill() {
+	if (done) return;
+	kill(-pid, SIGKILL);	// (the whole process group: the shell, and whatever it started)
+	int waitStatus;
+	while (waitpid(pid, &waitStatus, 0) < 0 and errno == EINTR) {}
+	ReadPipe(0);
+	ReadPipe(1);
+	Finish(137);	// (128 + SIGKILL)
+}
+
+void ChildProcess::Finish(int exitStatus) {
+	for (int i=0; i<2; i++) {
+		if (pipes[i] >= 0) close(pipes[i]);
+		pipes[i] = -1;
+	}
+	output = TrimFinalLineBreak(received[0].ToString());
+	errors = TrimFinalLineBreak(received[1].ToString());
+	pid = -1;
+	status = exitStatus;
+	done = true;
+}
+
 #endif
 
 }  // end of namespace MiniScript
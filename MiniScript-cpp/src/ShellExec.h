@@ -10,6 +10,9 @@
 #define SHELLEXEC_H
 
 #include <stdio.h>
+#if !(_WIN32 || _WIN64)
+	#include <sys/types.h>
+#endif
 #include "SimpleString.h"
 #include "MiniscriptTypes.h"
 
@@ -24,6 +27,54 @@ bool BeginExec(String cmd, double timeout, double currentTime, ValueList* outRes
 // into output parameters and return true.  If not, return false.
 bool FinishExec(ValueList data, double currentTime, String* outStdout, String* outStderr, int* outStatus);
 
+// A child process running a shell command, whose output we collect as it
+// arrives (so a child with lots to say never stalls on a full pipe).  Start
+// as many as you like, then call PollAll now and then until they're Done.
+class ChildProcess {
+public:
+	ChildProcess();
+	~ChildProcess();		// (kills the child, if it's still running)
+
+	// Start running the given command.  Return false if we couldn't.
+	bool Start(String cmd, double timeout);
+
+	// Read whatever output is ready from all the given processes, and check
+	// which ones have finished (or run out of time, in which case they're killed).
+	static void PollAll(ChildProcess **procs, long count);
+	void Poll() { ChildProcess *self = this; PollAll(&self, 1); }
+
+	// Stop the child now (its status will be 137, as from SIGKILL).
+	void Kill();
+
+	bool Done() const { return done; }
+
+	// Results, once Done: output and errors (each without a final line
+	// break, as with exec), and the exit status.
+	String Output() const { return output; }
+	String Errors() const { return errors; }
+	int Status() const { return status; }
+
+private:
+	ChildProcess(const ChildProcess& other);			// (not copyable)
+	ChildProcess& operator= (const ChildProcess& other);
+
+	void Finish(int exitStatus);
+
+	bool done;
+	String output;
+	String errors;
+	int status;
+#if _WIN32 || _WIN64
+	ValueList execData;		// (from BeginExec)
+#else
+	bool ReadPipe(int which);
+	pid_t pid;
+	int pipes[2];			// read ends of the child's stdout and stderr (or -1)
+	StringBuilder received[2];
+	double deadline;
+#endif
+};
+
 
 
 }
@@ -19,9 +19,11 @@
 #include "MiniScript/MiniscriptInterpreter.h"
 #include "OstreamSupport.h"
 #include "MiniScript/SplitJoin.h"
+#include "MiniScript/SimpleRegex.h"
 #include "whereami/whereami.h"
 #include "DateTimeUtils.h"
 #include "ShellExec.h"
+#include "FileWatch.h"
 #include "Key.h"
 
 #include <cstdlib>
@@ -31,17 +33,20 @@
 #include <stdexcept>
 #include <array>
 #include <vector>
+#include <thread>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
 #if _WIN32 || _WIN64
 	#define WINDOWS 1
 	#include <windows.h>
 	#include <Shlwapi.h>
 	#include <Fileapi.h>
 	#include <direct.h>
+	#include <io.h>		// for _read and _isatty
 	#include <locale>
 	#include <codecvt>
 	#define getcwd _getcwd
@@ -58,6 +63,8 @@
 		#include <copyfile.h>
 	#else
 		#include <sys/sendfile.h>
+		#include <sys/ioctl.h>
+		#include <linux/fs.h>	// for FICLONE
 	#endif
 	#define PATHSEP '/'
 	#include <sys/wait.h>
@@ -74,52 +81,196 @@ bool exitASAP = false;
 int exitResult = 0;
 ValueList shellArgs;
 
-static Value _handle("_handle");
 static Value _MS_IMPORT_PATH("MS_IMPORT_PATH");
 
 static ValueDict getEnvMap();
 
-// RefCountedStorage class to wrap a FILE*
-class FileHandleStorage : public RefCountedStorage {
+static NativeClass& FileHandleClass();
+static NativeClass& RawDataClass();
+static NativeClass& ProcessClass();
+static NativeClass& FileWatchClass();
+
+// Native object wrapping a FILE*
+class FileHandleStorage : public NativeObject {
 public:
-	FileHandleStorage(FILE *file) : f(file) {}
+	FileHandleStorage(FILE *file) : NativeObject(FileHandleClass()), f(file) {}
 	virtual ~FileHandleStorage() { if (f) fclose(f); }
 
+	// Get the storage behind a file handle, or nullptr if the value isn't one.
+	static FileHandleStorage *Get(const Value& v) { return (FileHandleStorage*)NativeObject::Get(v, FileHandleClass()); }
+
 	FILE *f;
 };
 
-// RefCountedStorage class to wrap raw data
-class RawDataHandleStorage : public RefCountedStorage {
+// Native object wrapping raw data
+class RawDataHandleStorage : public NativeObject {
 public:
-	RawDataHandleStorage() : data(nullptr), dataSize(0) {}
-	RawDataHandleStorage(FILE *f) {
+	RawDataHandleStorage() : NativeObject(RawDataClass()), data(nullptr), dataSize(0), littleEndian(true) {}
+	RawDataHandleStorage(FILE *f) : NativeObject(RawDataClass()), littleEndian(true) {
 		fseek(f, 0, SEEK_END);
 		dataSize = ftell(f);
 		data = malloc(dataSize);
 		if (data) {
 			fseek(f, 0, SEEK_SET);
 			fread(data, 1, dataSize, f);
+			MemoryAccount::Charge((long)dataSize);
+		} else {
+			dataSize = 0;
 		}
 	}
-	virtual ~RawDataHandleStorage() { free(data); }
+	virtual ~RawDataHandleStorage() {
+		free(data);
+		MemoryAccount::Charge(-(long)dataSize);
+	}
 	void resize(size_t newSize) {
 		if (newSize == 0) {
 			free(data);
+			MemoryAccount::Charge(-(long)dataSize);
 			data = nullptr;
 			dataSize = 0;
 		} else {
 			void *newData = realloc(data, newSize);
 			if (newData) {
+				MemoryAccount::Charge((long)newSize - (long)dataSize);
 				data = newData;
 				dataSize = newSize;
 			}
 		}
 	}
 
+	// Get the storage behind a RawData object, or nullptr if the value isn't one.
+	static RawDataHandleStorage *Get(const Value& v) { return (RawDataHandleStorage*)NativeObject::Get(v, RawDataClass()); }
+
 	void *data;
 	size_t dataSize;
+	bool littleEndian;
+};
+
+// Native object wrapping a child process (from `spawn` or `execAll`)
+class ProcessHandleStorage : public NativeObject {
+public:
+	ProcessHandleStorage() : NativeObject(ProcessClass()) {}
+
+	// Get the storage behind a process handle, or nullptr if the value isn't one.
+	static ProcessHandleStorage *Get(const Value& v) { return (ProcessHandleStorage*)NativeObject::Get(v, ProcessClass()); }
+
+	ChildProcess proc;
+};
+
+// Native object wrapping a file watcher (from `file.watch`)
+class FileWatchStorage : public NativeObject {
+public:
+	FileWatchStorage() : NativeObject(FileWatchClass()) {}
+
+	// Get the storage behind a file watch handle, or nullptr if the value isn't one.
+	static FileWatchStorage *Get(const Value& v) { return (FileWatchStorage*)NativeObject::Get(v, FileWatchClass()); }
+
+	FileWatcher watcher;
+};
+
+// Buffered reader on standard input, for the stdin module (and `input`, when
+// stdin is not a terminal).  Reads file descriptor 0 directly, a big chunk at
+// a time, rather than going through iostream or editline; so there's no
+// per-line system call and no limit on line length.
+class StdinReader {
+public:
+	// Read the next line, without its line break (\n or \r\n).
+	// Return false if we're at the end of input.
+	static bool ReadLine(String *outLine) {
+		StringBuilder partial;		// (used only for lines that span a buffer refill)
+		bool gotAny = false;
+		while (true) {
+			const char *start = buf + bufStart;
+			const char *eol = (const char*)memchr(start, '\n', bufEnd - bufStart);
+			if (eol) {
+				size_t len = eol - start;
+				bufStart += len + 1;
+				if (partial.empty()) {
+					if (len > 0 and start[len-1] == '\r') len--;
+					*outLine = String(start, len);
+				} else {
+					partial.Append(start, len);
+					*outLine = StripCR(partial.ToString());
+				}
+				return true;
+			}
+			if (bufEnd > bufStart) {
+				partial.Append(start, bufEnd - bufStart);
+				gotAny = true;
+			}
+			bufStart = bufEnd;
+			if (!Fill()) {
+				if (!gotAny) return false;
+				*outLine = StripCR(partial.ToString());
+				return true;
+			}
+		}
+	}
+
+	// Read up to the given number of bytes (or all remaining input, if byteCount < 0).
+	static String Read(long byteCount) {
+		StringBuilder result;
+		while (byteCount != 0) {
+			if (bufStart == bufEnd and !Fill()) break;
+			size_t take = bufEnd - bufStart;
+			if (byteCount > 0 and (size_t)byteCount < take) take = byteCount;
+			result.Append(buf + bufStart, take);
+			bufStart += take;
+			if (byteCount > 0) byteCount -= take;
+		}
+		return result.ToString();
+	}
+
+	// Return whether we have input buffered that hasn't been consumed yet.
+	static bool HasBuffered() { return bufStart < bufEnd; }
+
+	static bool IsTerminal() {
+		#if WINDOWS
+			return _isatty(0) != 0;
+		#else
+			return isatty(0) != 0;
+		#endif
+	}
+
+private:
+	static const size_t bufSize = 64 * 1024;
+
+	// Refill the (fully consumed) buffer.  Return false at end of input.
+	static bool Fill() {
+		bufStart = bufEnd = 0;
+		if (atEOF) return false;
+		#if WINDOWS
+			int got = _read(0, buf, bufSize);
+		#else
+			ssize_t got;
+			do {
+				got = read(0, buf, bufSize);
+			} while (got < 0 and errno == EINTR);
+		#endif
+		if (got <= 0) {
+			atEOF = true;
+			return false;
+		}
+		bufEnd = got;
+		return true;
+	}
+
+	static String StripCR(const String& s) {
+		size_t len = s.LengthB();
+		if (len > 0 and s.data()[len-1] == '\r') return s.SubstringB(0, len-1);
+		return s;
+	}
+
+	static char buf[bufSize];
+	static size_t bufStart, bufEnd;		// unconsumed data is buf[bufStart] up to buf[bufEnd]
+	static bool atEOF;
 };
 
+char StdinReader::buf[StdinReader::bufSize];
+size_t StdinReader::bufStart = 0;
+size_t StdinReader::bufEnd = 0;
+bool StdinReader::atEOF = false;
+
 // hidden (unnamed) intrinsics, only accessible via other methods (such as the File module)
 Intrinsic *i_getcwd = nullptr;
 Intrinsic *i_chdir = nullptr;
@@ -146,6 +297,9 @@ Intrinsic *i_fread = nullptr;
 Intrinsic *i_freadLine = nullptr;
 Intrinsic *i_fposition = nullptr;
 Intrinsic *i_feof = nullptr;
+Intrinsic *i_watch = nullptr;
+Intrinsic *i_watchNext = nullptr;
+Intrinsic *i_watchClose = nullptr;
 
 Intrinsic *i_rawDataLen = nullptr;
 Intrinsic *i_rawDataResize = nullptr;
@@ -178,6 +332,25 @@ Intrinsic *i_keyAxis = nullptr;
 Intrinsic *i_keyPutInFront = nullptr;
 Intrinsic *i_keyEcho = nullptr;
 
+Intrinsic *i_regexMatch = nullptr;
+Intrinsic *i_regexFind = nullptr;
+Intrinsic *i_regexFindAll = nullptr;
+Intrinsic *i_regexReplace = nullptr;
+Intrinsic *i_regexSplit = nullptr;
+
+Intrinsic *i_tsvParse = nullptr;
+Intrinsic *i_tsvWrite = nullptr;
+Intrinsic *i_csvParse = nullptr;
+Intrinsic *i_csvWrite = nullptr;
+
+Intrinsic *i_processWait = nullptr;
+Intrinsic *i_processDone = nullptr;
+Intrinsic *i_processKill = nullptr;
+
+Intrinsic *i_stdinReadLine = nullptr;
+Intrinsic *i_stdinLines = nullptr;
+Intrinsic *i_stdinRead = nullptr;
+
 // Copy a file.  Return 0 on success, or some value < 0 on error.
 static int UnixishCopyFile(const char* source, const char* destination) {
 #if WINDOWS
@@ -196,9 +369,75 @@ static int UnixishCopyFile(const char* source, const char* destination) {
 	close(output);
 	return result;
 #else
-	// on Linux, the best way to copy a file with metadata is to let the shell do it:
-	String command = String("cp -p \"") + source + "\" \"" + destination + "\"";
-	return system(command.c_str());
+	// On Linux, copy in the kernel without passing the data through user space:
+	// first try a reflink (an instant copy-on-write clone, on filesystems that
+	// support it), then copy_file_range, then sendfile.  Then copy the mode,
+	// owner (if we can), and timestamps, as cp -p would.
+	int input = open(source, O_RDONLY | O_CLOEXEC);
+	if (input == -1) return -1;
+	struct stat st;
+	if (fstat(input, &st) != 0 or !S_ISREG(st.st_mode)) {
+		close(input);
+		return -1;
+	}
+	int output = open(destination, O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+	if (output == -1) {
+		close(input);
+		return -1;
+	}
+	// Refuse to copy a file onto itself (or onto another link to it), which
+	// would truncate it; only then is it safe to empty the destination.
+	struct stat outSt;
+	if (fstat(output, &outSt) != 0 or (outSt.st_dev == st.st_dev and outSt.st_ino == st.st_ino)
+			or ftruncate(output, 0) != 0) {
+		close(input);
+		close(output);
+		return -1;
+	}
+	bool ok = false;
+	#ifdef FICLONE
+		ok = (ioctl(output, FICLONE, input) == 0);
+	#endif
+	if (!ok) {
+		const size_t chunk = 1 << 30;
+		bool useSendfile = true;
+		#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+			useSendfile = false;
+		#endif
+		while (true) {
+			ssize_t copied;
+			if (useSendfile) {
+				copied = sendfile(output, input, nullptr, chunk);
+			} else {
+				#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+					copied = copy_file_range(input, nullptr, output, nullptr, chunk, 0);
+					if (copied < 0 and (errno == ENOSYS or errno == EXDEV or errno == EINVAL or errno == EOPNOTSUPP)) {
+						// (not supported for this pair of files; carry on with sendfile)
+						useSendfile = true;
+						continue;
+					}
+				#endif
+			}
+			if (copied < 0 and errno == EINTR) continue;
+			if (copied <= 0) {
+				ok = (copied == 0);
+				break;
+			}
+		}
+	}
+	if (ok) {
+		ok = (fchmod(output, st.st_mode & 07777) == 0);
+		if (fchown(output, st.st_uid, st.st_gid) != 0) { /* (fine; only root can do this in general) */ }
+		struct timespec times[2] = { st.st_atim, st.st_mtim };
+		futimens(output, times);
+	}
+	close(input);
+	if (close(output) != 0) ok = false;
+	if (!ok) {
+		unlink(destination);
+		return -1;
+	}
+	return 0;
 #endif
 }
 
@@ -256,14 +495,20 @@ static String ExpandVariables(String path) {
 	return path;
 }
 
-static ValueDict& FileHandleClass();
-static ValueDict& RawDataType();
 static ValueDict& KeyModule();
 
 static IntrinsicResult intrinsic_input(Context *context, IntrinsicResult partialResult) {
 	Value prompt = context->GetVar("prompt");
 	
 	#if useEditline
+		if (StdinReader::HasBuffered() or !StdinReader::IsTerminal()) {
+			// Input is piped (or already being read via the stdin module): skip
+			// editline, and read from the same buffer as the stdin module.
+			std::cout << prompt.ToString() << std::flush;
+			String s;
+			if (!StdinReader::ReadLine(&s)) return IntrinsicResult(Value::emptyString);
+			return IntrinsicResult(s);
+		}
 		char *buf;
 		buf = readline(prompt.ToString().c_str());
 		if (buf == nullptr) return IntrinsicResult(Value::emptyString);
@@ -271,13 +516,35 @@ static IntrinsicResult intrinsic_input(Context *context, IntrinsicResult partial
 		free(buf);
 		return IntrinsicResult(s);
 	#else
-		std::cout << prompt.ToString();
-		char buf[1024];
-		if (not std::cin.getline(buf, sizeof(buf))) return IntrinsicResult::Null;
-		return IntrinsicResult(String(buf));
+		std::cout << prompt.ToString() << std::flush;
+		String s;
+		if (!StdinReader::ReadLine(&s)) return IntrinsicResult::Null;
+		return IntrinsicResult(s);
 	#endif
 }
 
+static IntrinsicResult intrinsic_stdinReadLine(Context *context, IntrinsicResult partialResult) {
+	String line;
+	if (!StdinReader::ReadLine(&line)) return IntrinsicResult::Null;
+	return IntrinsicResult(line);
+}
+
+static IntrinsicResult intrinsic_stdinLines(Context *context, IntrinsicResult partialResult) {
+	long maxCount = context->GetVar("maxCount").IntValue();
+	ValueList list;
+	String line;
+	while (maxCount != 0 and StdinReader::ReadLine(&line)) {
+		list.Add(line);
+		if (maxCount > 0) maxCount--;
+	}
+	return IntrinsicResult(list);
+}
+
+static IntrinsicResult intrinsic_stdinRead(Context *context, IntrinsicResult partialResult) {
+	long bytesToRead = context->GetVar("byteCount").IntValue();
+	return IntrinsicResult(StdinReader::Read(bytesToRead));
+}
+
 static IntrinsicResult intrinsic_shellArgs(Context *context, IntrinsicResult partialResult) {
 	return IntrinsicResult(shellArgs);
 }
@@ -541,6 +808,11 @@ static IntrinsicResult intrinsic_rename(Context *context, IntrinsicResult partia
 	String oldPath = context->GetVar("oldPath").ToString();
 	String newPath = context->GetVar("newPath").ToString();
 	int err = rename(oldPath.c_str(), newPath.c_str());
+	if (err != 0 and errno == EXDEV) {
+		// Can't rename across filesystems; copy and then delete the original instead.
+		err = UnixishCopyFile(oldPath.c_str(), newPath.c_str());
+		if (err == 0) err = remove(oldPath.c_str());
+	}
 	return IntrinsicResult(Value::Truth(err == 0));
 }
 
@@ -583,23 +855,13 @@ static IntrinsicResult intrinsic_fopen(Context *context, IntrinsicResult partial
 	}
 	if (handle == nullptr) return IntrinsicResult::Null;
 	
-	ValueDict instance;
-	instance.SetValue(Value::magicIsA, FileHandleClass());
-	
-	Value fileWrapper = Value::NewHandle(new FileHandleStorage(handle));
-	instance.SetValue(_handle, fileWrapper);
-	
-	Value result(instance);
-	instance.SetValue(result, fileWrapper);
-	
-	return IntrinsicResult(result);
+	return IntrinsicResult(Value::NewHandle(new FileHandleStorage(handle)));
 }
 
 static IntrinsicResult intrinsic_fclose(Context *context, IntrinsicResult partialResult) {
 	Value self = context->GetVar("self");
-	Value fileWrapper = self.Lookup(_handle);
-	if (fileWrapper.IsNull() or fileWrapper.type != ValueType::Handle) return IntrinsicResult::Null;
-	FileHandleStorage *storage = (FileHandleStorage*)fileWrapper.data.ref;
+	FileHandleStorage *storage = FileHandleStorage::Get(self);
+	if (!storage) return IntrinsicResult::Null;
 	FILE *handle = storage->f;
 	if (handle == nullptr) return IntrinsicResult(Value::zero);
 	fclose(handle);
@@ -609,35 +871,41 @@ static IntrinsicResult intrinsic_fclose(Context *context, IntrinsicResult partia
 
 static IntrinsicResult intrinsic_isOpen(Context *context, IntrinsicResult partialResult) {
 	Value self = context->GetVar("self");
-	Value fileWrapper = self.Lookup(_handle);
-	if (fileWrapper.IsNull() or fileWrapper.type != ValueType::Handle) return IntrinsicResult::Null;
-	FileHandleStorage *storage = (FileHandleStorage*)fileWrapper.data.ref;
+	FileHandleStorage *storage = FileHandleStorage::Get(self);
+	if (!storage) return IntrinsicResult::Null;
 	return IntrinsicResult(Value::Truth(storage->f != nullptr));
 }
 
+// Write the given data to a file: a StringBuilder is written straight from
+// its buffer; anything else is converted to a string first.
+static size_t WriteData(Context *context, Value data, FILE *handle) {
+	StringBuilderStorage *sb = StringBuilderStorage::Get(data);
+	if (sb) return fwrite(sb->data(), 1, sb->LengthB(), handle);
+	String s = data.ToString();
+	return fwrite(s.c_str(), 1, s.sizeB(), handle);
+}
+
 static IntrinsicResult intrinsic_fwrite(Context *context, IntrinsicResult partialResult) {
 	Value self = context->GetVar("self");
-	String data = context->GetVar("data").ToString();
+	Value data = context->GetVar("data");
 
-	Value fileWrapper = self.Lookup(_handle);
-	if (fileWrapper.IsNull() or fileWrapper.type != ValueType::Handle) return IntrinsicResult::Null;
-	FileHandleStorage *storage = (FileHandleStorage*)fileWrapper.data.ref;
+	FileHandleStorage *storage = FileHandleStorage::Get(self);
+	if (!storage) return IntrinsicResult::Null;
 	FILE *handle = storage->f;
 	if (handle == nullptr) return IntrinsicResult(Value::zero);
 
-	size_t written = fwrite(data.c_str(), 1, data.sizeB(), handle);
+	size_t written = WriteData(context, data, handle);
 	return IntrinsicResult((int)written);
 }
 
 static IntrinsicResult intrinsic_fwriteLine(Context *context, IntrinsicResult partialResult) {
 	Value self = context->GetVar("self");
-	String data = context->GetVar("data").ToString();
-	Value fileWrapper = self.Lookup(_handle);
-	if (fileWrapper.IsNull() or fileWrapper.type != ValueType::Handle) return IntrinsicResult::Null;
-	FileHandleStorage *storage = (FileHandleStorage*)fileWrapper.data.ref;
+	Value data = context->GetVar("data");
+	FileHandleStorage *storage = FileHandleStorage::Get(self);
+	if (!storage) return IntrinsicResult::Null;
 	FILE *handle = storage->f;
 	if (handle == nullptr) return IntrinsicResult(Value::zero);
-	size_t written = fwrite(data.c_str(), 1, data.sizeB(), handle);
+	size_t written = WriteData(context, data, handle);
 	written += fwrite("\n", 1, 1, handle);
 	return IntrinsicResult((int)written);
 }
@@ -660,9 +928,8 @@ static IntrinsicResult intrinsic_fread(Context *context, IntrinsicResult partial
 	long bytesToRead = context->GetVar("byteCount").IntValue();
 	if (bytesToRead == 0) return IntrinsicResult(Value::emptyString);
 
-	Value fileWrapper = self.Lookup(_handle);
-	if (fileWrapper.IsNull() or fileWrapper.type != ValueType::Handle) return IntrinsicResult::Null;
-	FileHandleStorage *storage = (FileHandleStorage*)fileWrapper.data.ref;
+	FileHandleStorage *storage = FileHandleStorage::Get(self);
+	if (!storage) return IntrinsicResult::Null;
 	FILE *handle = storage->f;
 	if (handle == nullptr) return IntrinsicResult(Value::zero);
 	
@@ -673,9 +940,8 @@ static IntrinsicResult intrinsic_fread(Context *context, IntrinsicResult partial
 static IntrinsicResult intrinsic_fposition(Context *context, IntrinsicResult partialResult) {
 	Value self = context->GetVar("self");
 	
-	Value fileWrapper = self.Lookup(_handle);
-	if (fileWrapper.IsNull() or fileWrapper.type != ValueType::Handle) return IntrinsicResult::Null;
-	FileHandleStorage *storage = (FileHandleStorage*)fileWrapper.data.ref;
+	FileHandleStorage *storage = FileHandleStorage::Get(self);
+	if (!storage) return IntrinsicResult::Null;
 	FILE *handle = storage->f;
 	if (handle == nullptr) return IntrinsicResult::Null;
 
@@ -685,9 +951,8 @@ static IntrinsicResult intrinsic_fposition(Context *context, IntrinsicResult par
 static IntrinsicResult intrinsic_feof(Context *context, IntrinsicResult partialResult) {
 	Value self = context->GetVar("self");
 	
-	Value fileWrapper = self.Lookup(_handle);
-	if (fileWrapper.IsNull() or fileWrapper.type != ValueType::Handle) return IntrinsicResult::Null;
-	FileHandleStorage *storage = (FileHandleStorage*)fileWrapper.data.ref;
+	FileHandleStorage *storage = FileHandleStorage::Get(self);
+	if (!storage) return IntrinsicResult::Null;
 	FILE *handle = storage->f;
 	if (handle == nullptr) return IntrinsicResult::Null;
 
@@ -698,9 +963,8 @@ static IntrinsicResult intrinsic_feof(Context *context, IntrinsicResult partialR
 
 static IntrinsicResult intrinsic_freadLine(Context *context, IntrinsicResult partialResult) {
 	Value self = context->GetVar("self");
-	Value fileWrapper = self.Lookup(_handle);
-	if (fileWrapper.IsNull() or fileWrapper.type != ValueType::Handle) return IntrinsicResult::Null;
-	FileHandleStorage *storage = (FileHandleStorage*)fileWrapper.data.ref;
+	FileHandleStorage *storage = FileHandleStorage::Get(self);
+	if (!storage) return IntrinsicResult::Null;
 	FILE *handle = storage->f;
 	if (handle == nullptr) return IntrinsicResult::Null;
 
@@ -757,6 +1021,57 @@ static IntrinsicResult intrinsic_readLines(Context *context, IntrinsicResult par
 	return IntrinsicResult(list);
 }
 
+static IntrinsicResult intrinsic_watch(Context *context, IntrinsicResult partialResult) {
+	Value paths = context->GetVar("paths");
+	bool recursive = context->GetVar("recursive").BoolValue();
+	ValueList list;
+	if (paths.type == ValueType::List) list = paths.GetList();
+	else list.Add(paths);
+	
+	FileWatchStorage *storage = new FileWatchStorage();
+	Value handle = Value::NewHandle(storage);
+	bool watchingAny = false;
+	for (long i=0; i<list.Count(); i++) {
+		if (storage->watcher.Add(list[i].ToString(), recursive)) watchingAny = true;
+	}
+	if (!watchingAny) return IntrinsicResult::Null;
+	return IntrinsicResult(handle);
+}
+
+// Longest we'll block in one call to watch.next, before returning control to
+// the host (and coming back to wait some more).
+static const long kWatchSliceMs = 100;
+
+static IntrinsicResult intrinsic_watchNext(Context *context, IntrinsicResult partialResult) {
+	FileWatchStorage *storage = FileWatchStorage::Get(context->GetVar("self"));
+	if (!storage) return IntrinsicResult::Null;
+	
+	// Our partial result is the time we give up (or -1 to wait forever).
+	double now = context->vm->RunTime();
+	double deadline;
+	if (partialResult.Done()) {
+		double timeout = context->GetVar("timeout").DoubleValue();
+		deadline = timeout < 0 ? -1 : now + timeout;
+	} else {
+		deadline = partialResult.Result().DoubleValue();
+	}
+	long waitMs = kWatchSliceMs;
+	if (deadline >= 0 and (deadline - now) * 1000 < waitMs) waitMs = (long)((deadline - now) * 1000);
+	if (waitMs < 0) waitMs = 0;
+	
+	ValueList events;
+	if (!storage->watcher.Read(waitMs, &events)) return IntrinsicResult::Null;
+	if (events.Count() > 0) return IntrinsicResult(events);
+	if (deadline >= 0 and context->vm->RunTime() >= deadline) return IntrinsicResult(events);
+	return IntrinsicResult(Value(deadline), false);
+}
+
+static IntrinsicResult intrinsic_watchClose(Context *context, IntrinsicResult partialResult) {
+	FileWatchStorage *storage = FileWatchStorage::Get(context->GetVar("self"));
+	if (storage) storage->watcher.Close();
+	return IntrinsicResult::Null;
+}
+
 static IntrinsicResult intrinsic_writeLines(Context *context, IntrinsicResult partialResult) {
 	Value self = context->GetVar("self");
 	String path = context->GetVar("path").ToString();
@@ -788,28 +1103,16 @@ static IntrinsicResult intrinsic_loadRaw(Context *context, IntrinsicResult parti
 	String path = context->GetVar("path").ToString();
 	FILE *f = fopen(path.c_str(), "rb");
 	if (f == nullptr) return IntrinsicResult::Null;
-	Value dataWrapper = Value::NewHandle(new RawDataHandleStorage(f));
-	ValueDict instance;
-	instance.SetValue(Value::magicIsA, RawDataType());
-	instance.SetValue(_handle, dataWrapper);
-	Value result(instance);
+	Value result = Value::NewHandle(new RawDataHandleStorage(f));
+	fclose(f);
 	return IntrinsicResult(result);
 }
 
 static IntrinsicResult intrinsic_saveRaw(Context *context, IntrinsicResult partialResult) {
 	String path = context->GetVar("path").ToString();
 	Value rawData = context->GetVar("rawData");
-	if (!rawData.IsA(RawDataType(), context->vm)) {
-		Value errMsg("Error: RawData parameter is required");
-		return IntrinsicResult(errMsg);
-	}
-	Value dataWrapper = rawData.Lookup(_handle);
-	if (dataWrapper.IsNull() or dataWrapper.type != ValueType::Handle) {
-		Value errMsg("Error: RawData parameter is required");
-		return IntrinsicResult(errMsg);
-	}
-	RawDataHandleStorage *storage = (RawDataHandleStorage*)dataWrapper.data.ref;
-	if (storage->dataSize == 0) {
+	RawDataHandleStorage *storage = RawDataHandleStorage::Get(rawData);
+	if (!storage or storage->dataSize == 0) {
 		Value errMsg("Error: RawData parameter is required");
 		return IntrinsicResult(errMsg);
 	}
@@ -830,9 +1133,8 @@ static IntrinsicResult intrinsic_saveRaw(Context *context, IntrinsicResult parti
 
 static IntrinsicResult intrinsic_rawDataLen(Context *context, IntrinsicResult partialResult) {
 	Value self = context->GetVar("self");
-	Value dataWrapper = self.Lookup(_handle);
-	if (dataWrapper.IsNull() or dataWrapper.type != ValueType::Handle) return IntrinsicResult(Value((double)0));
-	RawDataHandleStorage *storage = (RawDataHandleStorage*)dataWrapper.data.ref;
+	RawDataHandleStorage *storage = RawDataHandleStorage::Get(self);
+	if (!storage) return IntrinsicResult(Value((double)0));
 	return IntrinsicResult(storage->dataSize);
 }
 
@@ -842,12 +1144,8 @@ static IntrinsicResult intrinsic_rawDataResize(Context *context, IntrinsicResult
 	if (nBytes < 0) {
 		IndexException(String("bytes parameter must be >= 0")).raise();
 	}
-	Value dataWrapper = self.Lookup(_handle);
-	if (dataWrapper.IsNull() or dataWrapper.type != ValueType::Handle) {
-		dataWrapper = Value::NewHandle(new RawDataHandleStorage());
-		self.GetDict().SetValue(_handle, dataWrapper);
-	}
-	RawDataHandleStorage *storage = (RawDataHandleStorage*)dataWrapper.data.ref;
+	RawDataHandleStorage *storage = RawDataHandleStorage::Get(self);
+	if (!storage) TypeException("Type Error: RawData required").raise();
 	storage->resize(nBytes);
 	return IntrinsicResult::Null;
 }
@@ -896,10 +1194,16 @@ static void bufWriteWord(unsigned char *buf, size_t nBytes, bool isLittleEndian,
 
 enum RawDataNotAvailable { rdnaNull, rdnaRaise, rdnaAdjust };
 
+// rawDataLittleEndian: Returns whether the given RawData reads and writes words little-end first.
+static bool rawDataLittleEndian(const Value& rawData) {
+	RawDataHandleStorage *storage = RawDataHandleStorage::Get(rawData);
+	return storage ? storage->littleEndian : true;
+}
+
 // rawDataGetBytes: Returns a pointer to a fragment of RawData's memory, also checks that `nBytes` are available.
 static unsigned char *rawDataGetBytes(Value& rawData, long& offset, long& nBytes, RawDataNotAvailable na = rdnaRaise) {
-	Value dataWrapper = rawData.Lookup(_handle);
-	if (dataWrapper.IsNull() or dataWrapper.type != ValueType::Handle) {
+	RawDataHandleStorage *storage = RawDataHandleStorage::Get(rawData);
+	if (!storage) {
 		switch (na) {
 			case rdnaNull:
 				return nullptr;
@@ -907,7 +1211,6 @@ static unsigned char *rawDataGetBytes(Value& rawData, long& offset, long& nBytes
 				IndexException(String("Index Error (index out of range)")).raise();
 		}
 	}
-	RawDataHandleStorage *storage = (RawDataHandleStorage*)dataWrapper.data.ref;
 	if (offset < 0) offset += storage->dataSize;
 	if (offset < 0 or offset > storage->dataSize) {
 		IndexException(String("Index Error (index out of range)")).raise();
@@ -929,7 +1232,7 @@ static unsigned char *rawDataGetBytes(Value& rawData, long& offset, long& nBytes
 static Value rawDataGetInteger(Context *context, long nBytes, bool isSigned) {
 	Value self = context->GetVar("self");
 	long offset = context->GetVar("offset").IntValue();
-	bool isLittleEndian = self.Lookup("littleEndian").BoolValue();
+	bool isLittleEndian = rawDataLittleEndian(self);
 	unsigned char *data = rawDataGetBytes(self, offset, nBytes);
 	uint64_t word = bufReadWord(data, nBytes, isLittleEndian);
 	if (!isSigned) return Value(word);
@@ -968,7 +1271,7 @@ static Value rawDataGetInteger(Context *context, long nBytes, bool isSigned) {
 static void rawDataSetInteger(Context *context, long nBytes, bool isSigned) {
 	Value self = context->GetVar("self");
 	long offset = context->GetVar("offset").IntValue();
-	bool littleEndian = self.Lookup("littleEndian").BoolValue();
+	bool littleEndian = rawDataLittleEndian(self);
 	unsigned char *data = rawDataGetBytes(self, offset, nBytes);
 	union {
 		uint64_t u;
@@ -985,7 +1288,7 @@ static void rawDataSetInteger(Context *context, long nBytes, bool isSigned) {
 static Value rawDataGetReal(Context *context, long nBytes) {
 	Value self = context->GetVar("self");
 	long offset = context->GetVar("offset").IntValue();
-	bool isLittleEndian = self.Lookup("littleEndian").BoolValue();
+	bool isLittleEndian = rawDataLittleEndian(self);
 	unsigned char *data = rawDataGetBytes(self, offset, nBytes);
 	uint64_t word = bufReadWord(data, nBytes, isLittleEndian);
 	switch (nBytes) {
@@ -1014,7 +1317,7 @@ static Value rawDataGetReal(Context *context, long nBytes) {
 static void rawDataSetReal(Context *context, long nBytes) {
 	Value self = context->GetVar("self");
 	long offset = context->GetVar("offset").IntValue();
-	bool littleEndian = self.Lookup("littleEndian").BoolValue();
+	bool littleEndian = rawDataLittleEndian(self);
 	unsigned char *data = rawDataGetBytes(self, offset, nBytes);
 	switch (nBytes) {
 		case 4:
@@ -1205,6 +1508,15 @@ static IntrinsicResult intrinsic_keyEcho(Context *context, IntrinsicResult parti
 }
 
 
+// Result map for a finished command: output, errors, and (exit) status.
+static ValueDict ExecResult(const String& output, const String& errors, int status) {
+	ValueDict result;
+	result.SetValue("output", Value(output));
+	result.SetValue("errors", Value(errors));
+	result.SetValue("status", Value(status));
+	return result;
+}
+
 static IntrinsicResult intrinsic_exec(Context *context, IntrinsicResult partialResult) {
 	double now = context->vm->RunTime();
 	if (partialResult.Done()) {
@@ -1226,17 +1538,598 @@ static IntrinsicResult intrinsic_exec(Context *context, IntrinsicResult partialR
 	int status = -1;
 	if (FinishExec(data, now, &stdOut, &stdErr, &status)) {
 		// All done!
-		ValueDict result;
-		result.SetValue("output", Value(stdOut));
-		result.SetValue("errors", Value(stdErr));
-		result.SetValue("status", Value(status));
-		return IntrinsicResult(result);
+		return IntrinsicResult(ExecResult(stdOut, stdErr, status));
 	} else {
 		// Not done yet.
 		return IntrinsicResult(data, false);
 	}
 }
 
+static IntrinsicResult intrinsic_spawn(Context *context, IntrinsicResult partialResult) {
+	String cmd = context->GetVar("cmd").ToString();
+	double timeout = context->GetVar("timeout").DoubleValue();
+	ProcessHandleStorage *storage = new ProcessHandleStorage();
+	Value handle = Value::NewHandle(storage);
+	if (!storage->proc.Start(cmd, timeout)) return IntrinsicResult::Null;
+	return IntrinsicResult(handle);
+}
+
+static IntrinsicResult intrinsic_processWait(Context *context, IntrinsicResult partialResult) {
+	ProcessHandleStorage *storage = ProcessHandleStorage::Get(context->GetVar("self"));
+	if (!storage) return IntrinsicResult::Null;
+	storage->proc.Poll();
+	if (!storage->proc.Done()) return IntrinsicResult(Value::one, false);	// (check again next time)
+	ChildProcess& proc = storage->proc;
+	return IntrinsicResult(ExecResult(proc.Output(), proc.Errors(), proc.Status()));
+}
+
+static IntrinsicResult intrinsic_processDone(Context *context, IntrinsicResult partialResult) {
+	ProcessHandleStorage *storage = ProcessHandleStorage::Get(context->GetVar("self"));
+	if (!storage) return IntrinsicResult::Null;
+	storage->proc.Poll();
+	return IntrinsicResult(Value::Truth(storage->proc.Done()));
+}
+
+static IntrinsicResult intrinsic_processKill(Context *context, IntrinsicResult partialResult) {
+	ProcessHandleStorage *storage = ProcessHandleStorage::Get(context->GetVar("self"));
+	if (storage) storage->proc.Kill();
+	return IntrinsicResult::Null;
+}
+
+static IntrinsicResult intrinsic_execAll(Context *context, IntrinsicResult partialResult) {
+	// Our partial result is a list: [commands, results, process handles, index of
+	// the next command to start].  Each process handle goes back to null when
+	// that process is finished (and its result map is in results).
+	ValueList state;
+	if (partialResult.Done()) {
+		Value commands = context->GetVar("commands");
+		if (commands.type != ValueType::List) TypeException("Type Error: execAll requires a list of commands").raise();
+		long count = commands.GetList().Count();
+		ValueList results(count), procs(count);
+		for (long i=0; i<count; i++) {
+			results.Add(Value::null);
+			procs.Add(Value::null);
+		}
+		state.Add(commands);
+		state.Add(results);
+		state.Add(procs);
+		state.Add(Value::zero);
+	} else {
+		state = partialResult.Result().GetList();
+	}
+	ValueList commands = state[0].GetList();
+	ValueList results = state[1].GetList();
+	ValueList procs = state[2].GetList();
+	long next = state[3].IntValue();
+	long count = commands.Count();
+	long maxParallel = context->GetVar("maxParallel").IntValue();
+	if (maxParallel <= 0) maxParallel = std::thread::hardware_concurrency();
+	if (maxParallel <= 0) maxParallel = 4;
+	
+	// Find the processes still running, and start more, up to our limit.
+	std::vector<ChildProcess*> running;
+	std::vector<long> runningIndex;
+	for (long i=0; i<next; i++) {
+		ProcessHandleStorage *storage = ProcessHandleStorage::Get(procs[i]);
+		if (!storage) continue;
+		running.push_back(&storage->proc);
+		runningIndex.push_back(i);
+	}
+	double timeout = context->GetVar("timeout").DoubleValue();
+	for (; next < count and (long)running.size() < maxParallel; next++) {
+		ProcessHandleStorage *storage = new ProcessHandleStorage();
+		Value handle = Value::NewHandle(storage);
+		if (!storage->proc.Start(commands[next].ToString(), timeout)) continue;	// (result stays null)
+		procs[next] = handle;
+		running.push_back(&storage->proc);
+		runningIndex.push_back(next);
+	}
+	state[3] = Value((double)next);
+	
+	// Then check on them all at once, and collect the results of any that are done.
+	if (!running.empty()) ChildProcess::PollAll(&running[0], running.size());
+	bool allDone = (next == count);
+	for (size_t j=0; j<running.size(); j++) {
+		ChildProcess *proc = running[j];
+		if (!proc->Done()) {
+			allDone = false;
+			continue;
+		}
+		results[runningIndex[j]] = ExecResult(proc->Output(), proc->Errors(), proc->Status());
+		procs[runningIndex[j]] = Value::null;
+	}
+	if (allDone) return IntrinsicResult(results);
+	return IntrinsicResult(state, false);
+}
+
+// regex module
+
+static ValueDict regexCache;	// pattern string -> Regex handle
+static const long kMaxRegexCacheSize = 500;
+
+// Get the compiled form of the given pattern, compiling (and caching) it if needed.
+static Regex *GetRegex(Value pattern) {
+	if (pattern.type != ValueType::String) TypeException("Type Error: regex pattern must be a string").raise();
+	Value cached;
+	if (regexCache.Get(pattern, &cached)) return (Regex*)cached.data.ref;
+	String err;
+	Regex *re = Regex::Compile(pattern.ToString(), &err);
+	if (!re) RuntimeException(String("regex: ") + err + " in pattern \"" + pattern.ToString() + "\"").raise();
+	if (regexCache.Count() >= kMaxRegexCacheSize) regexCache = ValueDict();
+	regexCache.SetValue(pattern, Value::NewHandle(re));
+	return re;
+}
+
+// Converts byte offsets in a UTF-8 string to character indexes, efficiently
+// when asked about increasing offsets (as when walking through matches).
+class CharIndexer {
+public:
+	CharIndexer(const char *text) : text(text), lastB(0), lastC(0) {}
+	long operator()(long posB) {
+		if (posB < lastB) { lastB = 0; lastC = 0; }
+		for (; lastB < posB; lastB++) {
+			if (((unsigned char)text[lastB] & 0xC0) != 0x80) lastC++;
+		}
+		return lastC;
+	}
+private:
+	const char *text;
+	long lastB, lastC;
+};
+
+// Build the map describing one match: start and end (character indexes),
+// text, groups (a list, with null for groups that didn't take part), and
+// named (a map of group name to text, if the pattern has named groups).
+static Value RegexMatchMap(Regex *re, const String& s, long *caps, CharIndexer& indexer) {
+	ValueDict m;
+	long startC = indexer(caps[0]);
+	m.SetValue("start", startC);
+	m.SetValue("end", startC + CharIndexer(s.c_str() + caps[0])(caps[1] - caps[0]));
+	m.SetValue("text", s.SubstringB(caps[0], caps[1] - caps[0]));
+	ValueList groups;
+	ValueDict named;
+	for (int g=1; g <= re->GroupCount(); g++) {
+		Value text;
+		if (caps[g*2] >= 0) text = s.SubstringB(caps[g*2], caps[g*2+1] - caps[g*2]);
+		groups.Add(text);
+		String name = re->GroupName(g);
+		if (!name.empty()) named.SetValue(name, text);
+	}
+	m.SetValue("groups", groups);
+	if (named.Count() > 0) m.SetValue("named", named);
+	return m;
+}
+
+// Byte position just past the character at posB (used to step over empty matches).
+static long NextCharB(const String& s, long posB) {
+	long len = s.LengthB();
+	if (posB >= len) return len + 1;
+	posB++;
+	while (posB < len and (s[posB] & 0xC0) == 0x80) posB++;
+	return posB;
+}
+
+static IntrinsicResult intrinsic_regexMatch(Context *context, IntrinsicResult partialResult) {
+	String s = context->GetVar("s").ToString();
+	Regex *re = GetRegex(context->GetVar("pattern"));
+	long caps[2 * 100];
+	SimpleVector<long> bigCaps;
+	long *c = caps;
+	if (re->GroupCount() >= 100) { bigCaps.resize((re->GroupCount()+1)*2); c = &bigCaps[0]; }
+	if (!re->Search(s.c_str(), s.LengthB(), 0, c, Regex::Mode::Full)) return IntrinsicResult::Null;
+	CharIndexer indexer(s.c_str());
+	return IntrinsicResult(RegexMatchMap(re, s, c, indexer));
+}
+
+static IntrinsicResult intrinsic_regexFind(Context *context, IntrinsicResult partialResult) {
+	String s = context->GetVar("s").ToString();
+	Regex *re = GetRegex(context->GetVar("pattern"));
+	long start = context->GetVar("start").IntValue();
+	if (start < 0) start += s.Length();
+	if (start < 0 or start > s.Length()) return IntrinsicResult::Null;
+	long caps[2 * 100];
+	SimpleVector<long> bigCaps;
+	long *c = caps;
+	if (re->GroupCount() >= 100) { bigCaps.resize((re->GroupCount()+1)*2); c = &bigCaps[0]; }
+	if (!re->Search(s.c_str(), s.LengthB(), s.bytePosOfCharPos(start), c)) return IntrinsicResult::Null;
+	CharIndexer indexer(s.c_str());
+	return IntrinsicResult(RegexMatchMap(re, s, c, indexer));
+}
+
+static IntrinsicResult intrinsic_regexFindAll(Context *context, IntrinsicResult partialResult) {
+	String s = context->GetVar("s").ToString();
+	Regex *re = GetRegex(context->GetVar("pattern"));
+	SimpleVector<long> caps;
+	caps.resize((re->GroupCount()+1)*2);
+	CharIndexer indexer(s.c_str());
+	ValueList result;
+	long len = s.LengthB();
+	long posB = 0;
+	while (posB <= len and re->Search(s.c_str(), len, posB, &caps[0])) {
+		result.Add(RegexMatchMap(re, s, &caps[0], indexer));
+		posB = (caps[1] > caps[0]) ? caps[1] : NextCharB(s, caps[1]);
+	}
+	return IntrinsicResult(result);
+}
+
+// Append the replacement text for one match, expanding $0-$99, ${name}, and $$.
+static void AppendReplacement(StringBuilder& out, const String& repl, Regex *re, const String& s, long *caps) {
+	const char *r = repl.c_str();
+	long rlen = repl.LengthB();
+	for (long i=0; i<rlen; i++) {
+		if (r[i] != '$' or i + 1 >= rlen) { out.Append(r[i]); continue; }
+		char next = r[i+1];
+		int group = -1;
+		if (next == '$') {
+			out.Append('$');
+			i++;
+			continue;
+		} else if (next >= '0' and next <= '9') {
+			group = next - '0';
+			i++;
+			if (i + 1 < rlen and r[i+1] >= '0' and r[i+1] <= '9' and group * 10 + (r[i+1] - '0') <= re->GroupCount()) {
+				group = group * 10 + (r[++i] - '0');
+			}
+		} else if (next == '{') {
+			long close = i + 2;
+			while (close < rlen and r[close] != '}') close++;
+			if (close >= rlen) { out.Append(r[i]); continue; }
+			String name(r + i + 2, close - i - 2);
+			for (int g=1; g <= re->GroupCount(); g++) {
+				if (re->GroupName(g) == name) { group = g; break; }
+			}
+			if (group < 0) RuntimeException(String("regex: no group named '") + name + "'").raise();
+			i = close;
+		} else {
+			out.Append(r[i]);
+			continue;
+		}
+		if (group > re->GroupCount()) RuntimeException(String("regex: no group ") + String::Format(group)).raise();
+		if (caps[group*2] >= 0) out.Append(s.c_str() + caps[group*2], caps[group*2+1] - caps[group*2]);
+	}
+}
+
+static IntrinsicResult intrinsic_regexReplace(Context *context, IntrinsicResult partialResult) {
+	String s = context->GetVar("s").ToString();
+	Regex *re = GetRegex(context->GetVar("pattern"));
+	String repl = context->GetVar("replacement").ToString();
+	long maxCount = context->GetVar("maxCount").IntValue();
+	SimpleVector<long> caps;
+	caps.resize((re->GroupCount()+1)*2);
+	StringBuilder out(s.LengthB());
+	const char *text = s.c_str();
+	long len = s.LengthB();
+	long posB = 0;		// where to search next
+	long copiedB = 0;	// how much of s has been copied to out
+	long count = 0;
+	while ((maxCount < 0 or count < maxCount) and posB <= len and re->Search(text, len, posB, &caps[0])) {
+		out.Append(text + copiedB, caps[0] - copiedB);
+		AppendReplacement(out, repl, re, s, &caps[0]);
+		copiedB = caps[1];
+		count++;
+		posB = (caps[1] > caps[0]) ? caps[1] : NextCharB(s, caps[1]);
+		if (out.LengthB() > (size_t)Value::maxStringSize) LimitExceededException("string too large").raise();
+	}
+	if (count == 0) return IntrinsicResult(s);
+	out.Append(text + copiedB, len - copiedB);
+	return IntrinsicResult(out.ToString());
+}
+
+static IntrinsicResult intrinsic_regexSplit(Context *context, IntrinsicResult partialResult) {
+	String s = context->GetVar("s").ToString();
+	Regex *re = GetRegex(context->GetVar("pattern"));
+	long maxCount = context->GetVar("maxCount").IntValue();
+	SimpleVector<long> caps;
+	caps.resize((re->GroupCount()+1)*2);
+	ValueList result;
+	const char *text = s.c_str();
+	long len = s.LengthB();
+	long posB = 0;		// where to search next
+	long pieceB = 0;	// start of the current piece
+	while ((maxCount <= 0 or result.Count() < maxCount - 1) and posB <= len and re->Search(text, len, posB, &caps[0])) {
+		if (caps[1] == caps[0]) {
+			// An empty match splits between characters, but not at the very ends.
+			if (caps[0] == 0 or caps[0] >= len) { posB = NextCharB(s, caps[1]); continue; }
+		}
+		result.Add(s.SubstringB(pieceB, caps[0] - pieceB));
+		pieceB = caps[1];
+		posB = (caps[1] > caps[0]) ? caps[1] : NextCharB(s, caps[1]);
+	}
+	result.Add(s.SubstringB(pieceB, len - pieceB));
+	return IntrinsicResult(result);
+}
+
+// tsv and csv modules
+
+// Parses delimited text (TSV or CSV), fed to it in chunks of any size.
+// A field that begins with a double quote is quoted: it runs to the next
+// lone quote ("" stands for a literal quote), and may contain delimiters
+// and line breaks.  Lines may end in LF, CRLF, or CR; blank lines are
+// skipped.  Rows come out as lists, or (with useHeader) as maps keyed by
+// the values in the first row, which all rows share.  With convertNumbers,
+// unquoted fields that look like numbers become numbers.
+class DelimitedParser {
+public:
+	DelimitedParser(char delimiter, bool useHeader, bool convertNumbers)
+	: delimiter(delimiter), useHeader(useHeader), convertNumbers(convertNumbers),
+	  state(stFieldStart), fieldQuoted(false), rowHasContent(false), skipLF(false), haveHeader(false) {}
+
+	void Feed(const char *data, size_t len);
+	void Finish();
+
+	ValueList rows;
+
+private:
+	enum State { stFieldStart, stUnquoted, stQuoted, stQuoteInQuoted };
+
+	void EndField();
+	void EndRow();
+	Value FieldValue();
+
+	char delimiter;
+	bool useHeader;
+	bool convertNumbers;
+	State state;
+	StringBuilder field;	// text of the current field so far
+	bool fieldQuoted;
+	bool rowHasContent;
+	bool skipLF;			// true just after a CR, so a following LF is ignored
+	ValueList fields;		// completed fields of the current row
+	ValueList header;
+	bool haveHeader;
+};
+
+void DelimitedParser::Feed(const char *data, size_t len) {
+	const char *p = data, *end = data + len;
+	if (skipLF and p < end) {
+		if (*p == '\n') p++;
+		skipLF = false;
+	}
+	while (p < end) {
+		char c = *p;
+		switch (state) {
+			case stFieldStart:
+				if (c == '"') {
+					state = stQuoted;
+					fieldQuoted = rowHasContent = true;
+					p++;
+					continue;
+				}
+				state = stUnquoted;
+				// fall through...
+			case stUnquoted: {
+				// Copy the run of ordinary characters all at once.
+				const char *runStart = p;
+				while (p < end and *p != delimiter and *p != '\n' and *p != '\r') p++;
+				if (p > runStart) {
+					field.Append(runStart, p - runStart);
+					rowHasContent = true;
+				}
+				if (p == end) continue;
+				c = *p++;
+				if (c == delimiter) {
+					rowHasContent = true;
+					EndField();
+				} else {
+					EndRow();
+					if (c == '\r') {
+						if (p == end) skipLF = true;
+						else if (*p == '\n') p++;
+					}
+				}
+			} break;
+			case stQuoted: {
+				const char *runStart = p;
+				while (p < end and *p != '"') p++;
+				field.Append(runStart, p - runStart);
+				if (p < end) {
+					state = stQuoteInQuoted;
+					p++;
+				}
+			} break;
+			case stQuoteInQuoted:
+				if (c == '"') {
+					// Doubled quote: a literal quote, and we're still in the quoted part.
+					field.Append('"');
+					state = stQuoted;
+					p++;
+				} else {
+					// End of the quoted part; anything up to the delimiter is appended as-is.
+					state = stUnquoted;
+				}
+				break;
+		}
+	}
+}
+
+void DelimitedParser::Finish() {
+	if (rowHasContent) EndRow();
+}
+
+Value DelimitedParser::FieldValue() {
+	size_t len = field.LengthB();
+	if (len == 0) return Value::emptyString;
+	const char *s = field.data();
+	if (convertNumbers and not fieldQuoted and len < 64) {
+		// Accept only plain decimal notation (no hex, inf, nan, or spaces).
+		bool isNumber = true, anyDigit = false;
+		for (size_t i=0; i<len and isNumber; i++) {
+			char c = s[i];
+			if (c >= '0' and c <= '9') anyDigit = true;
+			else if (c == '.' or c == 'e' or c == 'E') {}
+			else if ((c == '-' or c == '+') and (i == 0 or s[i-1] == 'e' or s[i-1] == 'E')) {}
+			else isNumber = false;
+		}
+		if (isNumber and anyDigit) {
+			char buf[64];
+			memcpy(buf, s, len);
+			buf[len] = 0;
+			char *numEnd;
+			double d = strtod(buf, &numEnd);
+			if (numEnd == buf + len) return Value(d);
+		}
+	}
+	return Value(String(s, len));
+}
+
+void DelimitedParser::EndField() {
+	if (useHeader and not haveHeader) fields.Add(String(field.data(), field.LengthB()));
+	else fields.Add(FieldValue());
+	field.Clear();
+	fieldQuoted = false;
+	state = stFieldStart;
+}
+
+void DelimitedParser::EndRow() {
+	if (!rowHasContent) {
+		state = stFieldStart;
+		return;	// (blank line)
+	}
+	EndField();
+	if (!useHeader) {
+		rows.Add(fields);
+	} else if (!haveHeader) {
+		header = fields;
+		haveHeader = true;
+	} else {
+		ValueDict row;
+		long fieldCount = fields.Count();
+		for (long i=0; i<header.Count(); i++) {
+			row.SetValue(header[i], i < fieldCount ? fields[i] : Value::null);
+		}
+		rows.Add(row);
+	}
+	fields = ValueList();
+	rowHasContent = false;
+}
+
+// Parse delimited text from a string, RawData object, or open file (read
+// from its current position in chunks).
+static IntrinsicResult DelimitedParse(Context *context, char delimiter) {
+	Value source = context->GetVar("source");
+	DelimitedParser parser(delimiter, context->GetVar("header").BoolValue(), context->GetVar("convertNumbers").BoolValue());
+	FileHandleStorage *file = FileHandleStorage::Get(source);
+	RawDataHandleStorage *rawData = RawDataHandleStorage::Get(source);
+	if (source.type == ValueType::String) {
+		String s = source.ToString();
+		parser.Feed(s.c_str(), s.LengthB());
+	} else if (file) {
+		FILE *handle = file->f;
+		if (handle == nullptr) return IntrinsicResult::Null;
+		const size_t chunkSize = 64 * 1024;
+		char *buf = new char[chunkSize];
+		size_t got;
+		while ((got = fread(buf, 1, chunkSize, handle)) > 0) parser.Feed(buf, got);
+		delete[] buf;
+	} else if (rawData) {
+		parser.Feed((const char*)rawData->data, rawData->dataSize);
+	} else if (!source.IsNull()) {
+		TypeException("Type Error: source must be a string, RawData, or open file").raise();
+	}
+	parser.Finish();
+	return IntrinsicResult(parser.rows);
+}
+
+static void AppendDelimitedField(StringBuilder& out, Value v, char delimiter, Machine *vm) {
+	if (v.type != ValueType::String) {
+		if (!v.IsNull()) v.AppendString(out, vm);
+		return;
+	}
+	String s = v.ToString();
+	const char *c = s.c_str();
+	size_t len = s.LengthB();
+	bool needsQuotes = false;
+	for (size_t i=0; i<len and !needsQuotes; i++) {
+		needsQuotes = (c[i] == delimiter or c[i] == '"' or c[i] == '\n' or c[i] == '\r');
+	}
+	if (!needsQuotes) {
+		out.Append(c, len);
+		return;
+	}
+	out.Append('"');
+	for (size_t i=0; i<len; i++) {
+		if (c[i] == '"') out.Append('"');
+		out.Append(c[i]);
+	}
+	out.Append('"');
+}
+
+static void AppendDelimitedRow(StringBuilder& out, ValueList fields, char delimiter, Machine *vm) {
+	for (long i=0; i<fields.Count(); i++) {
+		if (i > 0) out.Append(delimiter);
+		AppendDelimitedField(out, fields[i], delimiter, vm);
+	}
+	out.Append('\n');
+}
+
+// Write rows (lists, or maps with the given columns) as delimited text, to
+// an open file or (if no file is given) to a string that we return.  A
+// header line of column names comes first if there are columns; they
+// default to the keys of the first row, when that is a map.
+static IntrinsicResult DelimitedWrite(Context *context, char delimiter) {
+	Value rowsVal = context->GetVar("rows");
+	Value dest = context->GetVar("dest");
+	Value columnsVal = context->GetVar("columns");
+	if (rowsVal.type != ValueType::List) TypeException("Type Error: rows must be a list").raise();
+	ValueList rows = rowsVal.GetList();
+	FILE *handle = nullptr;
+	if (!dest.IsNull()) {
+		FileHandleStorage *file = FileHandleStorage::Get(dest);
+		if (!file) TypeException("Type Error: dest must be an open file").raise();
+		handle = file->f;
+		if (handle == nullptr) return IntrinsicResult::Null;
+	}
+	
+	ValueList columns;
+	if (columnsVal.type == ValueType::List) columns = columnsVal.GetList();
+	else if (rows.Count() > 0 and rows[0].type == ValueType::Map) columns = rows[0].GetDict().Keys();
+	
+	StringBuilder out;
+	const size_t flushSize = 64 * 1024;
+	if (columns.Count() > 0) AppendDelimitedRow(out, columns, delimiter, context->vm);
+	ValueList fields;
+	for (long r=0; r<rows.Count(); r++) {
+		Value row = rows[r];
+		if (row.type == ValueType::Map) {
+			ValueDict d = row.GetDict();
+			fields.Clear();
+			for (long i=0; i<columns.Count(); i++) fields.Add(d.Lookup(columns[i], Value::null));
+			AppendDelimitedRow(out, fields, delimiter, context->vm);
+		} else if (row.type == ValueType::List) {
+			AppendDelimitedRow(out, row.GetList(), delimiter, context->vm);
+		} else {
+			TypeException("Type Error: each row must be a list or map").raise();
+		}
+		if (handle and out.LengthB() >= flushSize) {
+			fwrite(out.data(), 1, out.LengthB(), handle);
+			out.Clear();
+		} else if (!handle and out.LengthB() > (size_t)Value::maxStringSize) {
+			LimitExceededException("string too large").raise();
+		}
+	}
+	if (handle) {
+		fwrite(out.data(), 1, out.LengthB(), handle);
+		return IntrinsicResult::Null;
+	}
+	return IntrinsicResult(out.ToString());
+}
+
+static IntrinsicResult intrinsic_tsvParse(Context *context, IntrinsicResult partialResult) {
+	return DelimitedParse(context, '\t');
+}
+
+static IntrinsicResult intrinsic_tsvWrite(Context *context, IntrinsicResult partialResult) {
+	return DelimitedWrite(context, '\t');
+}
+
+static IntrinsicResult intrinsic_csvParse(Context *context, IntrinsicResult partialResult) {
+	return DelimitedParse(context, ',');
+}
+
+static IntrinsicResult intrinsic_csvWrite(Context *context, IntrinsicResult partialResult) {
+	return DelimitedWrite(context, ',');
+}
+
 static bool disallowAssignment(ValueDict& dict, Value key, Value value) {
 	return true;
 }
@@ -1262,6 +2155,7 @@ static IntrinsicResult intrinsic_File(Context *context, IntrinsicResult partialR
 		fileModule.SetValue("writeLines", i_writeLines->GetFunc());
 		fileModule.SetValue("loadRaw", i_loadRaw->GetFunc());
 		fileModule.SetValue("saveRaw", i_saveRaw->GetFunc());
+		fileModule.SetValue("watch", i_watch->GetFunc());
 		fileModule.SetAssignOverride(disallowAssignment);
 	}
 	
@@ -1269,20 +2163,20 @@ static IntrinsicResult intrinsic_File(Context *context, IntrinsicResult partialR
 }
 
 
-static ValueDict& FileHandleClass() {
-	static ValueDict result;
-	if (result.Count() == 0) {
-		result.SetValue("close", i_fclose->GetFunc());
-		result.SetValue("isOpen", i_isOpen->GetFunc());
-		result.SetValue("write", i_fwrite->GetFunc());
-		result.SetValue("writeLine", i_fwriteLine->GetFunc());
-		result.SetValue("read", i_fread->GetFunc());
-		result.SetValue("readLine", i_freadLine->GetFunc());
-		result.SetValue("position", i_fposition->GetFunc());
-		result.SetValue("atEnd", i_feof->GetFunc());
+static NativeClass& FileHandleClass() {
+	static NativeClass cls("FileHandle");
+	if (cls.classMap.Count() == 0) {
+		cls.AddMethod("close", i_fclose->GetFunc());
+		cls.AddMethod("isOpen", i_isOpen->GetFunc());
+		cls.AddMethod("write", i_fwrite->GetFunc());
+		cls.AddMethod("writeLine", i_fwriteLine->GetFunc());
+		cls.AddMethod("read", i_fread->GetFunc());
+		cls.AddMethod("readLine", i_freadLine->GetFunc());
+		cls.AddMethod("position", i_fposition->GetFunc());
+		cls.AddMethod("atEnd", i_feof->GetFunc());
 	}
 	
-	return result;
+	return cls;
 }
 
 
@@ -1325,38 +2219,138 @@ static IntrinsicResult intrinsic_Key(Context *context, IntrinsicResult partialRe
 	return IntrinsicResult(KeyModule());
 }
 
+static ValueDict& RegexModule() {
+	static ValueDict regexModule;
+	
+	if (regexModule.Count() == 0) {
+		regexModule.SetValue("match", i_regexMatch->GetFunc());
+		regexModule.SetValue("find", i_regexFind->GetFunc());
+		regexModule.SetValue("findAll", i_regexFindAll->GetFunc());
+		regexModule.SetValue("replace", i_regexReplace->GetFunc());
+		regexModule.SetValue("split", i_regexSplit->GetFunc());
+		regexModule.SetAssignOverride(disallowAssignment);
+	}
+	
+	return regexModule;
+}
+
+static IntrinsicResult intrinsic_Regex(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(RegexModule());
+}
 
-static ValueDict& RawDataType() {
-	static ValueDict result;
-	if (result.Count() == 0) {
-		result.SetValue("littleEndian", Value::Truth(true));
-		result.SetValue("len", i_rawDataLen->GetFunc());
-		result.SetValue("resize", i_rawDataResize->GetFunc());
-		result.SetValue("byte", i_rawDataByte->GetFunc());
-		result.SetValue("setByte", i_rawDataSetByte->GetFunc());
-		result.SetValue("sbyte", i_rawDataSbyte->GetFunc());
-		result.SetValue("setSbyte", i_rawDataSetSbyte->GetFunc());
-		result.SetValue("ushort", i_rawDataUshort->GetFunc());
-		result.SetValue("setUshort", i_rawDataSetUshort->GetFunc());
-		result.SetValue("short", i_rawDataShort->GetFunc());
-		result.SetValue("setShort", i_rawDataSetShort->GetFunc());
-		result.SetValue("uint", i_rawDataUint->GetFunc());
-		result.SetValue("setUint", i_rawDataSetUint->GetFunc());
-		result.SetValue("int", i_rawDataInt->GetFunc());
-		result.SetValue("setInt", i_rawDataSetInt->GetFunc());
-		result.SetValue("float", i_rawDataFloat->GetFunc());
-		result.SetValue("setFloat", i_rawDataSetFloat->GetFunc());
-		result.SetValue("double", i_rawDataDouble->GetFunc());
-		result.SetValue("setDouble", i_rawDataSetDouble->GetFunc());
-		result.SetValue("utf8", i_rawDataUtf8->GetFunc());
-		result.SetValue("setUtf8", i_rawDataSetUtf8->GetFunc());
+static ValueDict& TsvModule() {
+	static ValueDict tsvModule;
+	
+	if (tsvModule.Count() == 0) {
+		tsvModule.SetValue("parse", i_tsvParse->GetFunc());
+		tsvModule.SetValue("write", i_tsvWrite->GetFunc());
+		tsvModule.SetAssignOverride(disallowAssignment);
 	}
 	
-	return result;
+	return tsvModule;
+}
+
+static IntrinsicResult intrinsic_Tsv(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(TsvModule());
+}
+
+static ValueDict& CsvModule() {
+	static ValueDict csvModule;
+	
+	if (csvModule.Count() == 0) {
+		csvModule.SetValue("parse", i_csvParse->GetFunc());
+		csvModule.SetValue("write", i_csvWrite->GetFunc());
+		csvModule.SetAssignOverride(disallowAssignment);
+	}
+	
+	return csvModule;
+}
+
+static IntrinsicResult intrinsic_Csv(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(CsvModule());
+}
+
+static NativeClass& FileWatchClass() {
+	static NativeClass cls("FileWatch");
+	if (cls.classMap.Count() == 0) {
+		cls.AddMethod("next", i_watchNext->GetFunc());
+		cls.AddMethod("close", i_watchClose->GetFunc());
+	}
+	
+	return cls;
+}
+
+static NativeClass& ProcessClass() {
+	static NativeClass cls("Process");
+	if (cls.classMap.Count() == 0) {
+		cls.AddMethod("wait", i_processWait->GetFunc());
+		cls.AddMethod("done", i_processDone->GetFunc());
+		cls.AddMethod("kill", i_processKill->GetFunc());
+	}
+	
+	return cls;
+}
+
+static ValueDict& StdinModule() {
+	static ValueDict stdinModule;
+	
+	if (stdinModule.Count() == 0) {
+		stdinModule.SetValue("readLine", i_stdinReadLine->GetFunc());
+		stdinModule.SetValue("lines", i_stdinLines->GetFunc());
+		stdinModule.SetValue("read", i_stdinRead->GetFunc());
+		stdinModule.SetAssignOverride(disallowAssignment);
+	}
+	
+	return stdinModule;
+}
+
+static IntrinsicResult intrinsic_Stdin(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(StdinModule());
+}
+
+static NativeObject *NewRawData() {
+	return new RawDataHandleStorage();
+}
+
+static Value rawDataGetLittleEndian(NativeObject *obj) {
+	return Value::Truth(((RawDataHandleStorage*)obj)->littleEndian);
+}
+
+static void rawDataSetLittleEndian(NativeObject *obj, Value value) {
+	((RawDataHandleStorage*)obj)->littleEndian = value.BoolValue();
+}
+
+static NativeClass& RawDataClass() {
+	static NativeClass cls("RawData", &NewRawData);
+	if (cls.classMap.Count() == 0) {
+		cls.AddProperty("littleEndian", &rawDataGetLittleEndian, &rawDataSetLittleEndian);
+		cls.AddMethod("len", i_rawDataLen->GetFunc());
+		cls.AddMethod("resize", i_rawDataResize->GetFunc());
+		cls.AddMethod("byte", i_rawDataByte->GetFunc());
+		cls.AddMethod("setByte", i_rawDataSetByte->GetFunc());
+		cls.AddMethod("sbyte", i_rawDataSbyte->GetFunc());
+		cls.AddMethod("setSbyte", i_rawDataSetSbyte->GetFunc());
+		cls.AddMethod("ushort", i_rawDataUshort->GetFunc());
+		cls.AddMethod("setUshort", i_rawDataSetUshort->GetFunc());
+		cls.AddMethod("short", i_rawDataShort->GetFunc());
+		cls.AddMethod("setShort", i_rawDataSetShort->GetFunc());
+		cls.AddMethod("uint", i_rawDataUint->GetFunc());
+		cls.AddMethod("setUint", i_rawDataSetUint->GetFunc());
+		cls.AddMethod("int", i_rawDataInt->GetFunc());
+		cls.AddMethod("setInt", i_rawDataSetInt->GetFunc());
+		cls.AddMethod("float", i_rawDataFloat->GetFunc());
+		cls.AddMethod("setFloat", i_rawDataSetFloat->GetFunc());
+		cls.AddMethod("double", i_rawDataDouble->GetFunc());
+		cls.AddMethod("setDouble", i_rawDataSetDouble->GetFunc());
+		cls.AddMethod("utf8", i_rawDataUtf8->GetFunc());
+		cls.AddMethod("setUtf8", i_rawDataSetUtf8->GetFunc());
+	}
+	
+	return cls;
 }
 
 static IntrinsicResult intrinsic_RawData(Context *context, IntrinsicResult partialResult) {
-	return IntrinsicResult(RawDataType());
+	return IntrinsicResult(RawDataClass().classMap);
 }
 
 static void setEnvVar(const char* key, const char* value) {
@@ -1393,6 +2387,108 @@ static ValueDict getEnvMap() {
 	return envMap;
 }
 
+// Get the modification time and size of the given file.
+// Return false if there's no such file.
+bool GetFileStamp(const String& path, double *outModTime, double *outSize) {
+#if _WIN32 || _WIN64
+	struct _stati64 stats;
+	if (_stati64(path.c_str(), &stats) != 0) return false;
+#else
+	struct stat stats;
+	if (stat(path.c_str(), &stats) < 0) return false;
+#endif
+	*outModTime = (double)stats.st_mtime;
+	*outSize = (double)stats.st_size;
+	return true;
+}
+
+// Add to outNames the names of the modules imported by the given source with
+// a literal name (i.e. `import "foo"`), which is nearly all of them.
+static void ScanImports(const String& source, ValueList& outNames) {
+	const char *src = source.c_str();
+	for (const char *p = strstr(src, "import"); p; p = strstr(p + 6, "import")) {
+		if (p > src and (isalnum((unsigned char)p[-1]) or p[-1] == '_')) continue;
+		const char *q = p + 6;
+		while (*q == ' ' or *q == '\t') q++;
+		if (*q == '(') q++;
+		while (*q == ' ' or *q == '\t') q++;
+		if (*q != '"') continue;
+		const char *nameEnd = strchr(q + 1, '"');
+		if (nameEnd and nameEnd > q + 1) outNames.Add(String(q + 1, nameEnd - q - 1));
+	}
+}
+
+// Import modules we have already read and parsed, by file path.  Each entry is
+// a list: [modification time, size, import function, names of modules it imports].
+static ValueDict importCache;
+
+// Find the given module on the import path, and return its importCache entry,
+// reading and parsing it first if it's new or has changed since last time.
+// Return an empty list if there's no such module.
+static ValueList FindImport(const String& libname) {
+	// Figure out what directories to look for the import modules in.
+	Value searchPath = getEnvMap().Lookup(_MS_IMPORT_PATH, Value::null);
+	StringList libDirs;
+	if (!searchPath.IsNull()) libDirs = Split(searchPath.ToString(), ":");
+	
+	// Search the lib dirs for a matching file.
+	for (long i=0, len=libDirs.Count(); i<len; i++) {
+		String path = libDirs[i];
+		if (path.empty()) path = ".";
+		else if (path[path.LengthB() - 1] != PATHSEP) path += String(PATHSEP);
+		path += libname + ".ms";
+		path = ExpandVariables(path);
+		double modTime, size;
+		if (!GetFileStamp(path, &modTime, &size)) continue;
+		
+		Value cached;
+		if (importCache.Get(path, &cached)) {
+			ValueList entry = cached.GetList();
+			if (entry[0].DoubleValue() == modTime and entry[1].DoubleValue() == size) return entry;
+		}
+		
+		FILE *handle = fopen(path.c_str(), "r");
+		if (handle == nullptr) continue;
+		String moduleSource = ReadFileHelper(handle, -1);
+		fclose(handle);
+		
+		// Parse that code, and build a function around it that returns
+		// its own locals as its result.
+		Parser parser;
+		parser.errorContext = libname + ".ms";
+		parser.Parse(moduleSource);
+		ValueList entry;
+		entry.Add(modTime);
+		entry.Add(size);
+		entry.Add(Value(parser.CreateImport()));
+		ValueList imports;
+		ScanImports(moduleSource, imports);
+		entry.Add(imports);
+		importCache.SetValue(path, entry);
+		return entry;
+	}
+	return ValueList();
+}
+
+void PreloadImports(const String& source) {
+	ValueList pending;
+	ScanImports(source, pending);
+	ValueDict seen;
+	while (pending.Count() > 0) {
+		Value libname = pending.Pop();
+		if (seen.ContainsKey(libname)) continue;
+		seen.SetValue(libname, Value::one);
+		try {
+			ValueList entry = FindImport(libname.ToString());
+			if (entry.Count() == 0) continue;
+			ValueList imports = entry[3].GetList();
+			for (long i=0; i<imports.Count(); i++) pending.Add(imports[i]);
+		} catch (MiniscriptException& mse) {
+			// Never mind; the script will report this when it gets to the import.
+		}
+	}
+}
+
 static IntrinsicResult intrinsic_import(Context *context, IntrinsicResult partialResult) {
 	if (!partialResult.Result().IsNull()) {
 		// When we're invoked with a partial result, it means that the import
@@ -1415,37 +2511,13 @@ static IntrinsicResult intrinsic_import(Context *context, IntrinsicResult partia
 		RuntimeException("import: libname required").raise();
 	}
 	
-	// Figure out what directories to look for the import modules in.
-	Value searchPath = getEnvMap().Lookup(_MS_IMPORT_PATH, Value::null);
-	StringList libDirs;
-	if (!searchPath.IsNull()) libDirs = Split(searchPath.ToString(), ":");
-	
-	// Search the lib dirs for a matching file.
-	String moduleSource;
-	bool found = false;
-	for (long i=0, len=libDirs.Count(); i<len; i++) {
-		String path = libDirs[i];
-		if (path.empty()) path = ".";
-		else if (path[path.LengthB() - 1] != PATHSEP) path += String(PATHSEP);
-		path += libname + ".ms";
-		path = ExpandVariables(path);
-		FILE *handle = fopen(path.c_str(), "r");
-		if (handle == nullptr) continue;
-		moduleSource = ReadFileHelper(handle, -1);
-		fclose(handle);
-		found = true;
-		break;
-	}
-	if (!found) {
+	ValueList entry = FindImport(libname);
+	if (entry.Count() == 0) {
 		RuntimeException("import: library not found: " + libname).raise();
 	}
 	
-	// Now, parse that code, and build a function around it that returns
-	// its own locals as its result.  Push a manual call.
-	Parser parser;
-	parser.errorContext = libname + ".ms";
-	parser.Parse(moduleSource);
-	FunctionStorage *import = parser.CreateImport();
+	// Push a manual call to the import function (which returns its own locals).
+	FunctionStorage *import = (FunctionStorage*)entry[2].data.ref;
 	context->vm->ManuallyPushCall(import, Value::Temp(0));
 	
 	// That call will not be able to run until we return from this intrinsic.
@@ -1515,6 +2587,9 @@ void AddShellIntrinsics() {
 	f->AddParam("prompt", "");
 	f->code = &intrinsic_input;
 
+	f = Intrinsic::Create("stdin");
+	f->code = &intrinsic_Stdin;
+
 	f = Intrinsic::Create("import");
 	f->AddParam("libname", "");
 	f->code = &intrinsic_import;
@@ -1613,6 +2688,18 @@ void AddShellIntrinsics() {
 	i_fposition = Intrinsic::Create("");
 	i_fposition->code = &intrinsic_fposition;
 	
+	i_watch = Intrinsic::Create("");
+	i_watch->AddParam("paths");
+	i_watch->AddParam("recursive", 0);
+	i_watch->code = &intrinsic_watch;
+	
+	i_watchNext = Intrinsic::Create("");
+	i_watchNext->AddParam("timeout", -1);
+	i_watchNext->code = &intrinsic_watchNext;
+	
+	i_watchClose = Intrinsic::Create("");
+	i_watchClose->code = &intrinsic_watchClose;
+	
 	i_readLines = Intrinsic::Create("");
 	i_readLines->AddParam("path");
 	i_readLines->code = &intrinsic_readLines;
@@ -1636,11 +2723,40 @@ void AddShellIntrinsics() {
 	f->AddParam("timeout", 30);
 	f->code = &intrinsic_exec;
 	
+	f = Intrinsic::Create("execAll");
+	f->AddParam("commands");
+	f->AddParam("maxParallel", 0);
+	f->AddParam("timeout", 30);
+	f->code = &intrinsic_execAll;
+	
+	f = Intrinsic::Create("spawn");
+	f->AddParam("cmd");
+	f->AddParam("timeout", 30);
+	f->code = &intrinsic_spawn;
+	
+	i_processWait = Intrinsic::Create("");
+	i_processWait->code = &intrinsic_processWait;
+	
+	i_processDone = Intrinsic::Create("");
+	i_processDone->code = &intrinsic_processDone;
+	
+	i_processKill = Intrinsic::Create("");
+	i_processKill->code = &intrinsic_processKill;
+	
 	f = Intrinsic::Create("RawData");
 	f->code = &intrinsic_RawData;
 	
 	f = Intrinsic::Create("key");
 	f->code = &intrinsic_Key;
+
+	f = Intrinsic::Create("regex");
+	f->code = &intrinsic_Regex;
+
+	f = Intrinsic::Create("tsv");
+	f->code = &intrinsic_Tsv;
+
+	f = Intrinsic::Create("csv");
+	f->code = &intrinsic_Csv;
 	
 	
 	// RawData methods
@@ -1790,4 +2906,88 @@ void AddShellIntrinsics() {
 	
 	// END key.* methods
 	
+	
+	// regex.* methods
+	
+	i_regexMatch = Intrinsic::Create("");
+	i_regexMatch->AddParam("s", "");
+	i_regexMatch->AddParam("pattern", "");
+	i_regexMatch->code = &intrinsic_regexMatch;
+	
+	i_regexFind = Intrinsic::Create("");
+	i_regexFind->AddParam("s", "");
+	i_regexFind->AddParam("pattern", "");
+	i_regexFind->AddParam("start", 0);
+	i_regexFind->code = &intrinsic_regexFind;
+	
+	i_regexFindAll = Intrinsic::Create("");
+	i_regexFindAll->AddParam("s", "");
+	i_regexFindAll->AddParam("pattern", "");
+	i_regexFindAll->code = &intrinsic_regexFindAll;
+	
+	i_regexReplace = Intrinsic::Create("");
+	i_regexReplace->AddParam("s", "");
+	i_regexReplace->AddParam("pattern", "");
+	i_regexReplace->AddParam("replacement", "");
+	i_regexReplace->AddParam("maxCount", -1);
+	i_regexReplace->code = &intrinsic_regexReplace;
+	
+	i_regexSplit = Intrinsic::Create("");
+	i_regexSplit->AddParam("s", "");
+	i_regexSplit->AddParam("pattern", "");
+	i_regexSplit->AddParam("maxCount", -1);
+	i_regexSplit->code = &intrinsic_regexSplit;
+	
+	// END regex.* methods
+	
+	
+	// tsv.* methods
+	
+	i_tsvParse = Intrinsic::Create("");
+	i_tsvParse->AddParam("source");
+	i_tsvParse->AddParam("header", 1);
+	i_tsvParse->AddParam("convertNumbers", 1);
+	i_tsvParse->code = &intrinsic_tsvParse;
+	
+	i_tsvWrite = Intrinsic::Create("");
+	i_tsvWrite->AddParam("rows");
+	i_tsvWrite->AddParam("dest");
+	i_tsvWrite->AddParam("columns");
+	i_tsvWrite->code = &intrinsic_tsvWrite;
+	
+	// END tsv.* methods
+	
+	
+	// csv.* methods
+	
+	i_csvParse = Intrinsic::Create("");
+	i_csvParse->AddParam("source");
+	i_csvParse->AddParam("header", 1);
+	i_csvParse->AddParam("convertNumbers", 1);
+	i_csvParse->code = &intrinsic_csvParse;
+	
+	i_csvWrite = Intrinsic::Create("");
+	i_csvWrite->AddParam("rows");
+	i_csvWrite->AddParam("dest");
+	i_csvWrite->AddParam("columns");
+	i_csvWrite->code = &intrinsic_csvWrite;
+	
+	// END csv.* methods
+	
+	
+	// stdin.* methods
+	
+	i_stdinReadLine = Intrinsic::Create("");
+	i_stdinReadLine->code = &intrinsic_stdinReadLine;
+	
+	i_stdinLines = Intrinsic::Create("");
+	i_stdinLines->AddParam("maxCount", -1);
+	i_stdinLines->code = &intrinsic_stdinLines;
+	
+	i_stdinRead = Intrinsic::Create("");
+	i_stdinRead->AddParam("byteCount", -1);
+	i_stdinRead->code = &intrinsic_stdinRead;
+	
+	// END stdin.* methods
+	
 }
@@ -26,4 +26,12 @@ void AddPathEnvVars();
 void AddScriptPathVar(const char* scriptPartialPath);
 void AddShellIntrinsics();
 
+// Get the modification time and size of the given file; return false if
+// there is no such file.
+bool GetFileStamp(const MiniScript::String& path, double *outModTime, double *outSize);
+
+// Read and parse (ahead of time) the modules the given source imports by
+// name, and any they import in turn, so that `import` finds them ready.
+void PreloadImports(const MiniScript::String& source);
+
 #endif // SHELLINTRINSICS_H
@@ -0,0 +1,311 @@
+//
+//  ShellServer.cpp
+//  MiniScript
+//
+//	A request, on the wire, is a 4-byte length followed by that many bytes of
+//	NUL-terminated strings: the client's working directory, then the script
+//	path and its arguments.  The client's stdin, stdout and stderr ride along
+//	with the length (as SCM_RIGHTS ancillary data).  When the script is done,
+//	the server replies with its 4-byte exit code.
+//
+
+#include "ShellServer.h"
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#if _WIN32 || _WIN64
+	#define WINDOWS 1
+#else
+	#include <unistd.h>
+	#include <signal.h>
+	#include <sys/stat.h>
+	#include <sys/socket.h>
+	#include <sys/un.h>
+#endif
+
+namespace MiniScript {
+
+#if WINDOWS
+
+int Serve(const char *socketPath, ServePrepareMethod prepare, ServeRunMethod run) {
+	std::cerr << "Server mode is not supported on Windows" << std::endl;
+	return -1;
+}
+
+int ServeClient(const char *socketPath, const StringList& args) {
+	std::cerr << "Server mode is not supported on Windows" << std::endl;
+	return -1;
+}
+
+#else
+
+// Largest request we'll accept (just a sanity check on the length we're sent).
+static const uint32_t kMaxRequestSize = 1024 * 1024;
+
+static bool ReadFully(int fd, void *buf, size_t bytes) {
+	char *p = (char*)buf;
+	while (bytes > 0) {
+		ssize_t got = read(fd, p, bytes);
+		if (got < 0 and errno == EINTR) continue;
+		if (got <= 0) return false;
+		p += got;
+		bytes -= got;
+	}
+	return true;
+}
+
+static bool WriteFully(int fd, const void *buf, size_t bytes) {
+	const char *p = (const char*)buf;
+	while (bytes > 0) {
+		ssize_t put = write(fd, p, bytes);
+		if (put < 0 and errno == EINTR) continue;
+		if (put <= 0) return false;
+		p += put;
+		bytes -= put;
+	}
+	return true;
+}
+
+static bool MakeAddress(const char *socketPath, struct sockaddr_un *outAddr) {
+	memset(outAddr, 0, sizeof(*outAddr));
+	outAddr->sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(outAddr->sun_path)) {
+		std::cerr << "Socket path too long: " << socketPath << std::endl;
+		return false;
+	}
+	strcpy(outAddr->sun_path, socketPath);
+	return true;
+}
+
+// Remove a socket left behind by a previous server, so we can bind to its
+// path.  Anything else there (a file, or a server still listening) is left
+// alone, and reported as an error.
+static bool ClearStaleSocket(const char *socketPath, const struct sockaddr_un& addr) {
+	struct stat stats;
+	if (lstat(socketPath, &stats) != 0) return true;	// (nothing there)
+	if (!S_ISSOCK(stats.st_mode)) {
+		std::cerr << "Can't listen on " << socketPath << ": not a socket" << std::endl;
+		return false;
+	}
+	int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (probe < 0) {
+		std::cerr << "Can't create socket: " << strerror(errno) << std::endl;
+		return false;
+	}
+	bool stale = (connect(probe, (const struct sockaddr*)&addr, sizeof(addr)) != 0 and errno == ECONNREFUSED);
+	close(probe);
+	if (!stale) {
+		std::cerr << "Can't listen on " << socketPath << ": a server is already running there" << std::endl;
+		return false;
+	}
+	if (unlink(socketPath) != 0) {
+		std::cerr << "Can't remove old socket " << socketPath << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Read a request (and the three file descriptors that come with it).
+static bool ReceiveRequest(int conn, ServeRequest *outRequest, int outFds[3]) {
+	uint32_t length = 0;
+	struct iovec iov;
+	iov.iov_base = &length;
+	iov.iov_len = sizeof(length);
+	union {
+		char buf[CMSG_SPACE(3 * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	ssize_t got;
+	do {
+		got = recvmsg(conn, &msg, 0);
+	} while (got < 0 and errno == EINTR);
+	if (got <= 0) return false;
+
+	int fdCount = 0;
+	for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+		if (c->cmsg_level != SOL_SOCKET or c->cmsg_type != SCM_RIGHTS) continue;
+		int n = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+		int *fds = (int*)CMSG_DATA(c);
+		for (int i=0; i<n; i++) {
+			if (fdCount < 3) outFds[fdCount++] = fds[i];
+			else close(fds[i]);
+		}
+	}
+	bool ok = (fdCount == 3);
+	if (ok and got < (ssize_t)sizeof(length)) {
+		ok = ReadFully(conn, (char*)&length + got, sizeof(length) - got);
+	}
+	ok = ok and length > 0 and length <= kMaxRequestSize;
+
+	char *payload = nullptr;
+	if (ok) {
+		payload = new char[length + 1];
+		ok = ReadFully(conn, payload, length);
+		payload[length] = 0;
+	}
+	if (ok) {
+		// Split into strings: the working directory, then the script args.
+		const char *end = payload + length;
+		outRequest->cwd = payload;
+		for (const char *p = payload + outRequest->cwd.LengthB() + 1; p < end; p += strlen(p) + 1) {
+			outRequest->args.Add(p);
+		}
+		ok = outRequest->args.Count() > 0;
+	}
+	delete[] payload;
+
+	if (!ok) {
+		for (int i=0; i<fdCount; i++) close(outFds[i]);
+	}
+	return ok;
+}
+
+static void SendResult(int conn, int result) {
+	int32_t code = result;
+	WriteFully(conn, &code, sizeof(code));
+}
+
+static void HandleConnection(int listener, int conn, ServePrepareMethod prepare, ServeRunMethod run) {
+	ServeRequest request;
+	int fds[3];
+	if (!ReceiveRequest(conn, &request, fds)) return;
+
+	if (chdir(request.cwd.c_str()) != 0) {
+		String err = String("Can't change to directory ") + request.cwd + ": " + strerror(errno) + "\n";
+		WriteFully(fds[2], err.c_str(), err.LengthB());
+		SendResult(conn, -1);
+	} else {
+		if (prepare) prepare(request);
+		std::cout << std::flush;
+		std::cerr << std::flush;
+		pid_t pid = fork();
+		if (pid == 0) {
+			// In the child: take over the client's standard I/O, and run the script.
+			close(listener);
+			for (int i=0; i<3; i++) {
+				dup2(fds[i], i);
+				if (fds[i] > 2) close(fds[i]);
+			}
+			signal(SIGPIPE, SIG_DFL);
+			signal(SIGCHLD, SIG_DFL);	// (so exec and friends can wait for their children)
+			int result = run(request);
+			std::cout << std::flush;
+			std::cerr << std::flush;
+			SendResult(conn, result);
+			_exit(0);
+		}
+		if (pid < 0) {
+			String err = String("Can't fork: ") + strerror(errno) + "\n";
+			WriteFully(fds[2], err.c_str(), err.LengthB());
+			SendResult(conn, -1);
+		}
+	}
+	for (int i=0; i<3; i++) close(fds[i]);
+}
+
+int Serve(const char *socketPath, ServePrepareMethod prepare, ServeRunMethod run) {
+	struct sockaddr_un addr;
+	if (!MakeAddress(socketPath, &addr)) return -1;
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		std::cerr << "Can't create socket: " << strerror(errno) << std::endl;
+		return -1;
+	}
+	if (!ClearStaleSocket(socketPath, addr)) {
+		close(listener);
+		return -1;
+	}
+	if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 or listen(listener, SOMAXCONN) != 0) {
+		std::cerr << "Can't listen on " << socketPath << ": " << strerror(errno) << std::endl;
+		close(listener);
+		return -1;
+	}
+
+	signal(SIGCHLD, SIG_IGN);	// (so finished children are reaped automatically)
+	signal(SIGPIPE, SIG_IGN);	// (so a client that goes away can't kill the server)
+
+	while (true) {
+		int conn = accept(listener, nullptr, nullptr);
+		if (conn < 0) {
+			if (errno == EINTR or errno == ECONNABORTED) continue;
+			std::cerr << "Can't accept connection: " << strerror(errno) << std::endl;
+			close(listener);
+			return -1;
+		}
+		HandleConnection(listener, conn, prepare, run);
+		close(conn);
+	}
+}
+
+int ServeClient(const char *socketPath, const StringList& args) {
+	struct sockaddr_un addr;
+	if (!MakeAddress(socketPath, &addr)) return -1;
+
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0 or connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		std::cerr << "Can't connect to server at " << socketPath << ": " << strerror(errno) << std::endl;
+		if (sock >= 0) close(sock);
+		return -1;
+	}
+
+	char *cwd = getcwd(nullptr, 0);
+	StringBuilder payload;
+	if (cwd) payload.Append(cwd, strlen(cwd) + 1);
+	else payload.Append(".", 2);
+	free(cwd);
+	for (long i=0; i<args.Count(); i++) payload.Append(args[i].c_str(), args[i].LengthB() + 1);
+
+	// Send the length, with our standard I/O attached; then the request itself.
+	uint32_t length = (uint32_t)payload.LengthB();
+	struct iovec iov;
+	iov.iov_base = &length;
+	iov.iov_len = sizeof(length);
+	union {
+		char buf[CMSG_SPACE(3 * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+	c->cmsg_level = SOL_SOCKET;
+	c->cmsg_type = SCM_RIGHTS;
+	c->cmsg_len = CMSG_LEN(3 * sizeof(int));
+	int stdFds[3] = { 0, 1, 2 };
+	memcpy(CMSG_DATA(c), stdFds, sizeof(stdFds));
+
+	ssize_t sent;
+	do {
+		sent = sendmsg(sock, &msg, 0);
+	} while (sent < 0 and errno == EINTR);
+	bool ok = (sent == (ssize_t)sizeof(length)) and WriteFully(sock, payload.data(), payload.LengthB());
+
+	// Then wait for the script's result code.
+	int32_t result = -1;
+	if (ok) ok = ReadFully(sock, &result, sizeof(result));
+	close(sock);
+	if (!ok) {
+		std::cerr << "Lost connection to server at " << socketPath << std::endl;
+		return -1;
+	}
+	return result;
+}
+
+#endif
+
+}
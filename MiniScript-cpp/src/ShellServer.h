@@ -0,0 +1,48 @@
+//
+//  ShellServer.h
+//  MiniScript
+//
+//	Server mode (`--serve socketPath`): a long-lived process that listens on
+//	a Unix-domain socket, and runs a script for each request it gets, so the
+//	cost of starting up (and of compiling scripts it has seen before) is paid
+//	only once.  The client (`--client socketPath script args...`) passes its
+//	own standard input, output and error along with the request, so the
+//	script reads and writes them directly, just as if it had been run
+//	the usual way; the client then exits with the script's result code.
+//
+//	Each request is run in a forked copy of the server, so one script can't
+//	disturb the next (or the warm state they all start from).
+//
+
+#ifndef SHELLSERVER_H
+#define SHELLSERVER_H
+
+#include "SimpleString.h"
+#include "SplitJoin.h"
+
+namespace MiniScript {
+
+// One request to run a script.
+struct ServeRequest {
+	String cwd;			// client's working directory
+	StringList args;	// script path, followed by its arguments
+};
+
+// Called in the server process for each request, just before forking the
+// process that will run it; a chance to warm up caches for next time.
+typedef void (*ServePrepareMethod)(const ServeRequest& request);
+
+// Called in the forked process, to run the request and return its exit code.
+typedef int (*ServeRunMethod)(const ServeRequest& request);
+
+// Listen on the given socket path, and handle requests until killed.
+// Returns only on error (with an error code, after printing a message).
+int Serve(const char *socketPath, ServePrepareMethod prepare, ServeRunMethod run);
+
+// Send a request to run the given script and arguments to a server, and
+// wait for it to finish.  Returns the script's exit code, or -1 on error.
+int ServeClient(const char *socketPath, const StringList& args);
+
+}
+
+#endif /* SHELLSERVER_H */
@@ -11,6 +11,7 @@
 #include <string>
 #include <chrono>
 #include <thread>
+#include <stdlib.h>
 #include "MiniScript/SimpleString.h"
 #include "MiniScript/UnicodeUtil.h"
 #include "MiniScript/UnitTest.h"
@@ -22,8 +23,10 @@
 #include "OstreamSupport.h"
 #include "MiniScript/SplitJoin.h"
 #include "ShellIntrinsics.h"
+#include "ShellServer.h"
 #include "DateTimeUtils.h"	// TEMP for initial testing
 #include "TermIntrinsics.h"
+#include "MatrixIntrinsics.h"
 
 // YIELD_NANOSECONDS: How many nano-seconds to sleep when yielding.
 #define YIELD_NANOSECONDS 10000000
@@ -52,11 +55,12 @@ static int ReturnErr(String s, int errCode = -1) {
 // Phase 2.2: Lazy loading helpers
 static bool shellIntrinsicsLoaded = false;
 static bool termIntrinsicsLoaded = false;
+static bool matrixIntrinsicsLoaded = false;
 
 static bool IsShellFunction(const String& funcName) {
 	static const char* SHELL_FUNCTIONS[] = {
-		"exit", "shellArgs", "env", "input", "import", "file", "_dateVal", "_dateStr",
-		"exec", "RawData", "key", "version", "print", "clear", "reset", "stackTrace", "debugMode"
+		"exit", "shellArgs", "env", "input", "stdin", "import", "file", "_dateVal", "_dateStr",
+		"exec", "execAll", "spawn", "RawData", "key", "regex", "tsv", "csv", "version", "print", "clear", "reset", "stackTrace", "debugMode"
 	};
 	static const int numFunctions = sizeof(SHELL_FUNCTIONS) / sizeof(SHELL_FUNCTIONS[0]);
 	
@@ -88,8 +92,8 @@ static void PreloadRequiredIntrinsics(const String& code) {
 	// Scan the code for function names that require shell or terminal intrinsics
 	if (!shellIntrinsicsLoaded) {
 		const char* SHELL_FUNCTIONS[] = {
-			"exit", "shellArgs", "env", "input", "import", "file", "_dateVal", "_dateStr",
-			"exec", "RawData", "key", "version", "print", "clear", "reset", "stackTrace", "debugMode"
+			"exit", "shellArgs", "env", "input", "stdin", "import", "file", "_dateVal", "_dateStr",
+			"exec", "execAll", "spawn", "RawData", "key", "regex", "tsv", "csv", "version", "print", "clear", "reset", "stackTrace", "debugMode"
 		};
 		const int numShellFuncs = sizeof(SHELL_FUNCTIONS) / sizeof(SHELL_FUNCTIONS[0]);
 		
@@ -116,6 +120,11 @@ static void PreloadRequiredIntrinsics(const String& code) {
 			}
 		}
 	}
+	
+	if (!matrixIntrinsicsLoaded and code.IndexOf("matrix") != -1) {
+		AddMatrixIntrinsics();
+		matrixIntrinsicsLoaded = true;
+	}
 }
 
 static void PrintHeaderInfo() {
@@ -135,11 +144,13 @@ static void PrintHelp(String cmdPath) {
 	Print(String("usage: ") + cmdPath + " [option] ... [-c cmd | file | -]");
 	Print("Options and arguments:");
 	Print("-c cmd : program passed in as String (terminates option list)");
+	Print("--client socket file [arg ...] : run 'file' on the server listening at 'socket'");
 	Print("--dumpTAC : print intermediate code");
 	Print("-h     : print this help message and exit (also -? or --help)");
 	Print("-i     : enter interactive mode after executing 'file'");
 	Print("--itest suite_file : run integration tests");
 	Print("-q     : suppress header info");
+	Print("--serve socket : run as a server for --client requests, listening at 'socket'");
 	Print("file   : program read from script file");
 	Print("-      : program read from stdin (default; interactive mode if a tty)");
 }
@@ -186,16 +197,8 @@ static int DoREPL(Interpreter &interp) {
 	}
 }
 
-static int DoCommand(Interpreter &interp, String cmd) {
-	// Phase 2.2: Preload required intrinsics based on code analysis
-	PreloadRequiredIntrinsics(cmd);
-	
-	interp.Reset(cmd);
-	interp.Compile();
-	
-//	std::cout << cmd << std::endl;
-	
-	if (dumpTAC) {
+static int RunCompiled(Interpreter &interp) {
+	if (dumpTAC and interp.vm) {
 		Context *c = interp.vm->GetGlobalContext();
 		for (long i=0; i<c->code.Count(); i++) {
 			std::cout << i << ". " << c->code[i].ToString() << std::endl;
@@ -205,7 +208,7 @@ static int DoCommand(Interpreter &interp, String cmd) {
 	while (!interp.Done()) {
 		try {
 			interp.RunUntilDone();
-			std::this_thread::sleep_for(std::chrono::nanoseconds(YIELD_NANOSECONDS));
+			if (!interp.Done()) std::this_thread::sleep_for(std::chrono::nanoseconds(YIELD_NANOSECONDS));
 		} catch (MiniscriptException& mse) {
 			std::cerr << "Runtime Exception: " << mse.message << std::endl;
 			interp.vm->Stop();
@@ -217,13 +220,24 @@ static int DoCommand(Interpreter &interp, String cmd) {
 	return -1;
 }
 
-static int DoScriptFile(Interpreter &interp, String path) {
-	// Read the file
+static int DoCommand(Interpreter &interp, String cmd) {
+	// Phase 2.2: Preload required intrinsics based on code analysis
+	PreloadRequiredIntrinsics(cmd);
+	
+	interp.Reset(cmd);
+	interp.Compile();
+	
+//	std::cout << cmd << std::endl;
+	
+	return RunCompiled(interp);
+}
+
+static bool ReadScriptFile(String path, String *outSource) {
 	List<String> source;
 	std::ifstream infile(path.c_str());
 	if (!infile.is_open()) {
 		std::cerr << "Error opening file: " << path.c_str() << std::endl;
-		return -1;
+		return false;
 	}
 	std::string line;
 	while (std::getline(infile, line)) {
@@ -234,8 +248,96 @@ static int DoScriptFile(Interpreter &interp, String path) {
 	// Comment out the first line, if it's a hashbang
 	if (source.Count() > 0 and source[0].StartsWith("#!")) source[0] = "// " + source[0];
 	
-	// Concatenate and execute the code.
-	return DoCommand(interp, Join("\n", source));
+	*outSource = Join("\n", source);
+	return true;
+}
+
+static int DoScriptFile(Interpreter &interp, String path) {
+	// Read the file, then concatenate and execute the code.
+	String source;
+	if (!ReadScriptFile(path, &source)) return -1;
+	return DoCommand(interp, source);
+}
+
+// Server mode: scripts the server has compiled, by full path.  Each request
+// runs in a forked copy of the server, so these stay as they were compiled,
+// ready to run again.
+struct WarmScript {
+	double modTime;
+	double size;
+	String source;
+	Interpreter *interp;
+};
+static Dictionary<String, WarmScript, hashString> warmScripts;
+
+static void IgnoreOutput(String, bool=true) {}
+
+static String FullPath(String path) {
+#if _WIN32 || _WIN64
+	char s[512];
+	if (!_fullpath(s, path.c_str(), sizeof(s))) return path;
+	return String(s);
+#else
+	char *s = realpath(path.c_str(), nullptr);
+	if (!s) return path;
+	String result(s);
+	free(s);
+	return result;
+#endif
+}
+
+static void PrepareServeRequest(const ServeRequest& request) {
+	// Make sure we have the requested script compiled (and its imports parsed),
+	// so that the forked process (and every one after it) can just run it.
+	String path = FullPath(request.args[0]);
+	double modTime, size;
+	if (!GetFileStamp(path, &modTime, &size)) return;
+	AddScriptPathVar(path.c_str());
+	
+	WarmScript warm;
+	if (warmScripts.Get(path, &warm)) {
+		if (warm.modTime == modTime and warm.size == size) {
+			PreloadImports(warm.source);
+			return;
+		}
+		delete warm.interp;
+		warmScripts.Remove(path);
+	}
+	
+	String source;
+	if (!ReadScriptFile(path, &source)) return;
+	warm.modTime = modTime;
+	warm.size = size;
+	warm.source = source;
+	warm.interp = new Interpreter(source);
+	ConfigInterpreter(*warm.interp);
+	warm.interp->errorOutput = &IgnoreOutput;	// (errors get reported when the script is run)
+	warm.interp->Compile();
+	if (!warm.interp->vm) {
+		delete warm.interp;
+		return;
+	}
+	warmScripts.SetValue(path, warm);
+	PreloadImports(source);
+}
+
+static int RunServeRequest(const ServeRequest& request) {
+	String path = request.args[0];
+	shellArgs = ValueList();
+	for (long i=0; i<request.args.Count(); i++) shellArgs.Add(request.args[i]);
+	AddScriptPathVar(path.c_str());
+	
+	int rc;
+	WarmScript warm;
+	if (warmScripts.Get(FullPath(path), &warm)) {
+		ConfigInterpreter(*warm.interp);
+		rc = RunCompiled(*warm.interp);
+	} else {
+		Interpreter interp;
+		ConfigInterpreter(interp);
+		rc = DoScriptFile(interp, path);
+	}
+	return exitASAP ? exitResult : rc;
 }
 
 static List<String> testOutput;
@@ -334,6 +436,15 @@ void PrepareShellArgs(int argc, const char* argv[], int startingAt) {
 
 int main(int argc, const char * argv[]) {
 	
+	// Client mode: hand the script off to a server, before doing anything else
+	// (starting fast is the whole point).
+	if (argc > 1 and String(argv[1]) == "--client") {
+		if (argc < 4) return ReturnErr("Socket path and script file expected after --client option");
+		StringList args;
+		for (int i=3; i<argc; i++) args.Add(argv[i]);
+		return ServeClient(argv[2], args);
+	}
+	
 #if(DEBUG)
 	std::cout << "StringStorage instances at start (from static keywords, etc.): " << StringStorage::instanceCount << std::endl;
 	std::cout << "total RefCountedStorage instances at start (from static keywords, etc.): " << RefCountedStorage::instanceCount << std::endl;
@@ -389,6 +500,16 @@ int main(int argc, const char * argv[]) {
 			if (i >= argc) return ReturnErr("Path to test suite expected after --itest option");
 			RunIntegrationTests(argv[i]);
 			return 0;
+		} else if (arg == "--serve") {
+			i++;
+			if (i >= argc) return ReturnErr("Socket path expected after --serve option");
+			// Load everything up front, so each request starts warm.
+			Intrinsics::InitIfNeeded();
+			AddShellIntrinsics();
+			AddTermIntrinsics();
+			AddMatrixIntrinsics();
+			shellIntrinsicsLoaded = termIntrinsicsLoaded = matrixIntrinsicsLoaded = true;
+			return Serve(argv[i], &PrepareServeRequest, &RunServeRequest);
 		} else if (arg == "-") {
 			PrintHeaderInfo();
 			PrepareShellArgs(argc, argv, i);